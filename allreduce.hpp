@@ -0,0 +1,349 @@
+#ifndef ALLREDUCE_HPP
+#define ALLREDUCE_HPP
+
+#include <mpi.h>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "mpi_wrap.hpp"
+
+// In-place allreduce of large vectors built on point-to-point messages.
+//
+//   recursive_doubling  log2(P) exchanges of the whole vector; latency-optimal,
+//                       for short vectors
+//   ring                reduce-scatter then allgather around a ring, 2(P-1) steps of
+//                       count/P elements; bandwidth-optimal, for long vectors
+//   rabenseifner        reduce-scatter by recursive halving, allgather by recursive
+//                       doubling: the ring's volume in log2(P) steps
+//   automatic           picks one of the above from the vector length and P
+//
+// Non-power-of-two process counts are folded: the first 2 * (P - pof2) ranks pair
+// up, one of each pair hands its vector to the other and sits out, and gets the
+// result back at the end. Ops must be commutative and associative.
+//
+// An op is a type with a static combine(const T* in, T* inout, size_t n) that
+// computes inout[i] = in[i] op inout[i]; the ones below are written with GCC
+// vector extensions so the loop is SIMD regardless of optimisation flags. Any op
+// can also be registered with MPI_Op_create through op_handle<Op, T>() to be used
+// with MPI_Allreduce and friends.
+//
+// Functions are collective over comm and return the first MPI error code, or
+// MPI_SUCCESS. Counts are limited to INT_MAX elements of any type mpi_wrap.hpp
+// maps to an MPI datatype. The point-to-point messages use tag (default_tag
+// unless given) on comm itself: while an allreduce runs, the caller must not have
+// messages on that tag in flight on comm, nor MPI_ANY_TAG receives posted there,
+// or they may match its segments. Pass a tag the caller leaves alone, or a
+// duplicate of comm.
+
+namespace allreduce {
+
+enum class Algorithm { ring, recursive_doubling, rabenseifner, automatic };
+
+const int default_tag = 7002;                // Tag of the point-to-point traffic unless one is given
+const size_t short_vector = 8 << 10;         // Bytes below which recursive doubling wins
+const size_t long_vector = 512 << 10;        // Bytes from which the ring wins on non-power-of-two P
+
+inline const char* name(Algorithm alg) {
+    switch (alg) {
+    case Algorithm::ring: return "ring";
+    case Algorithm::recursive_doubling: return "recursive_doubling";
+    case Algorithm::rabenseifner: return "rabenseifner";
+    default: return "auto";
+    }
+}
+
+inline bool parse(const char* text, Algorithm& alg) {
+    for (Algorithm a : {Algorithm::ring, Algorithm::recursive_doubling, Algorithm::rabenseifner, Algorithm::automatic}) {
+        if (std::strcmp(text, name(a)) == 0) {
+            alg = a;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Algorithm used by Algorithm::automatic
+inline Algorithm select(size_t bytes, int size) {
+    if (bytes < short_vector) {
+        return Algorithm::recursive_doubling;
+    }
+    bool power_of_two = (size & (size - 1)) == 0;
+    if (!power_of_two && bytes >= long_vector) {
+        return Algorithm::ring;
+    }
+    return Algorithm::rabenseifner;
+}
+
+namespace detail {
+
+// Apply vec_fn to whole 64-byte vectors of in/inout, then scalar_fn to the tail
+template <typename T, typename VecFn, typename ScalarFn>
+inline void simd_combine(const T* in, T* inout, size_t n, VecFn vec_fn, ScalarFn scalar_fn) {
+    typedef T V __attribute__((vector_size(64)));
+    constexpr size_t L = sizeof(V) / sizeof(T);
+    size_t i = 0;
+    for (; i + L <= n; i += L) {
+        V a, b;
+        std::memcpy(&a, in + i, sizeof(V));
+        std::memcpy(&b, inout + i, sizeof(V));
+        vec_fn(a, b);
+        std::memcpy(inout + i, &b, sizeof(V));
+    }
+    for (; i < n; ++i) {
+        inout[i] = scalar_fn(in[i], inout[i]);
+    }
+}
+
+} // namespace detail
+
+struct Sum {
+    template <typename T>
+    static void combine(const T* in, T* inout, size_t n) {
+        detail::simd_combine(in, inout, n, [](const auto& a, auto& b) { b += a; }, [](T a, T b) { return a + b; });
+    }
+};
+
+struct Max {
+    template <typename T>
+    static void combine(const T* in, T* inout, size_t n) {
+        detail::simd_combine(in, inout, n, [](const auto& a, auto& b) { b = a > b ? a : b; },
+                             [](T a, T b) { return a > b ? a : b; });
+    }
+};
+
+struct Min {
+    template <typename T>
+    static void combine(const T* in, T* inout, size_t n) {
+        detail::simd_combine(in, inout, n, [](const auto& a, auto& b) { b = a < b ? a : b; },
+                             [](T a, T b) { return a < b ? a : b; });
+    }
+};
+
+namespace detail {
+
+template <typename Op, typename T>
+void user_function(void* in, void* inout, int* len, MPI_Datatype*) {
+    Op::combine(static_cast<const T*>(in), static_cast<T*>(inout), (size_t)*len);
+}
+
+} // namespace detail
+
+// MPI_Op running Op::combine on T, created on first use and freed by MPI_Finalize
+template <typename Op, typename T>
+MPI_Op op_handle() {
+    static MPI_Op op = [] {
+        MPI_Op created;
+        MPI_Op_create(detail::user_function<Op, T>, 1, &created);
+        return created;
+    }();
+    return op;
+}
+
+namespace detail {
+
+// Ranks taking part after folding to a power of two: the even rank of each of the
+// first rem pairs sends its vector to the odd one and waits for the result
+struct Fold {
+    int pof2, rem, newrank;
+
+    Fold(int rank, int size) {
+        pof2 = 1;
+        while (pof2 * 2 <= size) {
+            pof2 *= 2;
+        }
+        rem = size - pof2;
+        if (rank < 2 * rem) {
+            newrank = rank % 2 == 0 ? -1 : rank / 2;
+        } else {
+            newrank = rank - rem;
+        }
+    }
+
+    int real_rank(int r) const {
+        return r < rem ? r * 2 + 1 : r + rem;
+    }
+};
+
+template <typename T, typename Op>
+int fold_in(T* data, T* tmp, int count, const Fold& f, int rank, MPI_Comm comm, int tag) {
+    if (rank >= 2 * f.rem) {
+        return MPI_SUCCESS;
+    }
+    if (rank % 2 == 0) {
+        return MPI_Send(data, count, mpiw::datatype<T>(), rank + 1, tag, comm);
+    }
+    int err = MPI_Recv(tmp, count, mpiw::datatype<T>(), rank - 1, tag, comm, MPI_STATUS_IGNORE);
+    Op::combine(tmp, data, (size_t)count);
+    return err;
+}
+
+template <typename T>
+int fold_out(T* data, int count, const Fold& f, int rank, MPI_Comm comm, int tag) {
+    if (rank >= 2 * f.rem) {
+        return MPI_SUCCESS;
+    }
+    if (rank % 2 == 0) {
+        return MPI_Recv(data, count, mpiw::datatype<T>(), rank + 1, tag, comm, MPI_STATUS_IGNORE);
+    }
+    return MPI_Send(data, count, mpiw::datatype<T>(), rank - 1, tag, comm);
+}
+
+template <typename T, typename Op>
+int recursive_doubling(T* data, int count, MPI_Comm comm, int rank, int size, int tag) {
+    std::vector<T> tmp(count);
+    Fold f(rank, size);
+    int err = fold_in<T, Op>(data, tmp.data(), count, f, rank, comm, tag);
+    if (err != MPI_SUCCESS) {
+        return err;
+    }
+    if (f.newrank >= 0) {
+        for (int mask = 1; mask < f.pof2; mask <<= 1) {
+            int partner = f.real_rank(f.newrank ^ mask);
+            err = MPI_Sendrecv(data, count, mpiw::datatype<T>(), partner, tag, tmp.data(), count, mpiw::datatype<T>(),
+                               partner, tag, comm, MPI_STATUS_IGNORE);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+            Op::combine(tmp.data(), data, (size_t)count);
+        }
+    }
+    return fold_out(data, count, f, rank, comm, tag);
+}
+
+template <typename T, typename Op>
+int ring(T* data, int count, MPI_Comm comm, int rank, int size, int tag) {
+    // Segment s is [offset(s), offset(s + 1))
+    int base = count / size, extra = count % size;
+    auto offset = [&](int s) { return s * base + std::min(s, extra); };
+    auto length = [&](int s) { return base + (s < extra ? 1 : 0); };
+    std::vector<T> tmp(base + 1);
+    int left = (rank - 1 + size) % size, right = (rank + 1) % size;
+
+    // Reduce-scatter: after step s the segment received holds s + 2 contributions
+    for (int s = 0; s < size - 1; ++s) {
+        int send_seg = (rank - s + size) % size, recv_seg = (rank - s - 1 + size) % size;
+        int err = MPI_Sendrecv(data + offset(send_seg), length(send_seg), mpiw::datatype<T>(), right, tag, tmp.data(),
+                               length(recv_seg), mpiw::datatype<T>(), left, tag, comm, MPI_STATUS_IGNORE);
+        if (err != MPI_SUCCESS) {
+            return err;
+        }
+        Op::combine(tmp.data(), data + offset(recv_seg), (size_t)length(recv_seg));
+    }
+
+    // Allgather: segment rank + 1 is complete here; pass completed segments around
+    for (int s = 0; s < size - 1; ++s) {
+        int send_seg = (rank + 1 - s + size) % size, recv_seg = (rank - s + size) % size;
+        int err = MPI_Sendrecv(data + offset(send_seg), length(send_seg), mpiw::datatype<T>(), right, tag,
+                               data + offset(recv_seg), length(recv_seg), mpiw::datatype<T>(), left, tag, comm,
+                               MPI_STATUS_IGNORE);
+        if (err != MPI_SUCCESS) {
+            return err;
+        }
+    }
+    return MPI_SUCCESS;
+}
+
+template <typename T, typename Op>
+int rabenseifner(T* data, int count, MPI_Comm comm, int rank, int size, int tag) {
+    std::vector<T> tmp(count);
+    Fold f(rank, size);
+    int err = fold_in<T, Op>(data, tmp.data(), count, f, rank, comm, tag);
+    if (err != MPI_SUCCESS) {
+        return err;
+    }
+
+    if (f.newrank >= 0) {
+        int pof2 = f.pof2;
+        std::vector<int> cnts(pof2), disps(pof2 + 1, 0);
+        for (int i = 0; i < pof2; ++i) {
+            cnts[i] = count / pof2 + (i < count % pof2 ? 1 : 0);
+            disps[i + 1] = disps[i] + cnts[i];
+        }
+        auto span = [&](int lo, int hi) { return disps[hi] - disps[lo]; };
+
+        // Reduce-scatter by recursive halving: keep half of the current range each step
+        int mask = 1, send_idx = 0, recv_idx = 0, last_idx = pof2;
+        while (mask < pof2) {
+            int partner = f.real_rank(f.newrank ^ mask);
+            int half = pof2 / (mask * 2);
+            int send_cnt, recv_cnt;
+            if (f.newrank < (f.newrank ^ mask)) {
+                send_idx = recv_idx + half;
+                send_cnt = span(send_idx, last_idx);
+                recv_cnt = span(recv_idx, send_idx);
+            } else {
+                recv_idx = send_idx + half;
+                send_cnt = span(send_idx, recv_idx);
+                recv_cnt = span(recv_idx, last_idx);
+            }
+            err = MPI_Sendrecv(data + disps[send_idx], send_cnt, mpiw::datatype<T>(), partner, tag,
+                               tmp.data() + disps[recv_idx], recv_cnt, mpiw::datatype<T>(), partner, tag, comm,
+                               MPI_STATUS_IGNORE);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+            Op::combine(tmp.data() + disps[recv_idx], data + disps[recv_idx], (size_t)recv_cnt);
+            send_idx = recv_idx;
+            mask <<= 1;
+            if (mask < pof2) {
+                last_idx = recv_idx + pof2 / mask;
+            }
+        }
+
+        // Allgather by recursive doubling: retrace the steps in reverse
+        mask >>= 1;
+        while (mask > 0) {
+            int partner = f.real_rank(f.newrank ^ mask);
+            int half = pof2 / (mask * 2);
+            int send_cnt, recv_cnt;
+            if (f.newrank < (f.newrank ^ mask)) {
+                if (mask != pof2 / 2) {
+                    last_idx = last_idx + half;
+                }
+                recv_idx = send_idx + half;
+                send_cnt = span(send_idx, recv_idx);
+                recv_cnt = span(recv_idx, last_idx);
+            } else {
+                recv_idx = send_idx - half;
+                send_cnt = span(send_idx, last_idx);
+                recv_cnt = span(recv_idx, send_idx);
+            }
+            err = MPI_Sendrecv(data + disps[send_idx], send_cnt, mpiw::datatype<T>(), partner, tag,
+                               data + disps[recv_idx], recv_cnt, mpiw::datatype<T>(), partner, tag, comm,
+                               MPI_STATUS_IGNORE);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+            if (f.newrank > (f.newrank ^ mask)) {
+                send_idx = recv_idx;
+            }
+            mask >>= 1;
+        }
+    }
+    return fold_out(data, count, f, rank, comm, tag);
+}
+
+} // namespace detail
+
+// Combine data across all ranks of comm with Op, leaving the result in data everywhere
+template <typename T, typename Op = Sum>
+int allreduce(T* data, size_t count, MPI_Comm comm, Algorithm alg = Algorithm::automatic, int tag = default_tag) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    if (size == 1 || count == 0) {
+        return MPI_SUCCESS;
+    }
+    if (alg == Algorithm::automatic) {
+        alg = select(count * sizeof(T), size);
+    }
+    switch (alg) {
+    case Algorithm::ring: return detail::ring<T, Op>(data, (int)count, comm, rank, size, tag);
+    case Algorithm::rabenseifner: return detail::rabenseifner<T, Op>(data, (int)count, comm, rank, size, tag);
+    default: return detail::recursive_doubling<T, Op>(data, (int)count, comm, rank, size, tag);
+    }
+}
+
+} // namespace allreduce
+
+#endif // ALLREDUCE_HPP
@@ -0,0 +1,230 @@
+#ifndef BCAST_HPP
+#define BCAST_HPP
+
+#include <mpi.h>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+
+// Broadcast algorithms built on point-to-point messages.
+//
+//   linear             root sends the whole buffer to every rank in turn: (P-1) x bytes
+//                      leave the root serially (the loop e7_comtime used to time)
+//   binomial           binomial tree, log2(P) rounds of the whole buffer; best for
+//                      short messages where latency dominates
+//   scatter_allgather  van de Geijn: binomial scatter of P pieces, then a ring
+//                      allgather; every link carries about 2 x bytes in total
+//   pipeline           chain through the ranks in chunks, each rank forwarding chunk c
+//                      while chunk c + 1 arrives; approaches link bandwidth for long
+//                      messages
+//   automatic          picks one of the above from the message and communicator size
+//
+// All functions are collective over comm and return the first MPI error code, or
+// MPI_SUCCESS. Messages are limited to INT_MAX bytes. broadcast_bytes takes the
+// size in bytes, broadcast<T> in elements of T. The point-to-point messages use
+// tag (default_tag unless given) on comm itself: while a broadcast runs, the
+// caller must not have messages on that tag in flight on comm, nor MPI_ANY_TAG
+// receives posted there, or they may match broadcast fragments. Pass a tag the
+// caller leaves alone, or a duplicate of comm.
+
+namespace bcast {
+
+enum class Algorithm { linear, binomial, scatter_allgather, pipeline, automatic };
+
+const int default_tag = 7001;                 // Tag of the point-to-point traffic unless one is given
+const size_t default_chunk = 64 << 10;        // Pipeline chunk size
+const size_t short_message = 12 << 10;        // Below this binomial wins
+const size_t long_message = 512 << 10;        // From this the pipeline wins
+
+inline const char* name(Algorithm alg) {
+    switch (alg) {
+    case Algorithm::linear: return "linear";
+    case Algorithm::binomial: return "binomial";
+    case Algorithm::scatter_allgather: return "scatter_allgather";
+    case Algorithm::pipeline: return "pipeline";
+    default: return "auto";
+    }
+}
+
+inline bool parse(const char* text, Algorithm& alg) {
+    for (Algorithm a : {Algorithm::linear, Algorithm::binomial, Algorithm::scatter_allgather, Algorithm::pipeline,
+                        Algorithm::automatic}) {
+        if (std::strcmp(text, name(a)) == 0) {
+            alg = a;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Algorithm used by Algorithm::automatic
+inline Algorithm select(size_t bytes, int size) {
+    if (bytes < short_message || size <= 2) {
+        return Algorithm::binomial;
+    }
+    if (bytes < long_message) {
+        return Algorithm::scatter_allgather;
+    }
+    return Algorithm::pipeline;
+}
+
+namespace detail {
+
+inline int to_rank(int relative, int root, int size) {
+    return (relative + root) % size;
+}
+
+inline int linear(char* buf, size_t bytes, int root, MPI_Comm comm, int rank, int size, int tag) {
+    if (rank != root) {
+        return MPI_Recv(buf, (int)bytes, MPI_BYTE, root, tag, comm, MPI_STATUS_IGNORE);
+    }
+    for (int r = 0; r < size; ++r) {
+        if (r != root) {
+            int err = MPI_Send(buf, (int)bytes, MPI_BYTE, r, tag, comm);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+        }
+    }
+    return MPI_SUCCESS;
+}
+
+inline int binomial(char* buf, size_t bytes, int root, MPI_Comm comm, int rank, int size, int tag) {
+    int vr = (rank - root + size) % size;
+    int mask = 1;
+    while (mask < size) {
+        if (vr & mask) {
+            int err = MPI_Recv(buf, (int)bytes, MPI_BYTE, to_rank(vr - mask, root, size), tag, comm, MPI_STATUS_IGNORE);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+            break;
+        }
+        mask <<= 1;
+    }
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+        if (vr + mask < size) {
+            int err = MPI_Send(buf, (int)bytes, MPI_BYTE, to_rank(vr + mask, root, size), tag, comm);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+        }
+    }
+    return MPI_SUCCESS;
+}
+
+inline int scatter_allgather(char* buf, size_t bytes, int root, MPI_Comm comm, int rank, int size, int tag) {
+    int vr = (rank - root + size) % size;
+    size_t piece = (bytes + size - 1) / size;
+    // Byte range of relative ranks [first, last)
+    auto offset = [&](int r) { return std::min((size_t)r * piece, bytes); };
+
+    // Binomial scatter: each rank receives the pieces of its whole subtree from its parent
+    int mask = 1;
+    while (mask < size) {
+        if (vr & mask) {
+            size_t lo = offset(vr), hi = offset(std::min(vr + mask, size));
+            int err = MPI_Recv(buf + lo, (int)(hi - lo), MPI_BYTE, to_rank(vr - mask, root, size), tag, comm,
+                               MPI_STATUS_IGNORE);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+            break;
+        }
+        mask <<= 1;
+    }
+    for (mask >>= 1; mask > 0; mask >>= 1) {
+        if (vr + mask < size) {
+            int child = vr + mask;
+            size_t lo = offset(child), hi = offset(std::min(child + mask, size));
+            int err = MPI_Send(buf + lo, (int)(hi - lo), MPI_BYTE, to_rank(child, root, size), tag, comm);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+        }
+    }
+
+    // Ring allgather: in step s pass on the piece received in step s - 1
+    int left = to_rank((vr - 1 + size) % size, root, size), right = to_rank((vr + 1) % size, root, size);
+    for (int s = 0; s < size - 1; ++s) {
+        int send_piece = (vr - s + size) % size, recv_piece = (vr - s - 1 + size) % size;
+        size_t send_lo = offset(send_piece), send_hi = offset(send_piece + 1);
+        size_t recv_lo = offset(recv_piece), recv_hi = offset(recv_piece + 1);
+        int err = MPI_Sendrecv(buf + send_lo, (int)(send_hi - send_lo), MPI_BYTE, right, tag, buf + recv_lo,
+                               (int)(recv_hi - recv_lo), MPI_BYTE, left, tag, comm, MPI_STATUS_IGNORE);
+        if (err != MPI_SUCCESS) {
+            return err;
+        }
+    }
+    return MPI_SUCCESS;
+}
+
+inline int pipeline(char* buf, size_t bytes, int root, MPI_Comm comm, int rank, int size, size_t chunk, int tag) {
+    int vr = (rank - root + size) % size;
+    int prev = to_rank(vr - 1, root, size), next = to_rank(vr + 1, root, size);
+    bool has_next = vr + 1 < size;
+    size_t chunks = (bytes + chunk - 1) / chunk;
+    std::vector<MPI_Request> recvs(vr > 0 ? chunks : 0, MPI_REQUEST_NULL), sends(has_next ? chunks : 0, MPI_REQUEST_NULL);
+
+    // Pre-post every receive so chunks land directly in place as they arrive
+    for (size_t c = 0; c < recvs.size(); ++c) {
+        size_t lo = c * chunk, len = std::min(chunk, bytes - lo);
+        int err = MPI_Irecv(buf + lo, (int)len, MPI_BYTE, prev, tag, comm, &recvs[c]);
+        if (err != MPI_SUCCESS) {
+            return err;
+        }
+    }
+    for (size_t c = 0; c < chunks; ++c) {
+        size_t lo = c * chunk, len = std::min(chunk, bytes - lo);
+        if (vr > 0) {
+            int err = MPI_Wait(&recvs[c], MPI_STATUS_IGNORE);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+        }
+        if (has_next) {
+            int err = MPI_Isend(buf + lo, (int)len, MPI_BYTE, next, tag, comm, &sends[c]);
+            if (err != MPI_SUCCESS) {
+                return err;
+            }
+        }
+    }
+    return MPI_Waitall((int)sends.size(), sends.data(), MPI_STATUSES_IGNORE);
+}
+
+} // namespace detail
+
+// Broadcast bytes from root's buffer into every rank's buffer
+inline int broadcast_bytes(void* buffer, size_t bytes, int root, MPI_Comm comm, Algorithm alg = Algorithm::automatic,
+                           size_t chunk = default_chunk, int tag = default_tag) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    if (size == 1 || bytes == 0) {
+        return MPI_SUCCESS;
+    }
+    if (alg == Algorithm::automatic) {
+        alg = select(bytes, size);
+    }
+    char* buf = static_cast<char*>(buffer);
+    switch (alg) {
+    case Algorithm::linear: return detail::linear(buf, bytes, root, comm, rank, size, tag);
+    case Algorithm::scatter_allgather: return detail::scatter_allgather(buf, bytes, root, comm, rank, size, tag);
+    case Algorithm::pipeline:
+        return detail::pipeline(buf, bytes, root, comm, rank, size, std::max<size_t>(chunk, 1), tag);
+    default: return detail::binomial(buf, bytes, root, comm, rank, size, tag);
+    }
+}
+
+// Broadcast count elements of T; the size is always in elements, never in bytes
+template <typename T>
+int broadcast(T* data, size_t count, int root, MPI_Comm comm, Algorithm alg = Algorithm::automatic,
+              size_t chunk = default_chunk, int tag = default_tag) {
+    static_assert(!std::is_void<T>::value, "broadcast takes elements; use broadcast_bytes for untyped buffers");
+    return broadcast_bytes(data, count * sizeof(T), root, comm, alg, chunk, tag);
+}
+
+} // namespace bcast
+
+#endif // BCAST_HPP
@@ -0,0 +1,375 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+// Jacobi iteration for the steady-state heat equation on a 2D grid:
+// every interior point becomes the mean of its four neighbours until the
+// largest change in one sweep drops below --tol. The top edge is held at 1 and
+// the other edges at 0.
+//
+// The ranks form a 2D MPI_Cart_create grid and each owns a block of points plus
+// a one-point ghost frame holding its neighbours' edges. The halo exchange uses
+// persistent requests, set up once for each of the two buffers the iteration
+// alternates between; north/south edges are contiguous rows and east/west edges
+// are columns sent and received in place through an MPI_Type_vector.
+//
+//   blocking  exchange the halo, then sweep the block; check convergence with
+//             MPI_Allreduce every --check iterations
+//   overlap   start the halo exchange, sweep the inner points that need no
+//             ghosts while it is in flight, wait, then sweep the block's edges;
+//             the convergence check is an MPI_Iallreduce that runs behind the
+//             following iterations and is only waited for at the next check
+//
+// --scaling strong repeats the overlap version for a fixed number of iterations
+// (--iters) on communicators of 1, 2, 4, ... and P ranks with the --nx x --ny
+// grid split among them; --scaling weak gives every rank an --nx x --ny block
+// instead. The efficiency is T(1) / (p T(p)) for strong and T(1) / T(p) for weak
+// scaling.
+//
+// Usage: mpirun -np P ./e10 [--nx N] [--ny N] [--tol T] [--max-iters N] [--check N]
+//                           [--scaling strong|weak] [--iters N]
+
+struct Options {
+    int nx = 1024, ny = 1024;   // Interior points, globally (per rank with --scaling weak)
+    double tol = 1e-4;
+    int max_iters = 2000;
+    int check = 10;             // Iterations between convergence checks
+    std::string scaling;        // "", "strong" or "weak"
+    int iters = 200;            // Iterations per run with --scaling
+};
+
+// Block distribution of n items over p parts: the first n % p parts get one extra item
+int block_size(int n, int p, int i) {
+    return n / p + (i < n % p ? 1 : 0);
+}
+
+int block_start(int n, int p, int i) {
+    return i * (n / p) + std::min(i, n % p);
+}
+
+enum Direction { north, south, west, east };
+
+// This rank's block of the grid: rows x cols points at u[(i + 1) * ld + j + 1],
+// surrounded by the ghost frame
+struct Domain {
+    MPI_Comm cart;
+    int dims[2], coords[2];
+    int neighbour[4];          // MPI_PROC_NULL on the edge of the grid
+    int rows, cols, row0, col0, ld;
+    std::vector<double> u[2];
+    MPI_Datatype column;       // rows points, one per row of the block
+    std::vector<MPI_Request> halo[2];  // Persistent exchange of u[b]: receives, then sends
+};
+
+// Persistent requests exchanging the edges of buffer b with the four neighbours.
+// A message's tag is the direction it travels in.
+void init_halo(Domain& d, int b) {
+    double* u = d.u[b].data();
+    int ld = d.ld, rows = d.rows, cols = d.cols;
+    struct Edge {
+        Direction to;
+        double* send;
+        double* recv;
+        int count;
+        MPI_Datatype type;
+    };
+    const Edge edges[4] = {
+        {north, &u[1 * ld + 1], &u[0 * ld + 1], cols, MPI_DOUBLE},
+        {south, &u[rows * ld + 1], &u[(rows + 1) * ld + 1], cols, MPI_DOUBLE},
+        {west, &u[1 * ld + 1], &u[1 * ld + 0], 1, d.column},
+        {east, &u[1 * ld + cols], &u[1 * ld + cols + 1], 1, d.column},
+    };
+    const Direction opposite[4] = {south, north, east, west};
+    d.halo[b].resize(8);
+    for (int e = 0; e < 4; ++e) {
+        // The ghosts on side e are filled by what the neighbour there sends the opposite way
+        MPI_Recv_init(edges[e].recv, edges[e].count, edges[e].type, d.neighbour[e], opposite[e], d.cart, &d.halo[b][e]);
+        MPI_Send_init(edges[e].send, edges[e].count, edges[e].type, d.neighbour[e], edges[e].to, d.cart,
+                      &d.halo[b][4 + e]);
+    }
+}
+
+// Split a ny x nx grid over the ranks of comm; false if some rank would get no rows or columns
+bool make_domain(MPI_Comm comm, int ny, int nx, Domain& d) {
+    int size, periods[2] = {0, 0};
+    MPI_Comm_size(comm, &size);
+    d.dims[0] = d.dims[1] = 0;
+    MPI_Dims_create(size, 2, d.dims);
+    if (d.dims[0] > ny || d.dims[1] > nx) {
+        return false;
+    }
+    MPI_Cart_create(comm, 2, d.dims, periods, 1, &d.cart);
+    int rank;
+    MPI_Comm_rank(d.cart, &rank);
+    MPI_Cart_coords(d.cart, rank, 2, d.coords);
+    MPI_Cart_shift(d.cart, 0, 1, &d.neighbour[north], &d.neighbour[south]);
+    MPI_Cart_shift(d.cart, 1, 1, &d.neighbour[west], &d.neighbour[east]);
+
+    d.rows = block_size(ny, d.dims[0], d.coords[0]);
+    d.row0 = block_start(ny, d.dims[0], d.coords[0]);
+    d.cols = block_size(nx, d.dims[1], d.coords[1]);
+    d.col0 = block_start(nx, d.dims[1], d.coords[1]);
+    d.ld = d.cols + 2;
+    MPI_Type_vector(d.rows, 1, d.ld, MPI_DOUBLE, &d.column);
+    MPI_Type_commit(&d.column);
+    for (int b = 0; b < 2; ++b) {
+        d.u[b].assign((size_t)(d.rows + 2) * d.ld, 0.0);
+        // The ghost row above the top edge of the grid holds the boundary value and is never exchanged
+        if (d.neighbour[north] == MPI_PROC_NULL) {
+            std::fill(d.u[b].begin(), d.u[b].begin() + d.ld, 1.0);
+        }
+        init_halo(d, b);
+    }
+    return true;
+}
+
+void free_domain(Domain& d) {
+    for (int b = 0; b < 2; ++b) {
+        for (MPI_Request& r : d.halo[b]) {
+            MPI_Request_free(&r);
+        }
+    }
+    MPI_Type_free(&d.column);
+    MPI_Comm_free(&d.cart);
+}
+
+// v = mean of the four neighbours in u over block rows [i0, i1) and columns [j0, j1)
+// (1-based, as stored); returns the largest change
+double sweep(const double* u, double* v, int ld, int i0, int i1, int j0, int j1) {
+    double diff = 0.0;
+    for (int i = i0; i < i1; ++i) {
+        for (int j = j0; j < j1; ++j) {
+            double x = 0.25 * (u[(i - 1) * ld + j] + u[(i + 1) * ld + j] + u[i * ld + j - 1] + u[i * ld + j + 1]);
+            diff = std::max(diff, std::fabs(x - u[i * ld + j]));
+            v[i * ld + j] = x;
+        }
+    }
+    return diff;
+}
+
+// One Jacobi iteration from u[b] into u[1 - b]; returns this rank's largest change
+double step(Domain& d, int b, bool overlap, double& comm) {
+    const double* u = d.u[b].data();
+    double* v = d.u[1 - b].data();
+    int rows = d.rows, cols = d.cols, ld = d.ld;
+    double t = MPI_Wtime();
+    MPI_Startall((int)d.halo[b].size(), d.halo[b].data());
+    if (!overlap) {
+        MPI_Waitall((int)d.halo[b].size(), d.halo[b].data(), MPI_STATUSES_IGNORE);
+        comm += MPI_Wtime() - t;
+        return sweep(u, v, ld, 1, rows + 1, 1, cols + 1);
+    }
+    comm += MPI_Wtime() - t;
+
+    // Points at least one away from the block's edges read no ghosts
+    double diff = sweep(u, v, ld, 2, rows, 2, cols);
+    t = MPI_Wtime();
+    MPI_Waitall((int)d.halo[b].size(), d.halo[b].data(), MPI_STATUSES_IGNORE);
+    comm += MPI_Wtime() - t;
+    diff = std::max(diff, sweep(u, v, ld, 1, 2, 1, cols + 1));
+    if (rows > 1) {
+        diff = std::max(diff, sweep(u, v, ld, rows, rows + 1, 1, cols + 1));
+    }
+    diff = std::max(diff, sweep(u, v, ld, 2, rows, 1, 2));
+    if (cols > 1) {
+        diff = std::max(diff, sweep(u, v, ld, 2, rows, cols, cols + 1));
+    }
+    return diff;
+}
+
+struct RunResult {
+    int iters;              // Iterations run
+    double residual;        // Largest change at the last completed check (-1 if none)
+    double seconds;         // Slowest rank
+    double comm;            // Mean per rank waiting for halos and convergence checks
+    double checksum;        // Sum of the final solution
+};
+
+// Iterate from the initial state until converged or max_iters (tol < 0: always max_iters)
+RunResult run(Domain& d, bool overlap, double tol, int max_iters, int check) {
+    for (int b = 0; b < 2; ++b) {
+        for (int i = 1; i <= d.rows; ++i) {
+            std::fill(&d.u[b][(size_t)i * d.ld + 1], &d.u[b][(size_t)i * d.ld + d.cols + 1], 0.0);
+        }
+    }
+    int b = 0, it = 0;
+    double comm = 0.0, local_diff = 0.0, global_diff = -1.0, residual = -1.0;
+    MPI_Request reduction = MPI_REQUEST_NULL;
+    bool converged = false;
+
+    MPI_Barrier(d.cart);
+    double start = MPI_Wtime();
+    while (it < max_iters && !converged) {
+        double diff = step(d, b, overlap, comm);
+        b = 1 - b;
+        ++it;
+        if (overlap && reduction != MPI_REQUEST_NULL) {
+            // Let the check started earlier progress; it is waited for at the next check at the latest
+            int done;
+            double t = MPI_Wtime();
+            MPI_Test(&reduction, &done, MPI_STATUS_IGNORE);
+            if (!done && (it % check == 0 || it == max_iters)) {
+                MPI_Wait(&reduction, MPI_STATUS_IGNORE);
+                done = 1;
+            }
+            comm += MPI_Wtime() - t;
+            if (done) {
+                residual = global_diff;
+                converged = residual < tol;
+            }
+        }
+        if (it % check == 0 && tol >= 0.0 && !converged) {
+            double t = MPI_Wtime();
+            if (overlap) {
+                local_diff = diff;
+                MPI_Iallreduce(&local_diff, &global_diff, 1, MPI_DOUBLE, MPI_MAX, d.cart, &reduction);
+            } else {
+                MPI_Allreduce(&diff, &residual, 1, MPI_DOUBLE, MPI_MAX, d.cart);
+                converged = residual < tol;
+            }
+            comm += MPI_Wtime() - t;
+        }
+    }
+    if (reduction != MPI_REQUEST_NULL) {
+        MPI_Wait(&reduction, MPI_STATUS_IGNORE);
+        residual = global_diff;
+    }
+    double elapsed = MPI_Wtime() - start;
+
+    RunResult r;
+    int size;
+    MPI_Comm_size(d.cart, &size);
+    r.iters = it;
+    r.residual = residual;
+    MPI_Allreduce(&elapsed, &r.seconds, 1, MPI_DOUBLE, MPI_MAX, d.cart);
+    MPI_Allreduce(&comm, &r.comm, 1, MPI_DOUBLE, MPI_SUM, d.cart);
+    r.comm /= size;
+    double sum = 0.0;
+    for (int i = 1; i <= d.rows; ++i) {
+        for (int j = 1; j <= d.cols; ++j) {
+            sum += d.u[b][(size_t)i * d.ld + j];
+        }
+    }
+    MPI_Allreduce(&sum, &r.checksum, 1, MPI_DOUBLE, MPI_SUM, d.cart);
+    return r;
+}
+
+// Solve once with each version on all ranks
+void solve(const Options& opt, int rank) {
+    Domain d;
+    if (!make_domain(MPI_COMM_WORLD, opt.ny, opt.nx, d)) {
+        if (rank == 0) {
+            fprintf(stderr, "The %d x %d grid is too small for the process grid\n", opt.nx, opt.ny);
+        }
+        return;
+    }
+    if (rank == 0) {
+        printf("Jacobi on %d x %d points, %d x %d process grid, blocks of about %d x %d, tolerance %.1e\n", opt.nx,
+               opt.ny, d.dims[1], d.dims[0], opt.nx / d.dims[1], opt.ny / d.dims[0], opt.tol);
+    }
+    for (int overlap = 0; overlap < 2; ++overlap) {
+        RunResult r = run(d, overlap, opt.tol, opt.max_iters, opt.check);
+        if (rank == 0) {
+            printf("%-9s %6d iterations (%s), residual %.3e, %9.3f us/iter, comm wait %9.3f us/iter/rank, "
+                   "checksum %.10e\n", overlap ? "overlap" : "blocking", r.iters,
+                   r.residual >= 0.0 && r.residual < opt.tol ? "converged" : "not converged", r.residual,
+                   r.seconds / r.iters * 1e6, r.comm / r.iters * 1e6, r.checksum);
+        }
+    }
+    free_domain(d);
+}
+
+// Fixed-iteration runs of the overlap version on 1, 2, 4, ... and P ranks
+void scaling(const Options& opt, int rank, int size) {
+    bool weak = opt.scaling == "weak";
+    std::vector<int> comm_sizes;
+    for (int p = 1; p < size; p *= 2) {
+        comm_sizes.push_back(p);
+    }
+    comm_sizes.push_back(size);
+
+    if (rank == 0) {
+        printf("scaling,ranks,grid,nx,ny,us_per_iter,comm_wait_us,efficiency\n");
+    }
+    double base = 0.0;
+    for (int p : comm_sizes) {
+        MPI_Comm comm;
+        MPI_Comm_split(MPI_COMM_WORLD, rank < p ? 0 : MPI_UNDEFINED, rank, &comm);
+        if (comm != MPI_COMM_NULL) {
+            int dims[2] = {0, 0};
+            MPI_Dims_create(p, 2, dims);
+            int nx = weak ? opt.nx * dims[1] : opt.nx, ny = weak ? opt.ny * dims[0] : opt.ny;
+            Domain d;
+            if (make_domain(comm, ny, nx, d)) {
+                RunResult r = run(d, true, -1.0, opt.iters, opt.check);
+                if (p == 1) {
+                    base = r.seconds;
+                }
+                double efficiency = weak ? base / r.seconds : base / (p * r.seconds);
+                if (rank == 0) {
+                    printf("%s,%d,%dx%d,%d,%d,%.3f,%.3f,%.3f\n", opt.scaling.c_str(), p, dims[1], dims[0], nx, ny,
+                           r.seconds / r.iters * 1e6, r.comm / r.iters * 1e6, efficiency);
+                    fflush(stdout);
+                }
+                free_domain(d);
+            } else if (rank == 0) {
+                fprintf(stderr, "%d ranks: the %d x %d grid is too small for the process grid\n", p, nx, ny);
+            }
+            MPI_Comm_free(&comm);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Options opt;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--nx") == 0 && i + 1 < argc) {
+            opt.nx = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ny") == 0 && i + 1 < argc) {
+            opt.ny = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tol") == 0 && i + 1 < argc) {
+            opt.tol = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--max-iters") == 0 && i + 1 < argc) {
+            opt.max_iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+            opt.check = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scaling") == 0 && i + 1 < argc) {
+            opt.scaling = argv[++i];
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            opt.iters = atoi(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    ok = ok && opt.nx > 0 && opt.ny > 0 && opt.tol >= 0.0 && opt.max_iters > 0 && opt.check > 0 && opt.iters > 0
+         && (opt.scaling.empty() || opt.scaling == "strong" || opt.scaling == "weak");
+    if (!ok) {
+        if (rank == 0) {
+            fprintf(stderr, "Usage: %s [--nx N] [--ny N] [--tol T] [--max-iters N] [--check N] [--scaling strong|weak]"
+                            " [--iters N]\n", argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (opt.scaling.empty()) {
+        solve(opt, rank);
+    } else {
+        scaling(opt, rank, size);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
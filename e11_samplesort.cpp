@@ -0,0 +1,445 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <vector>
+#include <string>
+#include <queue>
+#include <algorithm>
+
+// Distributed sample sort of 64-bit keys, each optionally carrying a payload of
+// --payload bytes.
+//
+//   1. every rank generates its share of the keys and radix-sorts it (LSD, one
+//      byte per pass, passes in which all keys share the byte are skipped)
+//   2. regular sampling: every rank takes P - 1 evenly spaced keys of its sorted
+//      run, MPI_Allgather collects them, and the P - 1 splitters are taken at
+//      regular positions of the sorted samples
+//   3. the run is cut at the splitters into P contiguous buckets, and bucket d
+//      goes to rank d with MPI_Alltoallv straight out of the sorted run (keys and
+//      payloads in two exchanges)
+//   4. every rank k-way merges the P sorted runs it received
+//
+// With --chunk-bytes B the exchange is streamed in rounds in which a rank sends
+// at most B bytes, so MPI never stages more than that per call; received pieces
+// land at their final place, so every run stays contiguous. A single exchange is
+// used otherwise, unless a count would not fit in an int.
+//
+// Reports keys/s over the slowest rank, the time of each phase (slowest rank)
+// and the load imbalance: the largest number of keys a rank ends up with over
+// the mean. --verify checks that the output is globally sorted, that keys were
+// neither lost nor duplicated (count and checksum), and that every payload still
+// belongs to its key.
+//
+// Usage: mpirun -np P ./e11 [--keys N[,N...]] [--payload BYTES] [--dist uniform|skewed]
+//                           [--chunk-bytes B] [--seed S] [--verify]
+//   N may be written as 1e8; the default runs 1e6 and 1e7 keys
+
+struct Options {
+    std::vector<long long> keys = {1000000, 10000000};
+    int payload = 0;
+    std::string dist = "uniform";
+    long long chunk_bytes = 0;
+    uint64_t seed = 1;
+    bool verify = false;
+};
+
+// Block distribution of n items over p parts: the first n % p parts get one extra item
+long long block_size(long long n, int p, int i) {
+    return n / p + (i < n % p ? 1 : 0);
+}
+
+long long block_start(long long n, int p, int i) {
+    return i * (n / p) + std::min<long long>(i, n % p);
+}
+
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Key number i of the whole input. Skewed keys are shifted right by a random
+// amount, so small keys are far more frequent and many repeat
+uint64_t make_key(const Options& opt, long long i) {
+    uint64_t r = splitmix64(opt.seed * 0x100000001B3ULL + (uint64_t)i);
+    if (opt.dist == "skewed") {
+        return r >> (splitmix64(r) % 64);
+    }
+    return r;
+}
+
+// Payload bytes are a function of the key, so --verify can check they travelled with it
+void make_payload(uint64_t key, unsigned char* out, int bytes) {
+    uint64_t x = key * 0x9E3779B97F4A7C15ULL;
+    for (int b = 0; b < bytes; ++b) {
+        out[b] = (unsigned char)(x >> (8 * (b % 8))) ^ (unsigned char)b;
+    }
+}
+
+// Sort keys ascending and return in perm the original position of each sorted key
+void radix_sort(std::vector<uint64_t>& keys, std::vector<uint32_t>& perm) {
+    size_t n = keys.size();
+    std::vector<uint64_t> tmp_keys(n);
+    std::vector<uint32_t> tmp_perm(n);
+    perm.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        perm[i] = (uint32_t)i;
+    }
+    for (int shift = 0; shift < 64; shift += 8) {
+        size_t count[257] = {};
+        for (size_t i = 0; i < n; ++i) {
+            count[((keys[i] >> shift) & 0xFF) + 1]++;
+        }
+        if (n == 0 || *std::max_element(count + 1, count + 257) == n) {
+            continue; // Every key has the same byte here
+        }
+        for (int d = 0; d < 256; ++d) {
+            count[d + 1] += count[d];
+        }
+        for (size_t i = 0; i < n; ++i) {
+            size_t at = count[(keys[i] >> shift) & 0xFF]++;
+            tmp_keys[at] = keys[i];
+            tmp_perm[at] = perm[i];
+        }
+        keys.swap(tmp_keys);
+        perm.swap(tmp_perm);
+    }
+}
+
+struct Phases {
+    double sort = 0.0, sample = 0.0, exchange = 0.0, merge = 0.0;
+};
+
+// P - 1 splitters from regular samples of every rank's sorted keys
+std::vector<uint64_t> choose_splitters(const std::vector<uint64_t>& keys, MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    // A rank without keys contributes UINT64_MAX, which sorts last and so only affects the top splitters
+    std::vector<uint64_t> samples(size - 1, UINT64_MAX), all((size_t)size * (size - 1));
+    for (int s = 0; s < size - 1 && !keys.empty(); ++s) {
+        samples[s] = keys[(size_t)(s + 1) * keys.size() / size];
+    }
+    MPI_Allgather(samples.data(), size - 1, MPI_UINT64_T, all.data(), size - 1, MPI_UINT64_T, comm);
+    std::sort(all.begin(), all.end());
+    // Sorted, the samples form P - 1 groups of P, one per sampled quantile; take the middle of each
+    std::vector<uint64_t> splitters(size - 1);
+    for (int s = 0; s < size - 1; ++s) {
+        splitters[s] = all[(size_t)s * size + size / 2];
+    }
+    return splitters;
+}
+
+// All-to-all exchange of `unit`-byte items in rounds of at most round_items per
+// destination. Items for rank d start at send + send_displs[d]; items from rank
+// s land at recv + recv_displs[s], in order, so runs arrive contiguous.
+void exchange(const void* send, const std::vector<long long>& send_counts, const std::vector<long long>& send_displs,
+              void* recv, const std::vector<long long>& recv_counts, const std::vector<long long>& recv_displs,
+              int unit, long long round_items, MPI_Comm comm) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    MPI_Datatype item;
+    MPI_Type_contiguous(unit, MPI_BYTE, &item);
+    MPI_Type_commit(&item);
+
+    long long my_rounds = 0, rounds = 0;
+    for (int p = 0; p < size; ++p) {
+        my_rounds = std::max(my_rounds, (std::max(send_counts[p], recv_counts[p]) + round_items - 1) / round_items);
+    }
+    MPI_Allreduce(&my_rounds, &rounds, 1, MPI_LONG_LONG, MPI_MAX, comm);
+
+    // Displacements are in items relative to the round's base pointer, one per rank
+    std::vector<int> sc(size), sd(size), rc(size), rd(size);
+    const char* send_bytes = static_cast<const char*>(send);
+    char* recv_bytes = static_cast<char*>(recv);
+    for (long long r = 0; r < rounds; ++r) {
+        // Every round sends from and receives into a window that starts at this
+        // round's first item for rank 0; other ranks' windows are offset from it
+        long long offset = r * round_items;
+        std::vector<long long> s_lo(size), r_lo(size);
+        long long s_base = LLONG_MAX, r_base = LLONG_MAX;
+        for (int p = 0; p < size; ++p) {
+            s_lo[p] = send_displs[p] + std::min(offset, send_counts[p]);
+            r_lo[p] = recv_displs[p] + std::min(offset, recv_counts[p]);
+            s_base = std::min(s_base, s_lo[p]);
+            r_base = std::min(r_base, r_lo[p]);
+        }
+        bool fits = true;
+        for (int p = 0; p < size; ++p) {
+            sc[p] = (int)std::min(round_items, std::max(0LL, send_counts[p] - offset));
+            rc[p] = (int)std::min(round_items, std::max(0LL, recv_counts[p] - offset));
+            fits = fits && s_lo[p] - s_base <= INT_MAX && r_lo[p] - r_base <= INT_MAX;
+            sd[p] = (int)(s_lo[p] - s_base);
+            rd[p] = (int)(r_lo[p] - r_base);
+        }
+        if (fits) {
+            MPI_Alltoallv(send_bytes + s_base * unit, sc.data(), sd.data(), item, recv_bytes + r_base * unit, rc.data(),
+                          rd.data(), item, comm);
+            continue;
+        }
+        // Displacements too far apart for int: the same round as point-to-point messages
+        std::vector<MPI_Request> requests;
+        for (int p = 0; p < size; ++p) {
+            if (rc[p] > 0) {
+                requests.emplace_back();
+                MPI_Irecv(recv_bytes + r_lo[p] * unit, rc[p], item, p, 0, comm, &requests.back());
+            }
+        }
+        for (int p = 0; p < size; ++p) {
+            if (sc[p] > 0) {
+                requests.emplace_back();
+                MPI_Isend(send_bytes + s_lo[p] * unit, sc[p], item, p, 0, comm, &requests.back());
+            }
+        }
+        MPI_Waitall((int)requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    }
+    MPI_Type_free(&item);
+}
+
+struct SortResult {
+    std::vector<uint64_t> keys;
+    std::vector<unsigned char> payload;
+    Phases phases;
+    long long rounds = 1;
+};
+
+SortResult sample_sort(const Options& opt, long long total, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    long long first = block_start(total, size, rank), n = block_size(total, size, rank);
+    int pb = opt.payload;
+    SortResult out;
+
+    std::vector<uint64_t> keys(n);
+    std::vector<unsigned char> input_payload((size_t)n * pb);
+    for (long long i = 0; i < n; ++i) {
+        keys[i] = make_key(opt, first + i);
+        make_payload(keys[i], &input_payload[(size_t)i * pb], pb);
+    }
+    MPI_Barrier(comm);
+
+    // 1. Local sort; payloads follow their keys through the permutation
+    double t = MPI_Wtime();
+    std::vector<uint32_t> perm;
+    radix_sort(keys, perm);
+    std::vector<unsigned char> payload((size_t)n * pb);
+    for (long long i = 0; i < n && pb > 0; ++i) {
+        memcpy(&payload[(size_t)i * pb], &input_payload[(size_t)perm[i] * pb], pb);
+    }
+    std::vector<unsigned char>().swap(input_payload);
+    std::vector<uint32_t>().swap(perm);
+    out.phases.sort = MPI_Wtime() - t;
+
+    // 2. Splitters
+    t = MPI_Wtime();
+    std::vector<uint64_t> splitters = choose_splitters(keys, comm);
+    out.phases.sample = MPI_Wtime() - t;
+
+    // 3. Buckets are contiguous in the sorted run: bucket d holds keys in (splitter d-1, splitter d]
+    t = MPI_Wtime();
+    std::vector<long long> send_counts(size), send_displs(size), recv_counts(size), recv_displs(size);
+    long long at = 0;
+    for (int d = 0; d < size; ++d) {
+        long long end = d + 1 < size ? std::upper_bound(keys.begin(), keys.end(), splitters[d]) - keys.begin() : n;
+        end = std::max(end, at);
+        send_displs[d] = at;
+        send_counts[d] = end - at;
+        at = end;
+    }
+    MPI_Alltoall(send_counts.data(), 1, MPI_LONG_LONG, recv_counts.data(), 1, MPI_LONG_LONG, comm);
+    long long received = 0;
+    for (int s = 0; s < size; ++s) {
+        recv_displs[s] = received;
+        received += recv_counts[s];
+    }
+    long long record_bytes = (long long)sizeof(uint64_t) + pb;
+    long long round_items = opt.chunk_bytes > 0 ? std::max(1LL, opt.chunk_bytes / record_bytes / size) : INT_MAX;
+    std::vector<uint64_t> runs(received);
+    std::vector<unsigned char> run_payload((size_t)received * pb);
+    exchange(keys.data(), send_counts, send_displs, runs.data(), recv_counts, recv_displs, sizeof(uint64_t),
+             round_items, comm);
+    if (pb > 0) {
+        exchange(payload.data(), send_counts, send_displs, run_payload.data(), recv_counts, recv_displs, pb,
+                 round_items, comm);
+    }
+    long long max_count = 0;
+    for (int p = 0; p < size; ++p) {
+        max_count = std::max({max_count, send_counts[p], recv_counts[p]});
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &max_count, 1, MPI_LONG_LONG, MPI_MAX, comm);
+    out.rounds = std::max(1LL, (max_count + round_items - 1) / round_items);
+    std::vector<uint64_t>().swap(keys);
+    std::vector<unsigned char>().swap(payload);
+    out.phases.exchange = MPI_Wtime() - t;
+
+    // 4. k-way merge of the P received runs
+    t = MPI_Wtime();
+    out.keys.resize(received);
+    out.payload.resize((size_t)received * pb);
+    typedef std::pair<uint64_t, int> Head;  // (key, run)
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+    std::vector<long long> next(size);
+    for (int s = 0; s < size; ++s) {
+        next[s] = recv_displs[s];
+        if (recv_counts[s] > 0) {
+            heads.push({runs[next[s]], s});
+        }
+    }
+    for (long long i = 0; !heads.empty(); ++i) {
+        Head h = heads.top();
+        heads.pop();
+        long long from = next[h.second]++;
+        out.keys[i] = h.first;
+        if (pb > 0) {
+            memcpy(&out.payload[(size_t)i * pb], &run_payload[(size_t)from * pb], pb);
+        }
+        if (next[h.second] < recv_displs[h.second] + recv_counts[h.second]) {
+            heads.push({runs[next[h.second]], h.second});
+        }
+    }
+    out.phases.merge = MPI_Wtime() - t;
+    return out;
+}
+
+// Errors on this rank: local order, order across the rank boundary, payloads,
+// and (on rank 0) the global count and checksum against the generator
+long long verify(const Options& opt, long long total, const SortResult& r, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    long long errors = 0;
+    std::vector<unsigned char> expected(opt.payload);
+    for (size_t i = 0; i < r.keys.size(); ++i) {
+        errors += i > 0 && r.keys[i - 1] > r.keys[i];
+        if (opt.payload > 0) {
+            make_payload(r.keys[i], expected.data(), opt.payload);
+            errors += memcmp(expected.data(), &r.payload[i * opt.payload], opt.payload) != 0;
+        }
+    }
+
+    // Every rank's smallest key must not be below the largest key of any rank before it
+    uint64_t ends[2] = {r.keys.empty() ? UINT64_MAX : r.keys.front(), r.keys.empty() ? 0 : r.keys.back()};
+    std::vector<uint64_t> all_ends(2 * size);
+    MPI_Allgather(ends, 2, MPI_UINT64_T, all_ends.data(), 2, MPI_UINT64_T, comm);
+    uint64_t largest_before = 0;
+    for (int p = 0; p < rank; ++p) {
+        largest_before = std::max(largest_before, all_ends[2 * p + 1]);
+    }
+    errors += !r.keys.empty() && r.keys.front() < largest_before;
+
+    // Count and wrap-around sum of the keys against those of the input
+    long long first = block_start(total, size, rank), n = block_size(total, size, rank);
+    uint64_t sums[2] = {0, 0}, global[2];
+    for (long long i = 0; i < n; ++i) {
+        sums[0] += make_key(opt, first + i);
+    }
+    for (uint64_t k : r.keys) {
+        sums[1] += k;
+    }
+    long long count = (long long)r.keys.size(), global_count = 0;
+    MPI_Reduce(sums, global, 2, MPI_UINT64_T, MPI_SUM, 0, comm);
+    MPI_Reduce(&count, &global_count, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+    if (rank == 0) {
+        errors += global[0] != global[1];
+        errors += global_count != total;
+    }
+    return errors;
+}
+
+// Comma-separated counts, each possibly in floating-point notation (1e8)
+bool parse_counts(const char* text, std::vector<long long>& counts) {
+    counts.clear();
+    std::string s = text;
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t comma = s.find(',', pos);
+        std::string item = s.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        char* end;
+        double v = strtod(item.c_str(), &end);
+        if (item.empty() || *end != '\0' || v < 0 || v > 1e15) {
+            return false;
+        }
+        counts.push_back((long long)v);
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    return !counts.empty();
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Options opt;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+            ok = parse_counts(argv[++i], opt.keys);
+        } else if (strcmp(argv[i], "--payload") == 0 && i + 1 < argc) {
+            opt.payload = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--dist") == 0 && i + 1 < argc) {
+            opt.dist = argv[++i];
+        } else if (strcmp(argv[i], "--chunk-bytes") == 0 && i + 1 < argc) {
+            opt.chunk_bytes = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            opt.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            opt.verify = true;
+        } else {
+            ok = false;
+        }
+    }
+    ok = ok && opt.payload >= 0 && opt.chunk_bytes >= 0 && (opt.dist == "uniform" || opt.dist == "skewed");
+    for (long long total : opt.keys) {
+        ok = ok && block_size(total, size, 0) < UINT32_MAX; // Local positions are 32-bit
+    }
+    if (!ok) {
+        if (rank == 0) {
+            fprintf(stderr, "Usage: %s [--keys N[,N...]] [--payload BYTES] [--dist uniform|skewed] [--chunk-bytes B]"
+                            " [--seed S] [--verify]\n", argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (rank == 0) {
+        printf("keys,ranks,payload_bytes,dist,rounds,seconds,keys_per_s,sort_s,sample_s,exchange_s,merge_s,"
+               "imbalance%s\n", opt.verify ? ",verified" : "");
+    }
+    for (long long total : opt.keys) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        double start = MPI_Wtime();
+        SortResult r = sample_sort(opt, total, MPI_COMM_WORLD);
+        double elapsed = MPI_Wtime() - start;
+
+        double local[5] = {elapsed, r.phases.sort, r.phases.sample, r.phases.exchange, r.phases.merge}, slowest[5];
+        long long mine = (long long)r.keys.size(), largest = 0;
+        MPI_Reduce(local, slowest, 5, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&mine, &largest, 1, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+        long long errors = 0, local_errors = opt.verify ? verify(opt, total, r, MPI_COMM_WORLD) : 0;
+        MPI_Reduce(&local_errors, &errors, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+        if (rank == 0) {
+            double mean = (double)total / size;
+            printf("%lld,%d,%d,%s,%lld,%.4f,%.4e,%.4f,%.4f,%.4f,%.4f,%.3f", total, size, opt.payload, opt.dist.c_str(),
+                   r.rounds, slowest[0], slowest[0] > 0.0 ? total / slowest[0] : 0.0, slowest[1], slowest[2],
+                   slowest[3], slowest[4], mean > 0.0 ? largest / mean : 1.0);
+            if (opt.verify) {
+                printf(",%s", errors == 0 ? "passed" : "FAILED");
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
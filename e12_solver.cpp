@@ -0,0 +1,454 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#if MPI_VERSION < 4 && defined(OPEN_MPI)
+#include <mpi-ext.h>
+#endif
+
+// Power iteration and conjugate gradients on a dense symmetric positive definite
+// N x N matrix, distributed as in e8_matops.cpp: the ranks form a Pr x Pc grid
+// and rank (r, c) owns block (r, c), block sizes differing by at most one.
+// Off the diagonal a(i, j) = a(j, i) is e8's matrix_value for (min, max), in
+// [1, 10]; the diagonal is 10 N, which makes the matrix diagonally dominant.
+//
+// A vector is kept as pieces: the ranks of grid row r all hold elements
+// [block_start(N, Pr, r), +rows). y = A x takes three collectives, the same
+// ones with the same buffers in every iteration:
+//
+//   gather   MPI_Allgather along the grid column: every rank gets all pieces
+//            (padded to the largest) and picks out the x it multiplies with
+//   row_sum  MPI_Allreduce along the grid row of the partial products A_rc x_c
+//   dot      MPI_Allreduce over all ranks of two dot products, each rank adding
+//            up its own share of its row piece
+//
+// Each collective runs in one of three ways, every one timed separately:
+//
+//   blocking     MPI_Allgather / MPI_Allreduce
+//   nonblocking  MPI_Iallgather / MPI_Iallreduce, then MPI_Wait
+//   persistent   MPI_Allgather_init / MPI_Allreduce_init once, MPI_Start and
+//                MPI_Wait every time: the schedule and buffers are set up once,
+//                not per call. MPI 4 has these; Open MPI 4 offers them as
+//                MPIX_*_init in mpi-ext.h. Without either, nonblocking stands in.
+//
+// Power iteration reports the largest eigenvalue and stops once it changes by
+// at most --tol relative; CG solves A x = 1 until the relative residual is at
+// most --tol. Both run --iters iterations when --tol is 0 (the default, for
+// timing). Reported per solver and variant: the median and p99 time
+// of one iteration (slowest rank), the time spent in the collectives per
+// iteration, the result, and the residual recomputed from scratch at the end
+// (|A x - lambda x| / |lambda| or |1 - A x| / |1|).
+//
+// Usage: mpirun -np P ./e12 [--n N] [--grid PrxPc] [--iters N] [--tol T] [--seed S]
+//                           [--solvers power,cg] [--variants blocking,nonblocking,persistent]
+
+#if MPI_VERSION >= 4
+#define HAVE_PERSISTENT_COLLECTIVES 1
+#define ALLREDUCE_INIT MPI_Allreduce_init
+#define ALLGATHER_INIT MPI_Allgather_init
+#elif defined(OMPI_HAVE_MPI_EXT_PCOLLREQ)
+#define HAVE_PERSISTENT_COLLECTIVES 1
+#define ALLREDUCE_INIT MPIX_Allreduce_init
+#define ALLGATHER_INIT MPIX_Allgather_init
+#else
+#define HAVE_PERSISTENT_COLLECTIVES 0
+#endif
+
+struct Options {
+    int N = 2000;
+    int Pr = 0, Pc = 0;     // 0: MPI_Dims_create chooses
+    int iters = 200;        // Iterations, or the most with --tol
+    double tol = 0.0;
+    uint64_t seed = 42;
+    std::string solvers = "power,cg";
+    std::string variants = "blocking,nonblocking,persistent";
+};
+
+// Block distribution of n items over p parts: the first n % p parts get one extra item
+int block_size(int n, int p, int i) {
+    return n / p + (i < n % p ? 1 : 0);
+}
+
+int block_start(int n, int p, int i) {
+    return i * (n / p) + std::min(i, n % p);
+}
+
+// Part that owns global index g
+int block_owner(int n, int p, int g) {
+    int q = n / p, r = n % p;
+    if (g < r * (q + 1)) {
+        return g / (q + 1);
+    }
+    return r + (g - r * (q + 1)) / q;
+}
+
+// Deterministic value in [1, 10] for global element (i, j), as in e8_matops.cpp
+int matrix_value(uint64_t seed, int i, int j) {
+    uint64_t x = seed ^ ((uint64_t)i << 32 | (uint32_t)j);
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (int)(x % 10) + 1;
+}
+
+double spd_value(uint64_t seed, int n, int i, int j) {
+    return i == j ? 10.0 * n : matrix_value(seed, std::min(i, j), std::max(i, j));
+}
+
+enum class Variant { blocking, nonblocking, persistent };
+
+const char* variant_name(Variant v) {
+    switch (v) {
+    case Variant::blocking: return "blocking";
+    case Variant::nonblocking: return "nonblocking";
+    default: return HAVE_PERSISTENT_COLLECTIVES ? "persistent" : "persistent(nonblocking)";
+    }
+}
+
+// One collective on buffers that stay the same for the whole solve
+class Collective {
+public:
+    enum Kind { allreduce_sum, allgather };
+
+    // count is the elements reduced, or the elements each rank contributes to the gather
+    Collective(Kind kind, Variant variant, const double* send, double* recv, int count, MPI_Comm comm)
+        : kind_(kind), variant_(variant), send_(send), recv_(recv), count_(count), comm_(comm) {
+#if HAVE_PERSISTENT_COLLECTIVES
+        if (variant_ == Variant::persistent) {
+            if (kind_ == allreduce_sum) {
+                ALLREDUCE_INIT(send_, recv_, count_, MPI_DOUBLE, MPI_SUM, comm_, MPI_INFO_NULL, &request_);
+            } else {
+                ALLGATHER_INIT(send_, count_, MPI_DOUBLE, recv_, count_, MPI_DOUBLE, comm_, MPI_INFO_NULL, &request_);
+            }
+        }
+#else
+        if (variant_ == Variant::persistent) {
+            variant_ = Variant::nonblocking;
+        }
+#endif
+    }
+
+    ~Collective() {
+        if (request_ != MPI_REQUEST_NULL) {
+            MPI_Request_free(&request_);
+        }
+    }
+
+    Collective(const Collective&) = delete;
+    Collective& operator=(const Collective&) = delete;
+
+    // Start and complete; returns the seconds it took
+    double run() {
+        double start = MPI_Wtime();
+        if (variant_ == Variant::persistent) {
+            MPI_Start(&request_);
+            MPI_Wait(&request_, MPI_STATUS_IGNORE);
+        } else if (variant_ == Variant::nonblocking) {
+            MPI_Request r;
+            if (kind_ == allreduce_sum) {
+                MPI_Iallreduce(send_, recv_, count_, MPI_DOUBLE, MPI_SUM, comm_, &r);
+            } else {
+                MPI_Iallgather(send_, count_, MPI_DOUBLE, recv_, count_, MPI_DOUBLE, comm_, &r);
+            }
+            MPI_Wait(&r, MPI_STATUS_IGNORE);
+        } else if (kind_ == allreduce_sum) {
+            MPI_Allreduce(send_, recv_, count_, MPI_DOUBLE, MPI_SUM, comm_);
+        } else {
+            MPI_Allgather(send_, count_, MPI_DOUBLE, recv_, count_, MPI_DOUBLE, comm_);
+        }
+        return MPI_Wtime() - start;
+    }
+
+private:
+    Kind kind_;
+    Variant variant_;
+    const double* send_;
+    double* recv_;
+    int count_;
+    MPI_Comm comm_;
+    MPI_Request request_ = MPI_REQUEST_NULL;
+};
+
+// Process grid and the matrix block owned by this rank
+struct Grid {
+    MPI_Comm cart, row_comm, col_comm;
+    int Pr, Pc, myrow, mycol;
+};
+
+struct System {
+    int N;
+    int rows, row0, cols, col0;    // Block of A; rows is also the length of a vector piece
+    int max_rows;                  // Longest piece, the padded length in the gather
+    int own0, own;                 // Share of the piece this rank adds up in dot products
+    std::vector<double> A;         // rows x cols, row-major
+    std::vector<int> gathered_at;  // Where each of the block's columns sits in the gathered vector
+};
+
+System make_system(const Options& opt, const Grid& g) {
+    System s;
+    s.N = opt.N;
+    s.rows = block_size(opt.N, g.Pr, g.myrow);
+    s.row0 = block_start(opt.N, g.Pr, g.myrow);
+    s.cols = block_size(opt.N, g.Pc, g.mycol);
+    s.col0 = block_start(opt.N, g.Pc, g.mycol);
+    s.max_rows = block_size(opt.N, g.Pr, 0);
+    s.own0 = block_start(s.rows, g.Pc, g.mycol);
+    s.own = block_size(s.rows, g.Pc, g.mycol);
+    s.A.resize((size_t)s.rows * s.cols);
+    for (int i = 0; i < s.rows; ++i) {
+        for (int j = 0; j < s.cols; ++j) {
+            s.A[(size_t)i * s.cols + j] = spd_value(opt.seed, opt.N, s.row0 + i, s.col0 + j);
+        }
+    }
+    s.gathered_at.resize(s.cols);
+    for (int j = 0; j < s.cols; ++j) {
+        int owner = block_owner(opt.N, g.Pr, s.col0 + j);
+        s.gathered_at[j] = owner * s.max_rows + (s.col0 + j - block_start(opt.N, g.Pr, owner));
+    }
+    return s;
+}
+
+// y = A x and dot products of vector pieces, through three collectives set up once
+class Operator {
+public:
+    Operator(const System& s, const Grid& g, Variant v)
+        : s_(s), piece_(std::max(s.max_rows, 1), 0.0), gathered_((size_t)g.Pr * piece_.size()), x_(s.cols),
+          partial_(std::max(s.rows, 1)), summed_(partial_.size()),
+          gather_(Collective::allgather, v, piece_.data(), gathered_.data(), (int)piece_.size(), g.col_comm),
+          row_sum_(Collective::allreduce_sum, v, partial_.data(), summed_.data(), s.rows, g.row_comm),
+          dot_(Collective::allreduce_sum, v, dot_in_, dot_out_, 2, g.cart) {}
+
+    void apply(const double* x, double* y) {
+        std::copy(x, x + s_.rows, piece_.begin());
+        comm_ += gather_.run();
+        for (int j = 0; j < s_.cols; ++j) {
+            x_[j] = gathered_[s_.gathered_at[j]];
+        }
+        for (int i = 0; i < s_.rows; ++i) {
+            const double* a = &s_.A[(size_t)i * s_.cols];
+            double sum = 0.0;
+            for (int j = 0; j < s_.cols; ++j) {
+                sum += a[j] * x_[j];
+            }
+            partial_[i] = sum;
+        }
+        comm_ += row_sum_.run();
+        std::copy(summed_.begin(), summed_.begin() + s_.rows, y);
+    }
+
+    // out[0] = a1 . b1, out[1] = a2 . b2 over whole vectors
+    void dots(const double* a1, const double* b1, const double* a2, const double* b2, double out[2]) {
+        dot_in_[0] = dot_in_[1] = 0.0;
+        for (int i = s_.own0; i < s_.own0 + s_.own; ++i) {
+            dot_in_[0] += a1[i] * b1[i];
+            dot_in_[1] += a2[i] * b2[i];
+        }
+        comm_ += dot_.run();
+        out[0] = dot_out_[0];
+        out[1] = dot_out_[1];
+    }
+
+    double comm_seconds() const { return comm_; }
+
+private:
+    const System& s_;
+    std::vector<double> piece_, gathered_, x_, partial_, summed_;
+    double dot_in_[2], dot_out_[2];
+    Collective gather_, row_sum_, dot_;
+    double comm_ = 0.0;
+};
+
+struct Result {
+    int iterations = 0;
+    std::vector<double> times;  // Per iteration, this rank
+    double comm = 0.0;          // Seconds in collectives over all iterations
+    double value = 0.0;         // Eigenvalue, or the CG residual by recurrence
+    double residual = 0.0;      // Recomputed at the end
+};
+
+Result power_iteration(const Options& opt, const System& s, Operator& op) {
+    Result res;
+    int n = s.rows;
+    std::vector<double> x(n, 1.0 / std::sqrt((double)s.N)), y(n), unused(n, 0.0);
+    double d[2], lambda = 0.0;
+    for (int it = 0; it < opt.iters; ++it) {
+        double start = MPI_Wtime();
+        op.apply(x.data(), y.data());
+        op.dots(x.data(), y.data(), y.data(), y.data(), d);  // Rayleigh quotient (|x| = 1), |y|^2
+        double previous = lambda, norm = std::sqrt(d[1]);
+        lambda = d[0];
+        for (int i = 0; i < n; ++i) {
+            x[i] = y[i] / norm;
+        }
+        res.times.push_back(MPI_Wtime() - start);
+        ++res.iterations;
+        if (opt.tol > 0.0 && std::fabs(lambda - previous) <= opt.tol * std::fabs(lambda)) {
+            break;
+        }
+    }
+    res.comm = op.comm_seconds();
+    res.value = lambda;
+
+    // |A x - lambda x| / |lambda|
+    op.apply(x.data(), y.data());
+    for (int i = 0; i < n; ++i) {
+        y[i] -= lambda * x[i];
+    }
+    op.dots(y.data(), y.data(), unused.data(), unused.data(), d);
+    res.residual = std::sqrt(d[0]) / std::fabs(lambda);
+    return res;
+}
+
+Result conjugate_gradients(const Options& opt, const System& s, Operator& op) {
+    Result res;
+    int n = s.rows;
+    std::vector<double> x(n, 0.0), r(n, 1.0), p(n, 1.0), q(n), unused(n, 0.0);
+    double d[2];
+    op.dots(r.data(), r.data(), unused.data(), unused.data(), d);
+    double rr = d[0], bb = d[0];
+    for (int it = 0; it < opt.iters && rr > 0.0; ++it) {
+        double start = MPI_Wtime();
+        op.apply(p.data(), q.data());
+        op.dots(p.data(), q.data(), unused.data(), unused.data(), d);
+        double alpha = rr / d[0];
+        for (int i = 0; i < n; ++i) {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+        }
+        op.dots(r.data(), r.data(), unused.data(), unused.data(), d);
+        double beta = d[0] / rr;
+        rr = d[0];
+        for (int i = 0; i < n; ++i) {
+            p[i] = r[i] + beta * p[i];
+        }
+        res.times.push_back(MPI_Wtime() - start);
+        ++res.iterations;
+        if (opt.tol > 0.0 && std::sqrt(rr / bb) <= opt.tol) {
+            break;
+        }
+    }
+    res.comm = op.comm_seconds();
+    res.value = std::sqrt(rr / bb);
+
+    // |1 - A x| / |1|
+    op.apply(x.data(), q.data());
+    for (int i = 0; i < n; ++i) {
+        q[i] = 1.0 - q[i];
+    }
+    op.dots(q.data(), q.data(), unused.data(), unused.data(), d);
+    res.residual = std::sqrt(d[0] / bb);
+    return res;
+}
+
+bool listed(const std::string& list, const char* item) {
+    return ("," + list + ",").find("," + std::string(item) + ",") != std::string::npos;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Options opt;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--n") == 0 && i + 1 < argc) {
+            opt.N = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            ok = sscanf(argv[++i], "%dx%d", &opt.Pr, &opt.Pc) == 2;
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            opt.iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tol") == 0 && i + 1 < argc) {
+            opt.tol = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            opt.seed = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--solvers") == 0 && i + 1 < argc) {
+            opt.solvers = argv[++i];
+        } else if (strcmp(argv[i], "--variants") == 0 && i + 1 < argc) {
+            opt.variants = argv[++i];
+        } else {
+            ok = false;
+        }
+    }
+    ok = ok && opt.iters > 0 && opt.tol >= 0.0 && opt.Pr >= 0 && opt.Pc >= 0
+         && (opt.Pr * opt.Pc == 0 || opt.Pr * opt.Pc == size);
+    int dims[2] = {opt.Pr, opt.Pc};
+    if (ok) {
+        MPI_Dims_create(size, 2, dims);
+    }
+    // Every grid row and column needs at least one row and column of the matrix
+    ok = ok && opt.N >= std::max(dims[0], dims[1]);
+    if (!ok) {
+        if (rank == 0) {
+            fprintf(stderr, "Usage: %s [--n N] [--grid PrxPc] [--iters N] [--tol T] [--seed S]"
+                            " [--solvers power,cg] [--variants blocking,nonblocking,persistent]\n"
+                            "  N at least Pr and Pc, Pr x Pc = %d\n", argv[0], size);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    Grid g;
+    g.Pr = dims[0];
+    g.Pc = dims[1];
+    int periods[2] = {0, 0}, coords[2], cart_rank;
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &g.cart);
+    MPI_Comm_rank(g.cart, &cart_rank);
+    MPI_Cart_coords(g.cart, cart_rank, 2, coords);
+    g.myrow = coords[0];
+    g.mycol = coords[1];
+    int keep_cols[2] = {0, 1}, keep_rows[2] = {1, 0};
+    MPI_Cart_sub(g.cart, keep_cols, &g.row_comm);  // Ranks in my grid row
+    MPI_Cart_sub(g.cart, keep_rows, &g.col_comm);  // Ranks in my grid column
+    System s = make_system(opt, g);
+
+    if (rank == 0) {
+        printf("solver,variant,ranks,grid,n,iterations,median_iter_us,p99_iter_us,comm_us_per_iter,value,residual\n");
+    }
+    const char* solvers[] = {"power", "cg"};
+    const Variant variants[] = {Variant::blocking, Variant::nonblocking, Variant::persistent};
+    const char* variant_keys[] = {"blocking", "nonblocking", "persistent"};
+    for (const char* solver : solvers) {
+        if (!listed(opt.solvers, solver)) {
+            continue;
+        }
+        for (int v = 0; v < 3; ++v) {
+            if (!listed(opt.variants, variant_keys[v])) {
+                continue;
+            }
+            Result res;
+            {
+                Operator op(s, g, variants[v]);
+                MPI_Barrier(MPI_COMM_WORLD);
+                res = strcmp(solver, "power") == 0 ? power_iteration(opt, s, op) : conjugate_gradients(opt, s, op);
+            }
+
+            // Iteration counts agree on every rank: they follow reduced values
+            std::vector<double> slowest(res.iterations);
+            double comm = 0.0;
+            MPI_Reduce(res.times.data(), slowest.data(), res.iterations, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+            MPI_Reduce(&res.comm, &comm, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+            if (rank == 0 && res.iterations > 0) {
+                std::sort(slowest.begin(), slowest.end());
+                int k = res.iterations;
+                printf("%s,%s,%d,%dx%d,%d,%d,%.2f,%.2f,%.2f,%.10e,%.3e\n", solver, variant_name(variants[v]), size,
+                       g.Pr, g.Pc, opt.N, k, slowest[k / 2] * 1e6, slowest[std::min(k - 1, (int)(0.99 * k))] * 1e6,
+                       comm / k * 1e6, res.value, res.residual);
+                fflush(stdout);
+            }
+        }
+    }
+
+    MPI_Comm_free(&g.row_comm);
+    MPI_Comm_free(&g.col_comm);
+    MPI_Comm_free(&g.cart);
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "mpi_wrap.hpp"
+
+// Latency of raw MPI calls against the same calls made through mpi_wrap.hpp,
+// between ranks 0 and 1. Each test runs in rounds that alternate raw and
+// wrapped so both see the same machine state; the report is the median
+// one-way latency per round and the wrapped/raw ratio.
+//
+//   pingpong   blocking MPI_Send/MPI_Recv vs mpiw::send/mpiw::recv
+//   nonblock   MPI_Isend/MPI_Irecv + MPI_Waitall vs mpiw::Request + wait_all
+//
+// Usage: mpirun -np 2 ./e2b [--iters N] [--rounds N] [--max-bytes N]
+
+struct Config {
+    int iters = 10000;
+    int rounds = 11;
+    size_t max_bytes = 1 << 16;
+};
+
+// One-way latency in seconds of iters round trips of count ints
+double pingpong_raw(std::vector<int>& buf, int count, int rank, int iters) {
+    int peer = 1 - rank;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    for (int i = 0; i < iters; ++i) {
+        if (rank == 0) {
+            MPI_Send(buf.data(), count, MPI_INT, peer, 0, MPI_COMM_WORLD);
+            MPI_Recv(buf.data(), count, MPI_INT, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        } else {
+            MPI_Recv(buf.data(), count, MPI_INT, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            MPI_Send(buf.data(), count, MPI_INT, peer, 0, MPI_COMM_WORLD);
+        }
+    }
+    return (MPI_Wtime() - start) / (2.0 * iters);
+}
+
+double pingpong_wrapped(std::vector<int>& buf, int count, int rank, int iters) {
+    int peer = 1 - rank;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    for (int i = 0; i < iters; ++i) {
+        if (rank == 0) {
+            mpiw::send(buf.data(), count, peer, 0);
+            mpiw::recv(buf.data(), count, peer, 0);
+        } else {
+            mpiw::recv(buf.data(), count, peer, 0);
+            mpiw::send(buf.data(), count, peer, 0);
+        }
+    }
+    return (MPI_Wtime() - start) / (2.0 * iters);
+}
+
+// Both ranks exchange count ints per iteration
+double nonblock_raw(std::vector<int>& out, std::vector<int>& in, int count, int rank, int iters) {
+    int peer = 1 - rank;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    for (int i = 0; i < iters; ++i) {
+        MPI_Request requests[2];
+        MPI_Irecv(in.data(), count, MPI_INT, peer, 0, MPI_COMM_WORLD, &requests[0]);
+        MPI_Isend(out.data(), count, MPI_INT, peer, 0, MPI_COMM_WORLD, &requests[1]);
+        MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+    }
+    return (MPI_Wtime() - start) / iters;
+}
+
+double nonblock_wrapped(std::vector<int>& out, std::vector<int>& in, int count, int rank, int iters) {
+    int peer = 1 - rank;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    for (int i = 0; i < iters; ++i) {
+        mpiw::Request requests[2] = {mpiw::irecv(in.data(), count, peer, 0), mpiw::isend(out.data(), count, peer, 0)};
+        mpiw::wait_all(requests);
+    }
+    return (MPI_Wtime() - start) / iters;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Config cfg;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            cfg.iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            cfg.rounds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--max-bytes") == 0 && i + 1 < argc) {
+            cfg.max_bytes = strtoull(argv[++i], nullptr, 10);
+        } else {
+            if (rank == 0) {
+                fprintf(stderr, "Usage: %s [--iters N] [--rounds N] [--max-bytes N]\n", argv[0]);
+            }
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (size != 2 || cfg.iters < 1 || cfg.rounds < 1) {
+        if (rank == 0) {
+            fprintf(stderr, "Run with exactly 2 processes and positive --iters/--rounds\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    std::vector<int> out(std::max<size_t>(cfg.max_bytes / sizeof(int), 1), rank), in(out.size());
+    if (rank == 0) {
+        printf("test,bytes,raw_us,wrapped_us,ratio\n");
+    }
+    for (size_t bytes = sizeof(int); bytes <= cfg.max_bytes; bytes *= 4) {
+        int count = (int)(bytes / sizeof(int));
+        int iters = bytes >= (1 << 16) ? std::max(cfg.iters / 10, 10) : cfg.iters;
+        for (int test = 0; test < 2; ++test) {
+            std::vector<double> raw(cfg.rounds), wrapped(cfg.rounds);
+            for (int r = 0; r < cfg.rounds; ++r) {
+                if (test == 0) {
+                    raw[r] = pingpong_raw(out, count, rank, iters);
+                    wrapped[r] = pingpong_wrapped(out, count, rank, iters);
+                } else {
+                    raw[r] = nonblock_raw(out, in, count, rank, iters);
+                    wrapped[r] = nonblock_wrapped(out, in, count, rank, iters);
+                }
+            }
+            if (rank == 0) {
+                std::sort(raw.begin(), raw.end());
+                std::sort(wrapped.begin(), wrapped.end());
+                double r = raw[cfg.rounds / 2], w = wrapped[cfg.rounds / 2];
+                printf("%s,%zu,%.3f,%.3f,%.3f\n", test == 0 ? "pingpong" : "nonblock", bytes, r * 1e6, w * 1e6, w / r);
+                fflush(stdout);
+            }
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
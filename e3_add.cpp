@@ -1,32 +1,194 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+// Token ring: a counter travels around the ring and every process adds one.
+//
+// The channel to the next and from the previous process is set up once with
+// persistent requests (MPI_Send_init/MPI_Recv_init) and each hop only calls
+// MPI_Start, so the timed loop measures the network, not terminal output.
+// Rank 0 times every lap and keeps every lap time (8 bytes per lap); the
+// per-hop latency of a lap is its time divided by the ring size, and the p50 and
+// p99 are exact percentiles of those. The message rate is hops per second over
+// the whole run. Logging (--log N) records the first N hops of each process in
+// memory and prints them after timing.
+//
+// Usage: mpirun -np P ./e3 [--laps N] [--log N] [--hist] [--scaling]
+//   --hist     also print a log2 histogram of the per-hop latencies
+//   --scaling  repeat the benchmark on rings of 2, 4, 8, ... and P processes
+
+const int hist_buckets = 40; // Bucket b holds hops of [2^b, 2^(b+1)) nanoseconds
+
+struct HopLog {
+    int lap;
+    int value;
+};
+
+struct RingResult {
+    double elapsed = 0.0;            // Seconds for all laps
+    std::vector<double> lap_times;   // Rank 0: seconds of every lap
+};
+
+// The given fraction of the samples are at most the returned one; reorders samples
+double percentile(std::vector<double>& samples, double fraction) {
+    size_t at = std::min(samples.size() - 1, (size_t)(fraction * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + at, samples.end());
+    return samples[at];
+}
+
+RingResult run_ring(MPI_Comm ring, long long laps, std::vector<HopLog>& log, size_t log_limit) {
+    int my_rank, comm_size;
+    MPI_Comm_rank(ring, &my_rank);
+    MPI_Comm_size(ring, &comm_size);
 
-// Simple ping pong program to exemplify MPI_Send and MPI_Recs
-// Assume only two processes
-int main(int argc, char** argv) {
-  const int tot_msgs = 100;
-  
-  MPI_Init(NULL, NULL);
-
-  int my_rank,comm_size;
-  MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
-  MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
-   
     int next_rank = (my_rank + 1) % comm_size; // Next process
     int prev_rank = (my_rank - 1 + comm_size) % comm_size; // Previous process
 
-  int num_msgs = 0;
-  while (num_msgs < tot_msgs) {
-    if (num_msgs % comm_size == my_rank) {
-      num_msgs++;
-       MPI_Send(&num_msgs, 1, MPI_INT, next_rank, 0, MPI_COMM_WORLD);
-      printf("Process %d sent message %d to process %d\n", my_rank, num_msgs, next_rank);
+    // Separate buffers: rank 0's send and receive are in flight at the same time
+    int token_out = 0, token_in = 0;
+    MPI_Request send_req, recv_req;
+    MPI_Send_init(&token_out, 1, MPI_INT, next_rank, 0, ring, &send_req);
+    MPI_Recv_init(&token_in, 1, MPI_INT, prev_rank, 0, ring, &recv_req);
+
+    RingResult result;
+    if (my_rank == 0) {
+        result.lap_times.resize(laps);
+    }
+    log.clear();
+    log.reserve(log_limit);
+
+    MPI_Barrier(ring);
+    double start = MPI_Wtime();
+    if (my_rank == 0) {
+        for (long long lap = 0; lap < laps; ++lap) {
+            double lap_start = MPI_Wtime();
+            token_out = 0;
+            MPI_Start(&recv_req);
+            MPI_Start(&send_req);
+            MPI_Wait(&send_req, MPI_STATUS_IGNORE);
+            MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
+            result.lap_times[lap] = MPI_Wtime() - lap_start;
+            if (log.size() < log_limit) {
+                log.push_back({(int)lap, token_in});
+            }
+        }
     } else {
-            MPI_Recv(&num_msgs, 1, MPI_INT, prev_rank, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            printf("Process %d received message %d from process %d\n", my_rank, num_msgs, prev_rank);
+        MPI_Start(&recv_req);
+        for (long long lap = 0; lap < laps; ++lap) {
+            MPI_Wait(&recv_req, MPI_STATUS_IGNORE);
+            token_out = token_in + 1;
+            MPI_Start(&send_req);
+            if (lap + 1 < laps) {
+                MPI_Start(&recv_req); // Already listening for the next lap
+            }
+            MPI_Wait(&send_req, MPI_STATUS_IGNORE);
+            if (log.size() < log_limit) {
+                log.push_back({(int)lap, token_out});
+            }
+        }
+    }
+    result.elapsed = MPI_Wtime() - start;
+
+    MPI_Request_free(&send_req);
+    MPI_Request_free(&recv_req);
+    return result;
+}
+
+int main(int argc, char** argv) {
+    long long laps = 1000000;
+    size_t log_limit = 0;
+    bool print_histogram = false, scaling = false;
+
+    MPI_Init(&argc, &argv);
+
+    int my_rank, comm_size;
+    MPI_Comm_size(MPI_COMM_WORLD, &comm_size);
+    MPI_Comm_rank(MPI_COMM_WORLD, &my_rank);
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--laps") == 0 && i + 1 < argc && atoll(argv[i + 1]) > 0) {
+            laps = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            log_limit = (size_t)atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--hist") == 0) {
+            print_histogram = true;
+        } else if (strcmp(argv[i], "--scaling") == 0) {
+            scaling = true;
+        } else {
+            if (my_rank == 0) {
+                fprintf(stderr, "Usage: %s [--laps N] [--log N] [--hist] [--scaling]\n", argv[0]);
+            }
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (comm_size < 2) {
+        if (my_rank == 0) {
+            fprintf(stderr, "The token ring needs at least 2 processes\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    std::vector<int> ring_sizes;
+    for (int p = 2; scaling && p < comm_size; p *= 2) {
+        ring_sizes.push_back(p);
+    }
+    ring_sizes.push_back(comm_size);
+
+    if (my_rank == 0) {
+        printf("ranks,laps,hop_latency_us,hop_p50_us,hop_p99_us,messages_per_sec\n");
+    }
+    std::vector<HopLog> log;
+    for (int ring_size : ring_sizes) {
+        MPI_Comm ring;
+        MPI_Comm_split(MPI_COMM_WORLD, my_rank < ring_size ? 0 : MPI_UNDEFINED, my_rank, &ring);
+        if (ring == MPI_COMM_NULL) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            continue;
+        }
+
+        RingResult result = run_ring(ring, laps, log, log_limit);
+        if (my_rank == 0) {
+            double hops = (double)laps * ring_size;
+            std::vector<double>& hop_times = result.lap_times;
+            for (double& t : hop_times) {
+                t /= ring_size;
+            }
+            double p50 = percentile(hop_times, 0.5), p99 = percentile(hop_times, 0.99);
+            printf("%d,%lld,%.3f,%.3f,%.3f,%.0f\n", ring_size, laps, result.elapsed / hops * 1e6, p50 * 1e6, p99 * 1e6,
+                   hops / result.elapsed);
+            if (print_histogram) {
+                long long histogram[hist_buckets] = {};
+                for (double t : hop_times) {
+                    double ns = t * 1e9;
+                    int bucket = ns < 1.0 ? 0 : (int)log2(ns);
+                    histogram[bucket < hist_buckets ? bucket : hist_buckets - 1]++;
+                }
+                for (int b = 0; b < hist_buckets; ++b) {
+                    if (histogram[b] > 0) {
+                        printf("  hop time [%.0f, %.0f) ns: %lld\n", ldexp(1.0, b), ldexp(1.0, b + 1), histogram[b]);
+                    }
+                }
+            }
+        }
+
+        // Logged hops, printed after the timed loop
+        int next_rank = (my_rank + 1) % ring_size, prev_rank = (my_rank - 1 + ring_size) % ring_size;
+        for (const HopLog& entry : log) {
+            if (my_rank == 0) {
+                printf("Process %d lap %d received counter %d from process %d\n", my_rank, entry.lap, entry.value, prev_rank);
+            } else {
+                printf("Process %d lap %d sent counter %d to process %d\n", my_rank, entry.lap, entry.value, next_rank);
+            }
+        }
+        MPI_Comm_free(&ring);
+        MPI_Barrier(MPI_COMM_WORLD);
     }
-  }
 
-  MPI_Finalize();
+    MPI_Finalize();
 }
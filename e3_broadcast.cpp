@@ -1,12 +1,45 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "hierarchical.hpp"
+
+// Rank 0 broadcasts a number to every rank.
+//
+// --coll flat is the plain MPI_Bcast over MPI_COMM_WORLD; --coll hier sends it
+// across one leader per node and then shares it within every node in shared
+// memory (hierarchical.hpp); --coll auto (default) takes hier when there are
+// several nodes. --ppn P groups P consecutive ranks into a node.
+//
+// Usage: mpirun -np P ./e3 [--coll flat|hier|auto] [--ppn P]
 
 int main(int argc, char** argv) {
 
-    MPI_Init(NULL, NULL);
+    MPI_Init(&argc, &argv);
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    hier::Mode mode = hier::Mode::automatic;
+    int ppn = 0;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (std::strcmp(argv[i], "--coll") == 0 && i + 1 < argc) {
+            ok = hier::parse(argv[++i], mode);
+        } else if (std::strcmp(argv[i], "--ppn") == 0 && i + 1 < argc) {
+            ppn = std::atoi(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || ppn < 0) {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0] << " [--coll flat|hier|auto] [--ppn P]" << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
  
      int data;
     if (rank == 0){
@@ -14,10 +47,13 @@ int main(int argc, char** argv) {
      data = 100;
     }
 
-    MPI_Bcast(&data, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    {
+        hier::Communicator world(MPI_COMM_WORLD, ppn);
+        world.bcast(&data, sizeof(data), 0, mode);
+    }
     std::cout << "Processor " << rank << " received data: " << data << std::endl;
     
     MPI_Finalize();
     return 0;
 
-}
\ No newline at end of file
+}
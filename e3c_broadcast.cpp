@@ -2,10 +2,127 @@
 #include <stdio.h>
 #include <iostream>
 #include <string.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+// A message travels around the ring and every process appends to it.
+//
+// Each hop is one message: a FrameHeader (step, payload length, origin rank)
+// followed by the payload. The receiver sizes its buffer with MPI_Probe and
+// MPI_Get_count, so the message can grow without limit, and it receives from its
+// ring predecessor explicitly instead of MPI_ANY_SOURCE.
+//
+// Usage: mpirun -np P ./e3c                  run the message around the ring
+//        mpirun -np P ./e3c --bench [laps]   per-hop latency, framed vs two-message scheme
+
+const int frame_tag = 0;
+
+struct FrameHeader {
+    int step;    // Number of modifications made so far
+    int length;  // Payload bytes following the header
+    int origin;  // Rank that created the message
+};
+
+// Pack the header and payload into buf and send them as a single message
+void send_frame(const FrameHeader& header, const char* payload, int dest, MPI_Comm comm, std::vector<char>& buf) {
+    buf.resize(sizeof(FrameHeader) + header.length);
+    memcpy(buf.data(), &header, sizeof(FrameHeader));
+    memcpy(buf.data() + sizeof(FrameHeader), payload, header.length);
+    MPI_Send(buf.data(), (int)buf.size(), MPI_BYTE, dest, frame_tag, comm);
+}
+
+// Send a received frame on with its header replaced; the payload stays where it is in buf
+void forward_frame(const FrameHeader& header, int dest, MPI_Comm comm, std::vector<char>& buf) {
+    memcpy(buf.data(), &header, sizeof(FrameHeader));
+    MPI_Send(buf.data(), (int)buf.size(), MPI_BYTE, dest, frame_tag, comm);
+}
+
+// Receive one frame of any length from source; returns false on a malformed frame
+bool recv_frame(int source, MPI_Comm comm, FrameHeader& header, std::vector<char>& buf) {
+    MPI_Status status;
+    int count;
+    MPI_Probe(source, frame_tag, comm, &status);
+    MPI_Get_count(&status, MPI_BYTE, &count);
+    buf.resize(count);
+    MPI_Recv(buf.data(), count, MPI_BYTE, source, frame_tag, comm, MPI_STATUS_IGNORE);
+    if (count < (int)sizeof(FrameHeader)) {
+        return false;
+    }
+    memcpy(&header, buf.data(), sizeof(FrameHeader));
+    return header.length == count - (int)sizeof(FrameHeader);
+}
+
+// Average per-hop latency of laps trips around the ring with the framed protocol,
+// after one untimed lap
+double bench_framed(int rank, int size, int laps, int payload_len) {
+    int next = (rank + 1) % size, prev = (rank - 1 + size) % size;
+    std::vector<char> payload(payload_len, 'x'), buf;
+    FrameHeader header = {0, payload_len, 0};
+
+    double start = 0.0;
+    for (int lap = -1; lap < laps; ++lap) { // Lap -1 is the warmup
+        if (lap == 0) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            start = MPI_Wtime();
+        }
+        if (rank == 0) {
+            send_frame(header, payload.data(), next, MPI_COMM_WORLD, buf);
+            recv_frame(prev, MPI_COMM_WORLD, header, buf);
+        } else {
+            recv_frame(prev, MPI_COMM_WORLD, header, buf);
+            header.step++;
+            forward_frame(header, next, MPI_COMM_WORLD, buf);
+        }
+    }
+    return (MPI_Wtime() - start) / ((double)laps * size);
+}
+
+// The same trip with the original scheme: the step and a fixed max_len buffer as
+// two messages, both received from MPI_ANY_SOURCE, also after one untimed lap
+double bench_two_messages(int rank, int size, int laps, int max_len) {
+    int next = (rank + 1) % size;
+    std::vector<char> message(max_len, 'x');
+    int step = 0;
+
+    double start = 0.0;
+    for (int lap = -1; lap < laps; ++lap) {
+        if (lap == 0) {
+            MPI_Barrier(MPI_COMM_WORLD);
+            start = MPI_Wtime();
+        }
+        if (rank == 0) {
+            MPI_Send(&step, 1, MPI_INT, next, 0, MPI_COMM_WORLD);
+            MPI_Send(message.data(), max_len, MPI_CHAR, next, 0, MPI_COMM_WORLD);
+        }
+        MPI_Recv(&step, 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Recv(message.data(), max_len, MPI_CHAR, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        if (rank != 0) {
+            step++;
+            MPI_Send(&step, 1, MPI_INT, next, 0, MPI_COMM_WORLD);
+            MPI_Send(message.data(), max_len, MPI_CHAR, next, 0, MPI_COMM_WORLD);
+        }
+    }
+    return (MPI_Wtime() - start) / ((double)laps * size);
+}
+
+void run_benchmark(int rank, int size, int laps) {
+    const int max_len = 100; // Buffer size of the original two-message scheme
+    if (rank == 0) {
+        printf("payload_bytes,framed_us_per_hop,two_message_us_per_hop\n");
+    }
+    for (int len : {8, 32, 100, 1000, 10000}) {
+        double framed = bench_framed(rank, size, laps, len);
+        // The old scheme always ships max_len bytes and cannot carry more
+        double two = bench_two_messages(rank, size, laps, len > max_len ? len : max_len);
+        if (rank == 0) {
+            printf("%d,%.3f,%.3f\n", len, framed * 1e6, two * 1e6);
+        }
+    }
+}
 
 int main(int argc, char** argv) {
     const int max_steps = 10; // Maximum number of modifications
-    const int max_len = 100; // Maximum length of the message
 
     MPI_Init(&argc, &argv);
 
@@ -13,34 +130,57 @@ int main(int argc, char** argv) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    char message[max_len]; // Message buffer
-    int step = 0;          // Number of modifications made
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        int laps = argc > 2 ? atoi(argv[2]) : 10000;
+        // Rank 0 sends before it receives, which would deadlock on itself once
+        // the payload is too large to go eagerly
+        if (laps < 1 || size < 2) {
+            if (rank == 0) {
+                fprintf(stderr, "Usage: %s --bench [laps]   (laps >= 1, at least 2 processes)\n", argv[0]);
+            }
+            MPI_Finalize();
+            return 1;
+        }
+        run_benchmark(rank, size, laps);
+        MPI_Finalize();
+        return 0;
+    }
+
+    int next = (rank + 1) % size, prev = (rank - 1 + size) % size;
+    std::vector<char> buf;
+    std::string message;
 
     if (rank == 0) {
         // Initialize the message in process 0
-        snprintf(message, max_len, "Initial message from process %d", rank);
-        printf("Process %d starting with message: %s\n", rank, message);
+        message = "Initial message from process " + std::to_string(rank);
+        printf("Process %d starting with message: %s\n", rank, message.c_str());
 
         // Send the message to the next process
-        MPI_Send(&step, 1, MPI_INT, (rank + 1) % size, 0, MPI_COMM_WORLD);
-        MPI_Send(message, max_len, MPI_CHAR, (rank + 1) % size, 0, MPI_COMM_WORLD);
+        FrameHeader header = {0, (int)message.size(), rank};
+        send_frame(header, message.data(), next, MPI_COMM_WORLD, buf);
     }
 
-    while (step < max_steps) {
+    // Step s is handled by process (s + 1) % size, so every process knows how many
+    // frames it will receive and none waits for a message that never comes
+    for (int s = (rank - 1 + size) % size; s < max_steps; s += size) {
         // Receive the step count and message
-        MPI_Recv(&step, 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-        MPI_Recv(message, max_len, MPI_CHAR, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        printf("Process %d received step %d with message: %s\n", rank, step, message);
+        FrameHeader header;
+        if (!recv_frame(prev, MPI_COMM_WORLD, header, buf)) {
+            fprintf(stderr, "Process %d received a malformed frame\n", rank);
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        message.assign(buf.data() + sizeof(FrameHeader), header.length);
+        printf("Process %d received step %d (from origin %d) with message: %s\n", rank, header.step, header.origin,
+               message.c_str());
 
         // Modify the message
-        snprintf(message + strlen(message), max_len - strlen(message), " -> modified by process %d", rank);
-        step++;
+        message += " -> modified by process " + std::to_string(rank);
+        header.step++;
+        header.length = (int)message.size();
 
         // Send to the next process
-        if (step < max_steps) {
-            MPI_Send(&step, 1, MPI_INT, (rank + 1) % size, 0, MPI_COMM_WORLD);
-            MPI_Send(message, max_len, MPI_CHAR, (rank + 1) % size, 0, MPI_COMM_WORLD);
+        if (header.step < max_steps) {
+            send_frame(header, message.data(), next, MPI_COMM_WORLD, buf);
         } else {
             // Final message, stop circulating
             printf("Process %d completed the message passing.\n", rank);
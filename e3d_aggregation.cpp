@@ -0,0 +1,209 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "msg_aggregator.hpp"
+
+// Message rate of many small messages, one MPI message each against batched by
+// msg_aggregator.hpp.
+//
+// Every rank sends --messages messages of a given payload size, spread round
+// robin over the other ranks, while it receives the messages addressed to it.
+//
+//   direct      one MPI_Isend per message (at most --window in flight) and one
+//               MPI_Recv per message, found with MPI_Iprobe between sends
+//   aggregated  MessageAggregator::send per message, poll() every 16 sends and
+//               finish() at the end; a handler receives each message
+//
+// Both check that every message arrived with the right payload. Rates are for
+// all ranks together over the slowest rank's time; the buffer size is --buffer.
+//
+// Usage: mpirun -np P ./e3d [--messages N] [--max-bytes N] [--buffer BYTES] [--window N]
+
+struct Config {
+    long long messages = 200000;
+    int max_bytes = 256;
+    size_t buffer = 8192;
+    int window = 256;
+};
+
+// Destination of a rank's i-th message; a single rank sends to itself
+int destination(int rank, int size, long long i) {
+    return size == 1 ? 0 : (int)((rank + 1 + i % (size - 1)) % size);
+}
+
+// Messages rank `to` receives in total
+long long expected_messages(int to, int size, long long messages) {
+    long long total = 0;
+    for (int from = 0; from < size; ++from) {
+        if (size == 1) {
+            total += messages;
+        } else if (from != to) {
+            // from sends to `to` for i with (i % (size - 1)) == (to - from - 1) mod size
+            long long slot = ((to - from - 1) % size + size) % size;
+            total += messages / (size - 1) + (slot < messages % (size - 1) ? 1 : 0);
+        }
+    }
+    return total;
+}
+
+// Payload of message i from rank r: every byte is (r + i) mod 251; the
+// receiver adds up the first byte of everything it gets, the sender what it sent
+unsigned char payload_byte(int rank, long long i) {
+    return (unsigned char)((rank + i) % 251);
+}
+
+struct Tally {
+    long long messages = 0, checksum = 0, bad = 0;
+
+    void take(const unsigned char* data, size_t bytes, size_t expected_bytes) {
+        ++messages;
+        checksum += data[0];
+        for (size_t b = 1; b < bytes; ++b) {
+            bad += data[b] != data[0];
+        }
+        bad += bytes != expected_bytes;
+    }
+};
+
+double run_direct(MPI_Comm comm, const Config& cfg, int bytes, Tally& tally) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    long long expected = expected_messages(rank, size, cfg.messages);
+    std::vector<unsigned char> out((size_t)cfg.window * bytes), in(bytes);
+    std::vector<MPI_Request> requests(cfg.window, MPI_REQUEST_NULL);
+
+    auto receive_arrived = [&] {
+        int found = 1;
+        while (found && tally.messages < expected) {
+            MPI_Status status;
+            MPI_Iprobe(MPI_ANY_SOURCE, 0, comm, &found, &status);
+            if (found) {
+                int count;
+                MPI_Get_count(&status, MPI_BYTE, &count);
+                MPI_Recv(in.data(), count, MPI_BYTE, status.MPI_SOURCE, 0, comm, MPI_STATUS_IGNORE);
+                tally.take(in.data(), count, bytes);
+            }
+        }
+    };
+
+    MPI_Barrier(comm);
+    double start = MPI_Wtime();
+    for (long long i = 0; i < cfg.messages; ++i) {
+        int slot = (int)(i % cfg.window);
+        if (requests[slot] != MPI_REQUEST_NULL) {
+            // Keep receiving while the oldest send is still in flight, or both sides can stall
+            int done = 0;
+            while (!done) {
+                MPI_Test(&requests[slot], &done, MPI_STATUS_IGNORE);
+                receive_arrived();
+            }
+        }
+        memset(&out[(size_t)slot * bytes], payload_byte(rank, i), bytes);
+        MPI_Isend(&out[(size_t)slot * bytes], bytes, MPI_BYTE, destination(rank, size, i), 0, comm, &requests[slot]);
+        if (slot == cfg.window - 1) {
+            receive_arrived();
+        }
+    }
+    while (tally.messages < expected) {
+        receive_arrived();
+    }
+    MPI_Waitall(cfg.window, requests.data(), MPI_STATUSES_IGNORE);
+    return MPI_Wtime() - start;
+}
+
+double run_aggregated(MPI_Comm comm, const Config& cfg, int bytes, Tally& tally, long long& batches) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    std::vector<unsigned char> out(bytes);
+    MessageAggregator agg(comm, cfg.buffer);
+    int handler = agg.register_handler([&](int, const void* data, size_t n) {
+        tally.take(static_cast<const unsigned char*>(data), n, bytes);
+    });
+
+    MPI_Barrier(comm);
+    double start = MPI_Wtime();
+    for (long long i = 0; i < cfg.messages; ++i) {
+        memset(out.data(), payload_byte(rank, i), bytes);
+        agg.send(destination(rank, size, i), handler, out.data(), bytes);
+        if (i % 16 == 15) {
+            agg.poll();
+        }
+    }
+    agg.finish();
+    double elapsed = MPI_Wtime() - start;
+    batches = agg.batches_sent();
+    return elapsed;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Config cfg;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--messages") == 0 && i + 1 < argc) {
+            cfg.messages = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--max-bytes") == 0 && i + 1 < argc) {
+            cfg.max_bytes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--buffer") == 0 && i + 1 < argc) {
+            cfg.buffer = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            cfg.window = atoi(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || cfg.messages < 1 || cfg.max_bytes < 1 || cfg.buffer < 1 || cfg.window < 1) {
+        if (rank == 0) {
+            fprintf(stderr, "Usage: %s [--messages N] [--max-bytes N] [--buffer BYTES] [--window N]\n", argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (rank == 0) {
+        printf("bytes,direct_msgs_per_s,direct_MB_per_s,aggregated_msgs_per_s,aggregated_MB_per_s,speedup,"
+               "records_per_batch\n");
+    }
+    for (int bytes = 1; bytes <= cfg.max_bytes; bytes *= 2) {
+        long long sent_checksum = 0;
+        for (long long i = 0; i < cfg.messages; ++i) {
+            sent_checksum += payload_byte(rank, i);
+        }
+
+        Tally direct, aggregated;
+        long long batches = 0;
+        double t_direct = run_direct(MPI_COMM_WORLD, cfg, bytes, direct);
+        double t_aggregated = run_aggregated(MPI_COMM_WORLD, cfg, bytes, aggregated, batches);
+
+        // Both variants must deliver every message intact: compare what all ranks sent and received
+        long long local[4] = {sent_checksum, direct.checksum, aggregated.checksum, direct.bad + aggregated.bad};
+        long long global[4], total_batches = 0;
+        double times[2] = {t_direct, t_aggregated}, max_times[2];
+        MPI_Reduce(local, global, 4, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&batches, &total_batches, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(times, max_times, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            if (global[0] != global[1] || global[0] != global[2] || global[3] != 0) {
+                fprintf(stderr, "%d bytes: messages lost or corrupted\n", bytes);
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+            double total = (double)cfg.messages * size;
+            printf("%d,%.0f,%.2f,%.0f,%.2f,%.2f,%.1f\n", bytes, total / max_times[0], total * bytes / max_times[0] * 1e-6,
+                   total / max_times[1], total * bytes / max_times[1] * 1e-6, max_times[0] / max_times[1],
+                   total / std::max(total_batches, 1LL));
+            fflush(stdout);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -1,24 +1,59 @@
 #include <mpi.h>
 #include <stdio.h>
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include "hierarchical.hpp"
+
+// Sum of rank + 1 over all ranks, on rank 0.
+//
+// --coll flat is the plain MPI_Reduce over MPI_COMM_WORLD; --coll hier first
+// reduces within every node in shared memory and then across one leader per node
+// (hierarchical.hpp); --coll auto (default) takes hier when there are several
+// nodes. --ppn P groups P consecutive ranks into a node, to try it on one machine.
+//
+// Usage: mpirun -np P ./e4 [--coll flat|hier|auto] [--ppn P]
 
 int main(int argc, char** argv) {
 
-    MPI_Init(NULL, NULL);
+    MPI_Init(&argc, &argv);
 
     int rank;
 
     MPI_Comm_rank(MPI_COMM_WORLD,&rank);
 
+    hier::Mode mode = hier::Mode::automatic;
+    int ppn = 0;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (std::strcmp(argv[i], "--coll") == 0 && i + 1 < argc) {
+            ok = hier::parse(argv[++i], mode);
+        } else if (std::strcmp(argv[i], "--ppn") == 0 && i + 1 < argc) {
+            ppn = std::atoi(argv[++i]);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || ppn < 0) {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0] << " [--coll flat|hier|auto] [--ppn P]" << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
     int local_data=rank+1;
 
     int global_sum;
 
-
-    MPI_Reduce(&local_data, &global_sum, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
-    if(rank==0){
-         std::cout << "The sum of all ranks is: " << global_sum << std::endl;
+    {
+        hier::Communicator world(MPI_COMM_WORLD, ppn);
+        world.reduce(&local_data, &global_sum, 1, 0, mode);
+        if(rank==0){
+             std::cout << "The sum of all ranks is: " << global_sum << " (" << hier::name(mode) << ", "
+                       << world.nodes() << " nodes)" << std::endl;
+        }
     }
     MPI_Finalize();
 return 0;
-}
\ No newline at end of file
+}
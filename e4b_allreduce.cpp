@@ -0,0 +1,140 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "allreduce.hpp"
+
+// Benchmark of the allreduce.hpp algorithms against MPI_Allreduce on float
+// vectors (sum). "mpi_userop" is MPI_Allreduce with the SIMD sum registered
+// through MPI_Op_create. Rank r contributes r + 1 + i % 7 in element i, and
+// every element of the result is checked exactly. Times are the median over iterations of the slowest
+// rank; bandwidth is vector bytes / time.
+//
+// Usage: mpirun -np P ./e4b [--max-count N] [--iters N] [--scaling]
+//   --scaling  repeat on communicators of 2, 4, 8, ... and P processes
+
+struct Variant {
+    const char* name;
+    int (*run)(float* data, float* scratch, size_t count, MPI_Comm comm);
+};
+
+int run_mpi(float* data, float* scratch, size_t count, MPI_Comm comm) {
+    return MPI_Allreduce(scratch, data, (int)count, MPI_FLOAT, MPI_SUM, comm);
+}
+
+int run_mpi_userop(float* data, float* scratch, size_t count, MPI_Comm comm) {
+    return MPI_Allreduce(scratch, data, (int)count, MPI_FLOAT, allreduce::op_handle<allreduce::Sum, float>(), comm);
+}
+
+template <allreduce::Algorithm algorithm>
+int run_library(float* data, float*, size_t count, MPI_Comm comm) {
+    return allreduce::allreduce(data, count, comm, algorithm);
+}
+
+const Variant variants[] = {
+    {"mpi", run_mpi},
+    {"mpi_userop", run_mpi_userop},
+    {"recursive_doubling", run_library<allreduce::Algorithm::recursive_doubling>},
+    {"ring", run_library<allreduce::Algorithm::ring>},
+    {"rabenseifner", run_library<allreduce::Algorithm::rabenseifner>},
+    {"auto", run_library<allreduce::Algorithm::automatic>},
+};
+
+void bench(MPI_Comm comm, size_t max_count, int iters) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    std::vector<float> data(max_count), scratch(max_count);
+    // Element i of rank r is r + 1 + i % 7, so a segment combined from the wrong
+    // place or left out shows in the result
+    auto value = [](int r, size_t i) { return (float)(r + 1 + (int)(i % 7)); };
+    auto expected = [size](size_t i) { return (float)size * (size + 1) / 2 + (float)size * (int)(i % 7); };
+    for (size_t j = 0; j < max_count; ++j) {
+        scratch[j] = value(rank, j); // Send buffer of the MPI variants
+    }
+
+    for (size_t count = 1; count <= max_count; count *= 4) {
+        for (const Variant& v : variants) {
+            int n = count >= (1 << 20) ? std::max(iters / 10, 3) : iters;
+            std::vector<double> times(n);
+            bool correct = true;
+            for (int i = -1; i < n; ++i) {
+                for (size_t j = 0; j < count; ++j) {
+                    data[j] = value(rank, j);
+                }
+                MPI_Barrier(comm);
+                double start = MPI_Wtime();
+                v.run(data.data(), scratch.data(), count, comm);
+                double elapsed = MPI_Wtime() - start;
+                if (i >= 0) {
+                    times[i] = elapsed; // Iteration -1 is the warmup
+                }
+                for (size_t j = 0; j < count; ++j) {
+                    correct = correct && data[j] == expected(j);
+                }
+            }
+            std::vector<double> max_times(n);
+            int local_ok = correct, all_ok = 0;
+            MPI_Reduce(times.data(), max_times.data(), n, MPI_DOUBLE, MPI_MAX, 0, comm);
+            MPI_Reduce(&local_ok, &all_ok, 1, MPI_INT, MPI_LAND, 0, comm);
+            if (rank == 0) {
+                std::sort(max_times.begin(), max_times.end());
+                double median = max_times[n / 2];
+                printf("%d,%zu,%zu,%s,%.3f,%.3f%s\n", size, count, count * sizeof(float), v.name, median * 1e6,
+                       count * sizeof(float) / median / 1e9, all_ok ? "" : ",WRONG");
+                fflush(stdout);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    size_t max_count = 4 << 20;
+    int iters = 50;
+    bool scaling = false;
+
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--max-count") == 0 && i + 1 < argc) {
+            max_count = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scaling") == 0) {
+            scaling = true;
+        } else {
+            if (rank == 0) {
+                fprintf(stderr, "Usage: %s [--max-count N] [--iters N] [--scaling]\n", argv[0]);
+            }
+            MPI_Finalize();
+            return 1;
+        }
+    }
+
+    std::vector<int> comm_sizes;
+    for (int p = 2; scaling && p < size; p *= 2) {
+        comm_sizes.push_back(p);
+    }
+    comm_sizes.push_back(size);
+
+    if (rank == 0) {
+        printf("ranks,count,bytes,algorithm,median_us,bandwidth_GBps\n");
+    }
+    for (int p : comm_sizes) {
+        MPI_Comm comm;
+        MPI_Comm_split(MPI_COMM_WORLD, rank < p ? 0 : MPI_UNDEFINED, rank, &comm);
+        if (comm != MPI_COMM_NULL) {
+            bench(comm, max_count, iters);
+            MPI_Comm_free(&comm);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,202 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "hierarchical.hpp"
+
+// Benchmark of the two-level collectives of hierarchical.hpp against the flat
+// MPI_Reduce, MPI_Allreduce and MPI_Bcast, on float vectors, while the number of
+// ranks per node varies.
+//
+// Each --ppn value builds a hier::Communicator whose nodes are groups of that
+// many consecutive ranks (within the real shared-memory nodes), so one machine
+// can stand in for 1, 2, 4, ... ranks per node; --ppn 0 uses the real nodes.
+// Every rank contributes rank + 1 in each element and the root broadcasts
+// 0, 1, 2, ..., so results are checked exactly. Times are the median over
+// iterations of the slowest rank, with a barrier before each iteration. Since
+// that barrier would hide a collective that leaves the shared segments unsafe for
+// the next one, each --ppn first runs a mix of all three back to back, without
+// barriers, and aborts if any result is wrong.
+//
+// Usage: mpirun -np P ./e4c [--max-count N] [--iters N] [--ppn a,b,...] [--ops reduce,allreduce,bcast]
+//                           [--root R] [--segment BYTES]
+//   the default --ppn is 1, 2, 4, ... up to P
+
+struct Options {
+    size_t max_count = 1 << 20;
+    int iters = 50;
+    std::vector<int> ppn;
+    std::string ops = "reduce,allreduce,bcast";
+    int root = 0;
+    size_t segment = 1 << 20;
+};
+
+// Time one collective in one mode; false in ok if any rank got a wrong result
+double run(const std::string& op, hier::Communicator& hc, hier::Mode mode, std::vector<float>& send,
+           std::vector<float>& recv, size_t count, int root, int rank, int size, bool& ok) {
+    std::fill(recv.begin(), recv.begin() + count, -1.0f);
+    if (op == "bcast") {
+        for (size_t i = 0; i < count; ++i) {
+            recv[i] = rank == root ? (float)(i % 1024) : -1.0f;
+        }
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    if (op == "reduce") {
+        hc.reduce(send.data(), recv.data(), count, root, mode);
+    } else if (op == "allreduce") {
+        hc.allreduce(send.data(), recv.data(), count, mode);
+    } else {
+        hc.bcast(recv.data(), count * sizeof(float), root, mode);
+    }
+    double elapsed = MPI_Wtime() - start;
+
+    float sum = (float)size * (size + 1) / 2;
+    for (size_t i = 0; i < count; ++i) {
+        if (op == "bcast") {
+            ok = ok && recv[i] == (float)(i % 1024);
+        } else if (op == "allreduce" || rank == root) {
+            ok = ok && recv[i] == sum;
+        }
+    }
+    return elapsed;
+}
+
+// Reduce, allreduce and bcast straight after one another, with changing roots and
+// counts of one element up to several segments; false if any rank got a wrong result
+bool check_back_to_back(hier::Communicator& hc, size_t segment, int rank, int size) {
+    const size_t counts[] = {1, 1000, segment / sizeof(float) * 5 / 2 + 3};
+    std::vector<float> send(counts[2]), recv(counts[2]), data(counts[2]);
+    bool ok = true;
+    for (int round = 0; round < 20; ++round) {
+        size_t count = counts[round % 3];
+        int root = round % size;
+        float sum = (float)size * (size + 1) / 2 + (float)size * round;
+        std::fill(send.begin(), send.end(), (float)(rank + 1 + round));
+        hc.allreduce(send.data(), recv.data(), count, hier::Mode::hierarchical);
+        for (size_t i = 0; i < count; ++i) {
+            ok = ok && recv[i] == sum;
+        }
+        for (int b = 0; b < 2; ++b) {
+            int bcast_root = (root + b) % size;
+            for (size_t i = 0; i < count; ++i) {
+                data[i] = rank == bcast_root ? (float)((i + round + b) % 1024) : -1.0f;
+            }
+            hc.bcast(data.data(), count * sizeof(float), bcast_root, hier::Mode::hierarchical);
+            for (size_t i = 0; i < count; ++i) {
+                ok = ok && data[i] == (float)((i + round + b) % 1024);
+            }
+        }
+        std::fill(recv.begin(), recv.end(), -1.0f);
+        hc.reduce(send.data(), recv.data(), count, root, hier::Mode::hierarchical);
+        for (size_t i = 0; i < count && rank == root; ++i) {
+            ok = ok && recv[i] == sum;
+        }
+    }
+    int local_ok = ok, all_ok = 0;
+    MPI_Allreduce(&local_ok, &all_ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    return all_ok;
+}
+
+void bench(const Options& opt, int ppn, int rank, int size) {
+    hier::Communicator hc(MPI_COMM_WORLD, ppn, opt.segment);
+    if (!check_back_to_back(hc, opt.segment, rank, size)) {
+        if (rank == 0) {
+            fprintf(stderr, "--ppn %d: back-to-back hierarchical collectives gave wrong results\n", ppn);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    int largest_node = 0, node_size = hc.node_size();
+    MPI_Allreduce(&node_size, &largest_node, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+    std::vector<float> send(opt.max_count, (float)(rank + 1)), recv(opt.max_count);
+    const char* ops[] = {"reduce", "allreduce", "bcast"};
+
+    for (const char* op : ops) {
+        if (("," + opt.ops + ",").find("," + std::string(op) + ",") == std::string::npos) {
+            continue;
+        }
+        for (size_t count = 1; count <= opt.max_count; count *= 4) {
+            int n = count >= (1 << 18) ? std::max(opt.iters / 10, 3) : opt.iters;
+            double medians[2];
+            bool ok = true;
+            const hier::Mode modes[2] = {hier::Mode::flat, hier::Mode::hierarchical};
+            for (int m = 0; m < 2; ++m) {
+                std::vector<double> times(n), max_times(n);
+                for (int i = -1; i < n; ++i) { // Iteration -1 is the warmup
+                    double t = run(op, hc, modes[m], send, recv, count, opt.root, rank, size, ok);
+                    if (i >= 0) {
+                        times[i] = t;
+                    }
+                }
+                MPI_Allreduce(times.data(), max_times.data(), n, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+                std::sort(max_times.begin(), max_times.end());
+                medians[m] = max_times[n / 2];
+            }
+            int local_ok = ok, all_ok = 0;
+            MPI_Reduce(&local_ok, &all_ok, 1, MPI_INT, MPI_LAND, 0, MPI_COMM_WORLD);
+            if (rank == 0) {
+                printf("%d,%d,%d,%s,%zu,%zu,%.3f,%.3f,%.2f%s\n", size, largest_node, hc.nodes(), op, count,
+                       count * sizeof(float), medians[0] * 1e6, medians[1] * 1e6, medians[0] / medians[1],
+                       all_ok ? "" : ",WRONG");
+                fflush(stdout);
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Options opt;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--max-count") == 0 && i + 1 < argc) {
+            opt.max_count = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            opt.iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ppn") == 0 && i + 1 < argc) {
+            for (char* p = strtok(argv[++i], ","); p; p = strtok(nullptr, ",")) {
+                opt.ppn.push_back(atoi(p));
+                ok = ok && opt.ppn.back() >= 0;
+            }
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            opt.ops = argv[++i];
+        } else if (strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+            opt.root = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--segment") == 0 && i + 1 < argc) {
+            opt.segment = strtoull(argv[++i], nullptr, 10);
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || opt.max_count < 1 || opt.iters < 1 || opt.root < 0 || opt.root >= size) {
+        if (rank == 0) {
+            fprintf(stderr, "Usage: %s [--max-count N] [--iters N] [--ppn a,b,...] [--ops reduce,allreduce,bcast]"
+                            " [--root R] [--segment BYTES]\n", argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (opt.ppn.empty()) {
+        for (int p = 1; p < size; p *= 2) {
+            opt.ppn.push_back(p);
+        }
+        opt.ppn.push_back(size);
+    }
+
+    if (rank == 0) {
+        printf("ranks,ranks_per_node,nodes,op,count,bytes,flat_us,hier_us,speedup\n");
+    }
+    for (int ppn : opt.ppn) {
+        bench(opt, ppn, rank, size);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -1,131 +1,156 @@
 #include <mpi.h>
 #include <iostream>
 #include <vector>
-#include <map>
-
-int main(int argc, char** argv) {
-    int rank, size;
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "mpi_async.hpp"
+
+// Sum of count numbers per process: rank 0 scatters them, every process adds up
+// its share, and a reduction collects the total on rank 0.
+//
+//   wait       MPI_Iscatter of everything, wait, add, MPI_Ireduce, wait: nothing
+//              overlaps, it is the blocking version in nonblocking calls
+//   pipelined  the shares go out in --chunks pieces, one MPI_Iscatter each, all
+//              posted up front; each piece's future continues with adding it up,
+//              so a piece is summed while the later ones are still in flight,
+//              and the last one continues with the MPI_Ireduce
+//
+// Both run on mpi_async.hpp futures. With --progress-thread a background thread
+// drives the engine and runs the continuations (MPI_THREAD_MULTIPLE); otherwise
+// the main thread does, in wait().
+//
+// Usage: mpirun -np P ./e6-async [--count N] [--chunks C] [--progress-thread]
+
+// Deterministic input: rank r's i-th number
+int number(int r, long long i) {
+    return (int)((r * 7 + i) % 100);
+}
 
-    // Initialize MPI
-    MPI_Init(&argc, &argv);
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
+long long add_up(const int* x, int n) {
+    long long sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += x[i];
+    }
+    return sum;
+}
 
-    // Error messages map
-    std::map<int, std::string> error_messages = {
-        {MPI_SUCCESS, "No error"},
-        {MPI_ERR_BUFFER, "Invalid buffer pointer"},
-        {MPI_ERR_COUNT, "Invalid count argument"},
-        {MPI_ERR_TYPE, "Invalid datatype argument"},
-        {MPI_ERR_TAG, "Invalid tag argument"},
-        {MPI_ERR_COMM, "Invalid communicator"},
-        {MPI_ERR_RANK, "Invalid rank"},
-        {MPI_ERR_REQUEST, "Invalid request (handle)"},
-        {MPI_ERR_ROOT, "Invalid root"},
-        {MPI_ERR_GROUP, "Invalid group"},
-        {MPI_ERR_OP, "Invalid operation"},
-        {MPI_ERR_TOPOLOGY, "Invalid topology"},
-        {MPI_ERR_DIMS, "Invalid dimension argument"},
-        {MPI_ERR_ARG, "Invalid argument of some other kind"},
-        {MPI_ERR_UNKNOWN, "Unknown error"},
-        {MPI_ERR_TRUNCATE, "Message truncated on receive"},
-        {MPI_ERR_OTHER, "Known error not in this list"},
-        {MPI_ERR_INTERN, "Internal MPI (implementation) error"},
-        {MPI_ERR_IN_STATUS, "Error code is in status"},
-        {MPI_ERR_PENDING, "Pending request"},
-        {MPI_ERR_KEYVAL, "Invalid keyval has been passed"},
-        {MPI_ERR_NO_MEM, "MPI_ALLOC_MEM failed because memory is exhausted"},
-        {MPI_ERR_BASE, "Invalid base passed to MPI_FREE_MEM"},
-        {MPI_ERR_INFO_KEY, "Key longer than MPI_MAX_INFO_KEY"},
-        {MPI_ERR_INFO_VALUE, "Value longer than MPI_MAX_INFO_VAL"},
-        {MPI_ERR_INFO_NOKEY, "Invalid key passed to MPI_INFO_DELETE"},
-        {MPI_ERR_SPAWN, "Error in spawning processes"},
-        {MPI_ERR_PORT, "Invalid port name passed to MPI_COMM_CONNECT"},
-        {MPI_ERR_SERVICE, "Invalid service name passed to MPI_UNPUBLISH_NAME"},
-        {MPI_ERR_NAME, "Invalid service name passed to MPI_LOOKUP_NAME"},
-        {MPI_ERR_WIN, "Invalid win argument"},
-        {MPI_ERR_SIZE, "Invalid size argument"},
-        {MPI_ERR_DISP, "Invalid disp argument"},
-        {MPI_ERR_INFO, "Invalid info argument"},
-        {MPI_ERR_LOCKTYPE, "Invalid locktype argument"},
-        {MPI_ERR_ASSERT, "Invalid assert argument"},
-        {MPI_ERR_RMA_CONFLICT, "Conflicting accesses to window"},
-        {MPI_ERR_RMA_SYNC, "Wrong synchronization of RMA calls"},
-        {MPI_ERR_FILE, "Invalid file handle"},
-        {MPI_ERR_NOT_SAME, "Collective argument not identical on all processes"},
-        {MPI_ERR_AMODE, "Error related to the amode passed to MPI_FILE_OPEN"},
-        {MPI_ERR_UNSUPPORTED_DATAREP, "Unsupported datarep passed to MPI_FILE_SET_VIEW"},
-        {MPI_ERR_UNSUPPORTED_OPERATION, "Unsupported operation, such as seeking on a file which supports sequential access only"},
-        {MPI_ERR_NO_SUCH_FILE, "File does not exist"},
-        {MPI_ERR_FILE_EXISTS, "File exists"},
-        {MPI_ERR_BAD_FILE, "Invalid file name (e.g., path name too long)"},
-        {MPI_ERR_ACCESS, "Permission denied"},
-        {MPI_ERR_NO_SPACE, "Not enough space"},
-        {MPI_ERR_QUOTA, "Quota exceeded"},
-        {MPI_ERR_READ_ONLY, "Read-only file or file system"},
-        {MPI_ERR_FILE_IN_USE, "File operation could not be completed, as the file is currently open by some process"},
-        {MPI_ERR_DUP_DATAREP, "Conversion functions could not be registered because a data representation identifier was already defined"},
-        {MPI_ERR_CONVERSION, "An error occurred in a user-supplied data conversion function"},
-        {MPI_ERR_IO, "Other I/O error"},
-        {MPI_ERR_LASTCODE, "Last error code"}
-    };
+// Each piece is rank 0's k-th run of chunk numbers in every process's share: a
+// type of chunk ints whose extent is a whole share, so MPI_Iscatter takes process
+// r's run r shares further on
+long long run_pipelined(mpia::Engine& engine, const std::vector<int>& numbers, std::vector<int>& mine, int count,
+                        int chunks, double& elapsed) {
+    int chunk = (count + chunks - 1) / chunks;
+    std::vector<long long> partial(chunks, 0);
+    long long local_sum = 0, global_sum = 0;
+    std::vector<mpia::Future<void>> summed;
+
+    double start = MPI_Wtime();
+    for (int k = 0; k < chunks; ++k) {
+        int first = std::min(k * chunk, count), n = std::min(chunk, count - first);
+        MPI_Datatype run, share;
+        MPI_Type_contiguous(n, MPI_INT, &run);
+        MPI_Type_create_resized(run, 0, (MPI_Aint)count * sizeof(int), &share);
+        MPI_Type_commit(&share);
+        MPI_Request r;
+        mpiw::check(MPI_Iscatter(numbers.empty() ? nullptr : &numbers[first], 1, share, &mine[first], n, MPI_INT, 0,
+                                 MPI_COMM_WORLD, &r), "MPI_Iscatter");
+        MPI_Type_free(&run);
+        MPI_Type_free(&share);
+        summed.push_back(engine.track(r).then([&, k, first, n] { partial[k] = add_up(&mine[first], n); }));
+    }
+    mpia::when_all(summed)
+        .then([&] {
+            for (long long p : partial) {
+                local_sum += p;
+            }
+            return mpia::ireduce(engine, &local_sum, &global_sum, 1, MPI_SUM, 0);
+        })
+        .wait();
+    elapsed = MPI_Wtime() - start;
+    return global_sum;
+}
 
-    // Create a vector with size equal to the number of processes
-    std::vector<int> numbers(size);
-    int local_sum = 0;
+long long run_wait(mpia::Engine& engine, const std::vector<int>& numbers, std::vector<int>& mine, int count,
+                   double& elapsed) {
+    long long local_sum = 0, global_sum = 0;
+    double start = MPI_Wtime();
+    mpia::iscatter(engine, numbers.data(), mine.data(), count, 0).wait();
+    local_sum = add_up(mine.data(), count);
+    mpia::ireduce(engine, &local_sum, &global_sum, 1, MPI_SUM, 0).wait();
+    elapsed = MPI_Wtime() - start;
+    return global_sum;
+}
 
-    // Only the master process initializes the data
-    if (rank == 0) {
-        for (int i = 0; i < size; ++i) {
-            numbers[i] = i + 1; // Fill the vector with numbers 1, 2, ..., size
-            std::cout << "Process " << rank << ": numbers[" << i << "] = " << numbers[i] << std::endl;
+int main(int argc, char** argv) {
+    int rank, size, provided;
+    int count = 1 << 22, chunks = 16;
+    bool progress_thread = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--progress-thread") == 0) {
+            progress_thread = true;
+        } else if (std::strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = std::atoi(argv[++i]);
+        } else if (std::strcmp(argv[i], "--chunks") == 0 && i + 1 < argc) {
+            chunks = std::atoi(argv[++i]);
+        } else {
+            count = -1;
         }
     }
 
-    // Declare the request object for non-blocking communication
-    MPI_Request send_request, recv_request;
-    MPI_Status send_status, recv_status;
-
-    // Non-blocking scatter
-    int local_number = 0;
-    std::cout << "Process " << rank << ": Before MPI_Iscatter, sending data..." << std::endl;
-    int scatter_err = MPI_Iscatter(numbers.data(), 1, MPI_INT, &local_number, 1, MPI_INT, 0, MPI_COMM_WORLD, &recv_request);
-
-    // Error handling for MPI_Iscatter
-    if (scatter_err != MPI_SUCCESS) {
-        std::cerr << "Error in MPI_Iscatter on process " << rank << ": " 
-                  << error_messages[scatter_err] << std::endl;
-        MPI_Abort(MPI_COMM_WORLD, scatter_err);
+    // Initialize MPI; a progress thread calls MPI concurrently with the main thread
+    MPI_Init_thread(&argc, &argv, progress_thread ? MPI_THREAD_MULTIPLE : MPI_THREAD_SINGLE, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (count < 1 || chunks < 1) {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0] << " [--count N] [--chunks C] [--progress-thread]" << std::endl;
+        }
+        MPI_Finalize();
         return 1;
     }
 
-    // Wait for scatter to complete (since this is non-blocking)
-    MPI_Wait(&recv_request, &recv_status);
-    std::cout << "Process " << rank << ": After MPI_Iscatter, received local number " << local_number << std::endl;
-
-    // Each process computes the sum of its number
-    local_sum = local_number;
-    std::cout << "Process " << rank << ": Local sum = " << local_sum << std::endl;
-
-    // Non-blocking reduce
-    int global_sum = 0;
-    std::cout << "Process " << rank << ": Before MPI_Ireduce, local_sum = " << local_sum << std::endl;
-    int reduce_err = MPI_Ireduce(&local_sum, &global_sum, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD, &send_request);
-
-    // Error handling for MPI_Ireduce
-    if (reduce_err != MPI_SUCCESS) {
-        std::cerr << "Error in MPI_Ireduce on process " << rank << ": " 
-                  << error_messages[reduce_err] << std::endl;
-        MPI_Abort(MPI_COMM_WORLD, reduce_err);
-        return 1;
+    // Only the master process initializes the data
+    std::vector<int> numbers, mine(count);
+    long long expected = 0;
+    if (rank == 0) {
+        numbers.resize((size_t)count * size);
+        for (int r = 0; r < size; ++r) {
+            for (long long i = 0; i < count; ++i) {
+                numbers[(size_t)r * count + i] = number(r, i);
+                expected += number(r, i);
+            }
+        }
     }
 
-    // Wait for the reduce to complete
-    MPI_Wait(&send_request, &send_status);
-
-    // Only the root process will print the result
-    if (rank == 0) {
-        std::cout << "Process " << rank << ": The global sum is " << global_sum << std::endl;
+    {
+        mpia::Engine engine;
+        if (progress_thread && !engine.start_thread()) {
+            if (rank == 0) {
+                std::cerr << "The MPI library does not support MPI_THREAD_MULTIPLE, needed by --progress-thread"
+                          << std::endl;
+            }
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        double t_wait = 0.0, t_pipelined = 0.0, max_wait = 0.0, max_pipelined = 0.0;
+        for (int round = 0; round < 2; ++round) { // The first round warms up
+            MPI_Barrier(MPI_COMM_WORLD);
+            long long sum_wait = run_wait(engine, numbers, mine, count, t_wait);
+            MPI_Barrier(MPI_COMM_WORLD);
+            long long sum_pipelined = run_pipelined(engine, numbers, mine, count, chunks, t_pipelined);
+            if (rank == 0 && round == 1) {
+                std::cout << "Process " << rank << ": The global sum is " << sum_pipelined << " (expected " << expected
+                          << ", wait version " << sum_wait << ")" << std::endl;
+            }
+        }
+        MPI_Reduce(&t_wait, &max_wait, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&t_pipelined, &max_pipelined, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            std::cout << size << " processes x " << count << " numbers, " << chunks << " chunks"
+                      << (engine.threaded() ? ", progress thread" : "") << ": wait " << max_wait * 1e3
+                      << " ms, pipelined " << max_pipelined * 1e3 << " ms (" << max_wait / max_pipelined << "x)"
+                      << std::endl;
+        }
     }
 
     // Finalize MPI
@@ -0,0 +1,288 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+// The scatter/sum/reduce pipeline of e6_sync_add and e6_async_add, with vectors
+// of count numbers per rank, built five ways:
+//
+//   collective     MPI_Scatter + MPI_Reduce (e6_sync_add)
+//   nonblocking    MPI_Iscatter + MPI_Ireduce, each waited for (e6_async_add)
+//   fence_get      every rank MPI_Gets its chunk from rank 0's MPI_Win_create
+//                  window, then MPI_Accumulates its sum into rank 0; each step is
+//                  a fence epoch
+//   fence_put      rank 0 MPI_Puts every chunk into the receivers' MPI_Win_allocate
+//                  windows, then as fence_get
+//   passive        windows stay under MPI_Win_lock_all for the whole run: a rank
+//                  Gets its chunk and flushes, Accumulates its sum and bumps an
+//                  arrival counter with MPI_Fetch_and_op; rank 0 polls the counter.
+//                  No rank ever waits for another except rank 0 for the last sum
+//
+// --skew US makes the consumers irregular: in every round each rank first works
+// for a different pseudo-random 0..US microseconds. Reported per size: median
+// round time (slowest rank) and the average time per rank spent in
+// communication and synchronisation, i.e. round time minus its own work.
+//
+// Usage: mpirun -np P ./e6_rma [--max-count N] [--iters N] [--skew US] [--scaling]
+//   --scaling  repeat on communicators of 2, 4, 8, ... and P processes
+
+struct Context {
+    MPI_Comm comm;
+    int rank, size, count;
+    std::vector<int> numbers;    // Rank 0: count numbers per rank, the data to distribute
+    int* chunk;                  // This rank's count numbers; fence_put target window
+    long long* result;           // Rank 0: the sum of the fence variants
+    long long* result_passive;   // Rank 0: the sum (disp 0) and arrivals (disp 1) of the passive variant
+    MPI_Win numbers_win, chunk_win, result_win;       // Fence epochs
+    MPI_Win numbers_passive_win, result_passive_win;  // Locked for the whole run
+};
+
+long long local_sum(const int* x, int n) {
+    long long sum = 0;
+    for (int i = 0; i < n; ++i) {
+        sum += x[i];
+    }
+    return sum;
+}
+
+long long run_collective(Context& c) {
+    long long sum, global = 0;
+    MPI_Scatter(c.numbers.data(), c.count, MPI_INT, c.chunk, c.count, MPI_INT, 0, c.comm);
+    sum = local_sum(c.chunk, c.count);
+    MPI_Reduce(&sum, &global, 1, MPI_LONG_LONG, MPI_SUM, 0, c.comm);
+    return global;
+}
+
+long long run_nonblocking(Context& c) {
+    long long sum, global = 0;
+    MPI_Request request;
+    MPI_Iscatter(c.numbers.data(), c.count, MPI_INT, c.chunk, c.count, MPI_INT, 0, c.comm, &request);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    sum = local_sum(c.chunk, c.count);
+    MPI_Ireduce(&sum, &global, 1, MPI_LONG_LONG, MPI_SUM, 0, c.comm, &request);
+    MPI_Wait(&request, MPI_STATUS_IGNORE);
+    return global;
+}
+
+// Reduction shared by the fence variants: every rank adds its sum into rank 0
+long long accumulate_fence(Context& c, long long sum) {
+    if (c.rank == 0) {
+        c.result[0] = 0; // Local store before the epoch opens
+    }
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, c.result_win);
+    MPI_Accumulate(&sum, 1, MPI_LONG_LONG, 0, 0, 1, MPI_LONG_LONG, MPI_SUM, c.result_win);
+    MPI_Win_fence(MPI_MODE_NOSUCCEED, c.result_win);
+    return c.rank == 0 ? c.result[0] : 0;
+}
+
+long long run_fence_get(Context& c) {
+    MPI_Win_fence(MPI_MODE_NOPRECEDE | MPI_MODE_NOPUT, c.numbers_win);
+    MPI_Get(c.chunk, c.count, MPI_INT, 0, (MPI_Aint)c.rank * c.count, c.count, MPI_INT, c.numbers_win);
+    MPI_Win_fence(MPI_MODE_NOSUCCEED, c.numbers_win);
+    return accumulate_fence(c, local_sum(c.chunk, c.count));
+}
+
+long long run_fence_put(Context& c) {
+    MPI_Win_fence(MPI_MODE_NOPRECEDE, c.chunk_win);
+    if (c.rank == 0) {
+        for (int r = 0; r < c.size; ++r) {
+            MPI_Put(&c.numbers[(size_t)r * c.count], c.count, MPI_INT, r, 0, c.count, MPI_INT, c.chunk_win);
+        }
+    }
+    MPI_Win_fence(MPI_MODE_NOSUCCEED | MPI_MODE_NOSTORE, c.chunk_win);
+    return accumulate_fence(c, local_sum(c.chunk, c.count));
+}
+
+long long run_passive(Context& c) {
+    const long long one = 1;
+    if (c.rank != 0) {
+        MPI_Get(c.chunk, c.count, MPI_INT, 0, (MPI_Aint)c.rank * c.count, c.count, MPI_INT, c.numbers_passive_win);
+        MPI_Win_flush(0, c.numbers_passive_win);
+        long long sum = local_sum(c.chunk, c.count), previous;
+        // Accumulates are only ordered on the same location: the sum (disp 0) must be
+        // complete at rank 0 before the arrival (disp 1) can be seen
+        MPI_Accumulate(&sum, 1, MPI_LONG_LONG, 0, 0, 1, MPI_LONG_LONG, MPI_SUM, c.result_passive_win);
+        MPI_Win_flush(0, c.result_passive_win);
+        MPI_Fetch_and_op(&one, &previous, MPI_LONG_LONG, 0, 1, MPI_SUM, c.result_passive_win);
+        MPI_Win_flush(0, c.result_passive_win);
+        return 0;
+    }
+
+    long long sum = local_sum(c.numbers.data(), c.count), arrivals = 0, total = 0;
+    while (arrivals < c.size - 1) {
+        MPI_Fetch_and_op(nullptr, &arrivals, MPI_LONG_LONG, 0, 1, MPI_NO_OP, c.result_passive_win);
+        MPI_Win_flush(0, c.result_passive_win);
+    }
+    MPI_Fetch_and_op(nullptr, &total, MPI_LONG_LONG, 0, 0, MPI_NO_OP, c.result_passive_win);
+    MPI_Win_flush(0, c.result_passive_win);
+    return total + sum;
+}
+
+// Called between rounds, after the others are done with the previous one
+void reset_passive(Context& c) {
+    if (c.rank == 0) {
+        c.result_passive[0] = c.result_passive[1] = 0;
+        MPI_Win_sync(c.result_passive_win);
+    }
+}
+
+struct Variant {
+    const char* name;
+    long long (*run)(Context& c);
+};
+
+const Variant variants[] = {
+    {"collective", run_collective},
+    {"nonblocking", run_nonblocking},
+    {"fence_get", run_fence_get},
+    {"fence_put", run_fence_put},
+    {"passive", run_passive},
+};
+
+void spin(double seconds) {
+    double end = MPI_Wtime() + seconds;
+    while (MPI_Wtime() < end) {
+    }
+}
+
+// Pseudo-random work of rank in round, in [0, skew] seconds
+double work_for(int rank, int round, double skew) {
+    unsigned x = (unsigned)rank * 2654435761u ^ (unsigned)round * 40503u;
+    x ^= x >> 13;
+    x *= 0x5bd1e995u;
+    x ^= x >> 15;
+    return skew * (x % 1001) / 1000.0;
+}
+
+void bench(MPI_Comm comm, int max_count, int iters, double skew) {
+    Context c;
+    c.comm = comm;
+    MPI_Comm_rank(comm, &c.rank);
+    MPI_Comm_size(comm, &c.size);
+    if (c.rank == 0) {
+        c.numbers.resize((size_t)max_count * c.size);
+        for (size_t i = 0; i < c.numbers.size(); ++i) {
+            c.numbers[i] = (int)(i % 1000) + 1;
+        }
+    }
+
+    // Windows are set up once and reused by every round, as a real pipeline would
+    MPI_Aint numbers_bytes = (MPI_Aint)c.numbers.size() * sizeof(int);
+    MPI_Aint result_bytes = c.rank == 0 ? 2 * sizeof(long long) : 0;
+    MPI_Win_create(c.numbers.data(), numbers_bytes, sizeof(int), MPI_INFO_NULL, comm, &c.numbers_win);
+    MPI_Win_create(c.numbers.data(), numbers_bytes, sizeof(int), MPI_INFO_NULL, comm, &c.numbers_passive_win);
+    MPI_Win_allocate((MPI_Aint)max_count * sizeof(int), sizeof(int), MPI_INFO_NULL, comm, &c.chunk, &c.chunk_win);
+    MPI_Win_allocate(result_bytes, sizeof(long long), MPI_INFO_NULL, comm, &c.result, &c.result_win);
+    MPI_Win_allocate(result_bytes, sizeof(long long), MPI_INFO_NULL, comm, &c.result_passive, &c.result_passive_win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, c.numbers_passive_win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, c.result_passive_win);
+
+    for (int count = 1; count <= max_count; count *= 8) {
+        c.count = count;
+        long long expected = 0;
+        if (c.rank == 0) {
+            expected = local_sum(c.numbers.data(), count * c.size);
+        }
+        for (const Variant& v : variants) {
+            int n = count >= (1 << 16) ? std::max(iters / 10, 3) : iters;
+            std::vector<double> times(n), sync(n);
+            bool correct = true;
+            for (int i = -1; i < n; ++i) {
+                reset_passive(c);
+                MPI_Barrier(comm);
+                double start = MPI_Wtime(), work = work_for(c.rank, i, skew);
+                spin(work);
+                long long global = v.run(c);
+                double elapsed = MPI_Wtime() - start;
+                if (i >= 0) {
+                    times[i] = elapsed; // Iteration -1 is the warmup
+                    sync[i] = elapsed - work;
+                }
+                correct = correct && (c.rank != 0 || global == expected);
+            }
+            std::vector<double> max_times(n);
+            double my_sync = 0.0, total_sync = 0.0;
+            for (double s : sync) {
+                my_sync += s / n;
+            }
+            int ok = correct, all_ok = 0;
+            MPI_Reduce(times.data(), max_times.data(), n, MPI_DOUBLE, MPI_MAX, 0, comm);
+            MPI_Reduce(&my_sync, &total_sync, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+            MPI_Reduce(&ok, &all_ok, 1, MPI_INT, MPI_LAND, 0, comm);
+            if (c.rank == 0) {
+                std::sort(max_times.begin(), max_times.end());
+                printf("%d,%d,%zu,%s,%.3f,%.3f%s\n", c.size, count, count * sizeof(int), v.name, max_times[n / 2] * 1e6,
+                       total_sync / c.size * 1e6, all_ok ? "" : ",WRONG");
+                fflush(stdout);
+            }
+        }
+    }
+
+    MPI_Win_unlock_all(c.result_passive_win);
+    MPI_Win_unlock_all(c.numbers_passive_win);
+    MPI_Win_free(&c.result_passive_win);
+    MPI_Win_free(&c.result_win);
+    MPI_Win_free(&c.chunk_win);
+    MPI_Win_free(&c.numbers_passive_win);
+    MPI_Win_free(&c.numbers_win);
+}
+
+int main(int argc, char** argv) {
+    int max_count = 1 << 18, iters = 50;
+    double skew = 0.0;
+    bool scaling = false;
+
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--max-count") == 0 && i + 1 < argc) {
+            max_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--skew") == 0 && i + 1 < argc) {
+            skew = atof(argv[++i]) * 1e-6;
+        } else if (strcmp(argv[i], "--scaling") == 0) {
+            scaling = true;
+        } else {
+            if (rank == 0) {
+                fprintf(stderr, "Usage: %s [--max-count N] [--iters N] [--skew US] [--scaling]\n", argv[0]);
+            }
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (max_count < 1 || iters < 1 || size < 2) {
+        if (rank == 0) {
+            fprintf(stderr, "Needs at least 2 processes and positive --max-count and --iters\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    std::vector<int> comm_sizes;
+    for (int p = 2; scaling && p < size; p *= 2) {
+        comm_sizes.push_back(p);
+    }
+    comm_sizes.push_back(size);
+
+    if (rank == 0) {
+        printf("ranks,count,bytes_per_rank,variant,median_us,sync_per_rank_us\n");
+    }
+    for (int p : comm_sizes) {
+        MPI_Comm comm;
+        MPI_Comm_split(MPI_COMM_WORLD, rank < p ? 0 : MPI_UNDEFINED, rank, &comm);
+        if (comm != MPI_COMM_NULL) {
+            bench(comm, max_count, iters, skew);
+            MPI_Comm_free(&comm);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
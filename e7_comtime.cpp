@@ -1,7 +1,318 @@
 #include <mpi.h>
+#include <stdio.h>
 #include <iostream>
 #include <vector>
-#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "bcast.hpp"
+#include "mpi_async.hpp"
+
+// OSU-style communication microbenchmarks.
+//
+// Every test sweeps message sizes in powers of two, runs warmup iterations and
+// then timed iterations, and reports min/median/p99 latency and the bandwidth at
+// the median. Point-to-point tests run between ranks 0 and 1; collectives run on
+// all ranks, with a barrier before each iteration and the slowest rank's time
+// taken for that iteration. Results go to stdout as CSV (default) or JSON.
+//
+// Tests:
+//   pingpong    blocking MPI_Send/MPI_Recv round trip, latency = half the round trip
+//   uni_stream  rank 0 streams a window of blocking MPI_Sends to rank 1
+//   bi_stream   both ranks exchange a window of MPI_Isend/MPI_Irecv at the same time
+//   window      rank 0 posts a window of MPI_Isend, rank 1 a window of MPI_Irecv
+//   bcast, reduce, allreduce, gather, alltoall
+//   bcast_linear, bcast_binomial, bcast_scatter_allgather, bcast_pipeline, bcast_auto
+//               the broadcast algorithms of bcast.hpp, to compare against bcast (MPI_Bcast);
+//               bcast_linear is the root-serial send loop
+//   ibcast_overlap, iallreduce_overlap
+//               MPI_Ibcast / MPI_Iallreduce through mpi_async.hpp futures, overlapped
+//               with --compute-us of computation in ten slices that drive the
+//               engine in between; the time reported is what the computation did
+//               not hide (total minus compute), to compare with bcast/allreduce;
+//               it is no transfer time, so their bandwidth column is 0
+//
+// Gather and alltoall need size * bytes of buffer per rank and stop at --max-bytes total.
+//
+// Usage: mpirun -np P ./e7 [--min-bytes B] [--max-bytes B] [--iters N] [--iters-large N]
+//                          [--warmup N] [--window W] [--tests a,b,...] [--format csv|json]
+//                          [--compute-us US]
+
+struct Options {
+    size_t min_bytes = 1;
+    size_t max_bytes = 64 << 20;
+    int iters = 1000;             // Timed iterations for messages below large_bytes
+    int iters_large = 100;        // Timed iterations from large_bytes up
+    int warmup = 100;             // Warmup iterations (a tenth of this for large messages)
+    size_t large_bytes = 64 << 10;
+    int window = 64;              // Messages in flight per iteration in the streaming tests
+    double compute_us = 100.0;    // Computation overlapped with each collective in the *_overlap tests
+    std::string tests = "pingpong,uni_stream,bi_stream,window,bcast,reduce,allreduce,gather,alltoall,"
+                        "bcast_linear,bcast_binomial,bcast_scatter_allgather,bcast_pipeline,bcast_auto,"
+                        "ibcast_overlap,iallreduce_overlap";
+    bool json = false;
+};
+
+bool parse_options(int argc, char** argv, Options& opt) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i], value = argv[i + 1];
+        if (arg == "--min-bytes") {
+            opt.min_bytes = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--max-bytes") {
+            opt.max_bytes = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--iters") {
+            opt.iters = std::atoi(value.c_str());
+        } else if (arg == "--iters-large") {
+            opt.iters_large = std::atoi(value.c_str());
+        } else if (arg == "--warmup") {
+            opt.warmup = std::atoi(value.c_str());
+        } else if (arg == "--window") {
+            opt.window = std::atoi(value.c_str());
+        } else if (arg == "--compute-us") {
+            opt.compute_us = std::atof(value.c_str());
+        } else if (arg == "--tests") {
+            opt.tests = value;
+        } else if (arg == "--format") {
+            opt.json = value == "json";
+        } else {
+            return false;
+        }
+    }
+    return argc % 2 == 1 && opt.min_bytes >= 1 && opt.min_bytes <= opt.max_bytes && opt.iters > 0
+           && opt.iters_large > 0 && opt.window > 0 && opt.compute_us >= 0.0;
+}
+
+// Buffers shared by all tests, sized once for the largest message
+struct Context {
+    int rank, size;
+    int window;
+    std::vector<char> send, recv;
+    std::vector<MPI_Request> requests;
+    double compute;               // Seconds of computation in the *_overlap tests
+    mpia::Engine engine;
+};
+
+// One benchmark: run() performs one iteration and returns the time it measured on
+// this rank, already divided down to a single message where the test sends several
+struct Test {
+    const char* name;
+    bool collective;
+    double volume;          // Bytes moved per message, as a multiple of the message size; 0: no bandwidth
+    size_t min_bytes;       // Smallest meaningful message (reductions work on floats)
+    bool per_rank_buffers;  // Needs size * bytes of buffer (gather, alltoall)
+    double (*run)(Context&, size_t bytes);
+};
+
+double run_pingpong(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    if (ctx.rank == 0) {
+        MPI_Send(ctx.send.data(), (int)bytes, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
+        MPI_Recv(ctx.recv.data(), (int)bytes, MPI_BYTE, 1, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    } else {
+        MPI_Recv(ctx.recv.data(), (int)bytes, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        MPI_Send(ctx.send.data(), (int)bytes, MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+    }
+    return (MPI_Wtime() - start) / 2;
+}
+
+// Rank 1 acknowledges the whole window so rank 0 times delivery, not just injection
+void wait_for_ack(Context& ctx) {
+    char ack = 0;
+    if (ctx.rank == 0) {
+        MPI_Recv(&ack, 1, MPI_BYTE, 1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    } else {
+        MPI_Send(&ack, 1, MPI_BYTE, 0, 1, MPI_COMM_WORLD);
+    }
+}
+
+double run_uni_stream(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    for (int w = 0; w < ctx.window; ++w) {
+        if (ctx.rank == 0) {
+            MPI_Send(ctx.send.data(), (int)bytes, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
+        } else {
+            MPI_Recv(ctx.recv.data(), (int)bytes, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+    }
+    wait_for_ack(ctx);
+    return (MPI_Wtime() - start) / ctx.window;
+}
+
+double run_window(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    for (int w = 0; w < ctx.window; ++w) {
+        if (ctx.rank == 0) {
+            MPI_Isend(ctx.send.data(), (int)bytes, MPI_BYTE, 1, 0, MPI_COMM_WORLD, &ctx.requests[w]);
+        } else {
+            MPI_Irecv(ctx.recv.data(), (int)bytes, MPI_BYTE, 0, 0, MPI_COMM_WORLD, &ctx.requests[w]);
+        }
+    }
+    MPI_Waitall(ctx.window, ctx.requests.data(), MPI_STATUSES_IGNORE);
+    wait_for_ack(ctx);
+    return (MPI_Wtime() - start) / ctx.window;
+}
+
+double run_bi_stream(Context& ctx, size_t bytes) {
+    int peer = 1 - ctx.rank;
+    double start = MPI_Wtime();
+    for (int w = 0; w < ctx.window; ++w) {
+        MPI_Irecv(ctx.recv.data(), (int)bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD, &ctx.requests[w]);
+    }
+    for (int w = 0; w < ctx.window; ++w) {
+        MPI_Isend(ctx.send.data(), (int)bytes, MPI_BYTE, peer, 0, MPI_COMM_WORLD, &ctx.requests[ctx.window + w]);
+    }
+    MPI_Waitall(2 * ctx.window, ctx.requests.data(), MPI_STATUSES_IGNORE);
+    return (MPI_Wtime() - start) / ctx.window;
+}
+
+double run_bcast(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    MPI_Bcast(ctx.send.data(), (int)bytes, MPI_BYTE, 0, MPI_COMM_WORLD);
+    return MPI_Wtime() - start;
+}
+
+template <bcast::Algorithm algorithm>
+double run_bcast_algorithm(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    bcast::broadcast_bytes(ctx.send.data(), bytes, 0, MPI_COMM_WORLD, algorithm);
+    return MPI_Wtime() - start;
+}
+
+// Compute for ctx.compute seconds in ten slices, driving the engine between
+// them, then wait for the collective started at `start`; returns the part of
+// its time the computation did not hide
+double overlap_compute(Context& ctx, const mpia::Future<MPI_Status>& done, double start) {
+    volatile double x = 0.0;
+    for (int slice = 1; slice <= 10; ++slice) {
+        while (MPI_Wtime() - start < ctx.compute * slice / 10) {
+            x = x + 1.0;
+        }
+        ctx.engine.progress();
+    }
+    done.wait();
+    return MPI_Wtime() - start - ctx.compute;
+}
+
+double run_ibcast_overlap(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    return overlap_compute(ctx, mpia::ibcast(ctx.engine, ctx.send.data(), (int)bytes, 0), start);
+}
+
+double run_iallreduce_overlap(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    int count = (int)(bytes / sizeof(float));
+    auto done = mpia::iallreduce(ctx.engine, reinterpret_cast<const float*>(ctx.send.data()),
+                                 reinterpret_cast<float*>(ctx.recv.data()), count, MPI_SUM);
+    return overlap_compute(ctx, done, start);
+}
+
+double run_reduce(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    MPI_Reduce(ctx.send.data(), ctx.recv.data(), (int)(bytes / sizeof(float)), MPI_FLOAT, MPI_SUM, 0, MPI_COMM_WORLD);
+    return MPI_Wtime() - start;
+}
+
+double run_allreduce(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    MPI_Allreduce(ctx.send.data(), ctx.recv.data(), (int)(bytes / sizeof(float)), MPI_FLOAT, MPI_SUM, MPI_COMM_WORLD);
+    return MPI_Wtime() - start;
+}
+
+double run_gather(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    MPI_Gather(ctx.send.data(), (int)bytes, MPI_BYTE, ctx.recv.data(), (int)bytes, MPI_BYTE, 0, MPI_COMM_WORLD);
+    return MPI_Wtime() - start;
+}
+
+double run_alltoall(Context& ctx, size_t bytes) {
+    double start = MPI_Wtime();
+    MPI_Alltoall(ctx.send.data(), (int)bytes, MPI_BYTE, ctx.recv.data(), (int)bytes, MPI_BYTE, MPI_COMM_WORLD);
+    return MPI_Wtime() - start;
+}
+
+const Test all_tests[] = {
+    {"pingpong", false, 1.0, 1, false, run_pingpong},
+    {"uni_stream", false, 1.0, 1, false, run_uni_stream},
+    {"bi_stream", false, 2.0, 1, false, run_bi_stream},
+    {"window", false, 1.0, 1, false, run_window},
+    {"bcast", true, 1.0, 1, false, run_bcast},
+    {"reduce", true, 1.0, sizeof(float), false, run_reduce},
+    {"allreduce", true, 1.0, sizeof(float), false, run_allreduce},
+    {"gather", true, 1.0, 1, true, run_gather},
+    {"alltoall", true, 1.0, 1, true, run_alltoall},
+    {"bcast_linear", true, 1.0, 1, false, run_bcast_algorithm<bcast::Algorithm::linear>},
+    {"bcast_binomial", true, 1.0, 1, false, run_bcast_algorithm<bcast::Algorithm::binomial>},
+    {"bcast_scatter_allgather", true, 1.0, 1, false, run_bcast_algorithm<bcast::Algorithm::scatter_allgather>},
+    {"bcast_pipeline", true, 1.0, 1, false, run_bcast_algorithm<bcast::Algorithm::pipeline>},
+    {"bcast_auto", true, 1.0, 1, false, run_bcast_algorithm<bcast::Algorithm::automatic>},
+    {"ibcast_overlap", true, 0.0, 1, false, run_ibcast_overlap},
+    {"iallreduce_overlap", true, 0.0, sizeof(float), false, run_iallreduce_overlap},
+};
+
+struct Result {
+    std::string test;
+    size_t bytes;
+    int iters;
+    double min, median, p99;  // Seconds
+    double bandwidth;         // Bytes per second at the median
+};
+
+// Run warmup plus timed iterations of one test at one size; valid on rank 0
+Result measure(const Test& test, const Options& opt, Context& ctx, size_t bytes) {
+    bool large = bytes >= opt.large_bytes;
+    int iters = large ? opt.iters_large : opt.iters;
+    int warmup = large ? opt.warmup / 10 : opt.warmup;
+    bool active = test.collective || ctx.rank < 2;
+    std::vector<double> times(iters, 0.0), max_times(iters, 0.0);
+
+    for (int i = -warmup; i < iters; ++i) {
+        if (test.collective) {
+            MPI_Barrier(MPI_COMM_WORLD);
+        }
+        double t = active ? test.run(ctx, bytes) : 0.0;
+        if (i >= 0) {
+            times[i] = t;
+        }
+    }
+    if (test.collective) {
+        MPI_Reduce(times.data(), max_times.data(), iters, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+        times.swap(max_times);
+    }
+
+    std::sort(times.begin(), times.end());
+    Result r;
+    r.test = test.name;
+    r.bytes = bytes;
+    r.iters = iters;
+    r.min = times.front();
+    r.median = times[iters / 2];
+    r.p99 = times[std::min(iters - 1, (int)(0.99 * iters))];
+    r.bandwidth = test.volume > 0.0 && r.median > 0.0 ? test.volume * bytes / r.median : 0.0;
+    return r;
+}
+
+void print_csv_row(const Result& r, int size) {
+    printf("%s,%d,%zu,%d,%.3f,%.3f,%.3f,%.2f\n", r.test.c_str(), size, r.bytes, r.iters, r.min * 1e6, r.median * 1e6,
+           r.p99 * 1e6, r.bandwidth / 1e6);
+    fflush(stdout);
+}
+
+void print_json(const std::vector<Result>& results, int size, const char* library, const char* host) {
+    std::string lib = library;
+    std::replace(lib.begin(), lib.end(), '"', '\'');
+    std::replace(lib.begin(), lib.end(), '\n', ' ');
+    printf("{\n  \"ranks\": %d,\n  \"host\": \"%s\",\n  \"mpi_library\": \"%s\",\n  \"results\": [\n", size, host,
+           lib.c_str());
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        printf("    {\"test\": \"%s\", \"bytes\": %zu, \"iterations\": %d, \"min_us\": %.3f, \"median_us\": %.3f, "
+               "\"p99_us\": %.3f, \"bandwidth_MBps\": %.2f}%s\n",
+               r.test.c_str(), r.bytes, r.iters, r.min * 1e6, r.median * 1e6, r.p99 * 1e6, r.bandwidth / 1e6,
+               i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
 
 int main(int argc, char** argv) {
     int rank, size;
@@ -9,46 +320,64 @@ int main(int argc, char** argv) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-    const int N = 1000000; // Number of elements to send
-    std::vector<int> data(N, rank); // Data to send (all elements initialized to rank)
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0] << " [--min-bytes B] [--max-bytes B] [--iters N] [--iters-large N]"
+                      << " [--warmup N] [--window W] [--tests a,b,...] [--format csv|json] [--compute-us US]"
+                      << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
 
-    MPI_Barrier(MPI_COMM_WORLD); // Synchronize processes before starting the timer
+    Context ctx;
+    ctx.rank = rank;
+    ctx.size = size;
+    ctx.window = opt.window;
+    ctx.send.assign(opt.max_bytes, (char)rank);
+    ctx.recv.assign(opt.max_bytes, 0);
+    ctx.requests.resize(2 * opt.window);
+    ctx.compute = opt.compute_us * 1e-6;
 
-    // Timing synchronous communication
-    double sync_start = MPI_Wtime();
-    if (rank == 0) {
-        // Process 0 sends data to other processes
-        for (int i = 1; i < size; ++i) {
-            MPI_Send(data.data(), N, MPI_INT, i, 0, MPI_COMM_WORLD);
-        }
-    } else {
-        // Other processes receive data
-        MPI_Recv(data.data(), N, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    char library[MPI_MAX_LIBRARY_VERSION_STRING], host[MPI_MAX_PROCESSOR_NAME];
+    int len;
+    MPI_Get_library_version(library, &len);
+    MPI_Get_processor_name(host, &len);
+
+    std::vector<Result> results;
+    if (rank == 0 && !opt.json) {
+        printf("test,ranks,bytes,iterations,min_us,median_us,p99_us,bandwidth_MBps\n");
     }
-    double sync_end = MPI_Wtime();
 
-    // Timing asynchronous communication
-    MPI_Barrier(MPI_COMM_WORLD); // Synchronize processes before starting async timing
-    double async_start = MPI_Wtime();
-    MPI_Request request;
-    if (rank == 0) {
-        // Process 0 sends data asynchronously to other processes
-        for (int i = 1; i < size; ++i) {
-            MPI_Isend(data.data(), N, MPI_INT, i, 0, MPI_COMM_WORLD, &request);
-            MPI_Wait(&request, MPI_STATUS_IGNORE); // Wait for async send to complete
+    std::string selected = "," + opt.tests + ",";
+    for (const Test& test : all_tests) {
+        if (selected.find("," + std::string(test.name) + ",") == std::string::npos) {
+            continue;
+        }
+        if (!test.collective && size < 2) {
+            if (rank == 0) {
+                std::cerr << "Skipping " << test.name << ": needs at least 2 processes" << std::endl;
+            }
+            continue;
+        }
+        for (size_t bytes = opt.min_bytes; bytes <= opt.max_bytes; bytes *= 2) {
+            if (bytes < test.min_bytes || (test.per_rank_buffers && bytes * size > opt.max_bytes)) {
+                continue;
+            }
+            Result r = measure(test, opt, ctx, bytes);
+            MPI_Barrier(MPI_COMM_WORLD);
+            if (rank == 0) {
+                results.push_back(r);
+                if (!opt.json) {
+                    print_csv_row(r, size);
+                }
+            }
         }
-    } else {
-        // Other processes receive data
-        MPI_Request recv_request;
-        MPI_Irecv(data.data(), N, MPI_INT, 0, 0, MPI_COMM_WORLD, &recv_request);
-        MPI_Wait(&recv_request, MPI_STATUS_IGNORE); // Wait for async receive to complete
     }
-    double async_end = MPI_Wtime();
 
-    // Print the results
-    if (rank == 0) {
-        std::cout << "Sync communication time: " << sync_end - sync_start << " seconds." << std::endl;
-        std::cout << "Async communication time: " << async_end - async_start << " seconds." << std::endl;
+    if (rank == 0 && opt.json) {
+        print_json(results, size, library, host);
     }
 
     MPI_Finalize();
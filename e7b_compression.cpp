@@ -0,0 +1,235 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "mpi_compress.hpp"
+
+// Effective bandwidth of mpi_compress.hpp against plain MPI on data of varying
+// compressibility.
+//
+// Every pattern is sent from rank 0 to rank 1 (send: one way, then a one-byte
+// acknowledgement so the time covers delivery) and broadcast from rank 0 to all
+// ranks (bcast: slowest rank's time):
+//
+//   constant     one repeated value, like the buffer e7_comtime.cpp sends (int32)
+//   small_range  random values below 256 (int32)
+//   sparse       95% zeros, random values elsewhere (int32)
+//   timestamps   increasing nanosecond times, about 1 us apart (int64)
+//   random       random full-range values; incompressible (int32)
+//
+// through three paths: raw (MPI_Send / MPI_Bcast of the bytes), compressed
+// (always compress) and adaptive (compress if the model predicts a gain, after
+// Channel::calibrate()). Effective bandwidth is the uncompressed size over the
+// median time; ratio is compressed over raw size; adaptive says which way the
+// adaptive path went. Every received buffer is checked against the original.
+//
+// Usage: mpirun -np P ./e7b [--min-bytes B] [--max-bytes B] [--iters N] [--chunk-bytes B]
+//                           [--patterns a,b,...] [--ops send,bcast]
+
+struct Options {
+    size_t min_bytes = 64 << 10;
+    size_t max_bytes = 64 << 20;
+    int iters = 10;
+    size_t chunk_bytes = 256 << 10;
+    std::string patterns = "constant,small_range,sparse,timestamps,random";
+    std::string ops = "send,bcast";
+};
+
+uint64_t mix(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+void fill(const std::string& pattern, std::vector<int32_t>& x) {
+    for (size_t i = 0; i < x.size(); ++i) {
+        uint64_t r = mix(i);
+        if (pattern == "constant") {
+            x[i] = 1;
+        } else if (pattern == "small_range") {
+            x[i] = (int32_t)(r % 256);
+        } else if (pattern == "sparse") {
+            x[i] = r % 100 < 95 ? 0 : (int32_t)(r >> 32);
+        } else {
+            x[i] = (int32_t)r;
+        }
+    }
+}
+
+void fill(const std::string&, std::vector<int64_t>& x) {
+    int64_t t = 1700000000000000000LL;
+    for (size_t i = 0; i < x.size(); ++i) {
+        t += 900 + (int64_t)(mix(i) % 200);
+        x[i] = t;
+    }
+}
+
+enum Path { raw, compressed, adaptive };
+
+struct Measured {
+    double seconds[3];      // Median per path
+    double ratio = 1.0;     // Wire over raw bytes, compressed path
+    bool adaptive_compressed = false;
+};
+
+// One transfer of x along `path`; returns the time this rank measured
+template <typename T>
+double transfer(const std::string& op, Path path, mpic::Channel& channel, std::vector<T>& x, int rank) {
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    int bytes = (int)(x.size() * sizeof(T));
+    char ack = 0;
+    if (op == "send") {
+        if (rank == 0) {
+            if (path == raw) {
+                MPI_Send(x.data(), bytes, MPI_BYTE, 1, 0, MPI_COMM_WORLD);
+            } else {
+                channel.send(x.data(), x.size(), 1);
+            }
+            MPI_Recv(&ack, 1, MPI_BYTE, 1, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        } else if (rank == 1) {
+            if (path == raw) {
+                MPI_Recv(x.data(), bytes, MPI_BYTE, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            } else {
+                channel.recv(x.data(), x.size(), 0);
+            }
+            MPI_Send(&ack, 1, MPI_BYTE, 0, 1, MPI_COMM_WORLD);
+        }
+    } else if (path == raw) {
+        MPI_Bcast(x.data(), bytes, MPI_BYTE, 0, MPI_COMM_WORLD);
+    } else {
+        channel.bcast(x.data(), x.size(), 0);
+    }
+    return MPI_Wtime() - start;
+}
+
+template <typename T>
+Measured measure(const std::string& op, const std::string& pattern, size_t bytes, const Options& opt,
+                 mpic::Channel& channel, int rank) {
+    size_t n = bytes / sizeof(T);
+    std::vector<T> original(n), x(n);
+    fill(pattern, original);
+    Measured m;
+    long long errors = 0;
+    const mpic::Policy policies[3] = {mpic::Policy::raw, mpic::Policy::compressed, mpic::Policy::adaptive};
+    for (int path = raw; path <= adaptive; ++path) {
+        channel.set_policy(policies[path]);
+        channel.reset_stats();
+        std::vector<double> times;
+        for (int i = -1; i < opt.iters; ++i) { // One warmup
+            x.assign(n, 0);
+            if (rank == 0) {
+                x = original;
+            }
+            double t = transfer(op, (Path)path, channel, x, rank), slowest;
+            MPI_Allreduce(&t, &slowest, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+            if (i >= 0) {
+                times.push_back(slowest);
+            }
+            bool received = op == "bcast" || rank == 1;
+            errors += received && x != original;
+        }
+        std::sort(times.begin(), times.end());
+        m.seconds[path] = times[times.size() / 2];
+        const mpic::Channel::Stats& s = channel.stats();
+        if (path == compressed && s.raw_bytes > 0) {
+            m.ratio = (double)s.wire_bytes / s.raw_bytes;
+        }
+        if (path == adaptive) {
+            m.adaptive_compressed = s.compressed > s.messages / 2;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, &errors, 1, MPI_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+    if (errors > 0) {
+        if (rank == 0) {
+            fprintf(stderr, "%s %s %zu bytes: received data differs from what was sent\n", op.c_str(),
+                    pattern.c_str(), bytes);
+        }
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return m;
+}
+
+bool listed(const std::string& list, const std::string& item) {
+    return ("," + list + ",").find("," + item + ",") != std::string::npos;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Options opt;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--min-bytes") == 0 && i + 1 < argc) {
+            opt.min_bytes = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--max-bytes") == 0 && i + 1 < argc) {
+            opt.max_bytes = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            opt.iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk-bytes") == 0 && i + 1 < argc) {
+            opt.chunk_bytes = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--patterns") == 0 && i + 1 < argc) {
+            opt.patterns = argv[++i];
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            opt.ops = argv[++i];
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok || opt.min_bytes < 8 || opt.min_bytes > opt.max_bytes || opt.max_bytes > (size_t)1 << 30
+        || opt.iters < 1 || size < 2) {
+        if (rank == 0) {
+            fprintf(stderr, "Usage: %s [--min-bytes B] [--max-bytes B] [--iters N] [--chunk-bytes B]"
+                            " [--patterns a,b,...] [--ops send,bcast]   (at least 2 processes)\n", argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    {
+        mpic::Channel channel(MPI_COMM_WORLD, opt.chunk_bytes);
+        channel.calibrate();
+        if (rank == 0) {
+            printf("# link %.0f MB/s, bcast %.0f MB/s, encode %.0f MB/s, decode %.0f MB/s\n",
+                   channel.link_bandwidth() / 1e6, channel.bcast_bandwidth() / 1e6,
+                   channel.encode_throughput() / 1e6, channel.decode_throughput() / 1e6);
+            printf("op,ranks,pattern,bytes,raw_MBps,compressed_MBps,adaptive_MBps,ratio,speedup,adaptive\n");
+        }
+
+        const char* patterns[] = {"constant", "small_range", "sparse", "timestamps", "random"};
+        const char* ops[] = {"send", "bcast"};
+        for (const char* op : ops) {
+            if (!listed(opt.ops, op)) {
+                continue;
+            }
+            for (const char* pattern : patterns) {
+                if (!listed(opt.patterns, pattern)) {
+                    continue;
+                }
+                for (size_t bytes = opt.min_bytes; bytes <= opt.max_bytes; bytes *= 2) {
+                    Measured m = strcmp(pattern, "timestamps") == 0
+                                     ? measure<int64_t>(op, pattern, bytes, opt, channel, rank)
+                                     : measure<int32_t>(op, pattern, bytes, opt, channel, rank);
+                    if (rank == 0) {
+                        printf("%s,%d,%s,%zu,%.1f,%.1f,%.1f,%.4f,%.2f,%s\n", op, size, pattern, bytes,
+                               bytes / m.seconds[raw] / 1e6, bytes / m.seconds[compressed] / 1e6,
+                               bytes / m.seconds[adaptive] / 1e6, m.ratio, m.seconds[raw] / m.seconds[adaptive],
+                               m.adaptive_compressed ? "compressed" : "raw");
+                        fflush(stdout);
+                    }
+                }
+            }
+        }
+    } // The channel frees its communicator before MPI_Finalize
+
+    MPI_Finalize();
+    return 0;
+}
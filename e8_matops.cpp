@@ -1,167 +1,1251 @@
 #include <mpi.h>
 #include <iostream>
 #include <vector>
-#include <random>
-#include <chrono>
-#include <map>
-
-// Error message map
-std::map<int, std::string> error_messages = {
-    {MPI_SUCCESS, "No error"},
-    {MPI_ERR_BUFFER, "Invalid buffer pointer"},
-    {MPI_ERR_COUNT, "Invalid count argument"},
-    {MPI_ERR_TYPE, "Invalid datatype argument"},
-    {MPI_ERR_TAG, "Invalid tag argument"},
-    {MPI_ERR_COMM, "Invalid communicator"},
-    {MPI_ERR_RANK, "Invalid rank"},
-    {MPI_ERR_REQUEST, "Invalid request (handle)"},
-    {MPI_ERR_ROOT, "Invalid root"},
-    {MPI_ERR_GROUP, "Invalid group"},
-    {MPI_ERR_OP, "Invalid operation"},
-    {MPI_ERR_TOPOLOGY, "Invalid topology"},
-    {MPI_ERR_DIMS, "Invalid dimension argument"},
-    {MPI_ERR_ARG, "Invalid argument of some other kind"},
-    {MPI_ERR_UNKNOWN, "Unknown error"},
-    {MPI_ERR_TRUNCATE, "Message truncated on receive"},
-    {MPI_ERR_OTHER, "Known error not in this list"},
-    {MPI_ERR_INTERN, "Internal MPI (implementation) error"},
-    {MPI_ERR_IN_STATUS, "Error code is in status"},
-    {MPI_ERR_PENDING, "Pending request"},
-    {MPI_ERR_KEYVAL, "Invalid keyval has been passed"},
-    {MPI_ERR_NO_MEM, "MPI_ALLOC_MEM failed because memory is exhausted"},
-    {MPI_ERR_BASE, "Invalid base passed to MPI_FREE_MEM"},
-    {MPI_ERR_INFO_KEY, "Key longer than MPI_MAX_INFO_KEY"},
-    {MPI_ERR_INFO_VALUE, "Value longer than MPI_MAX_INFO_VAL"},
-    {MPI_ERR_INFO_NOKEY, "Invalid key passed to MPI_INFO_DELETE"},
-    {MPI_ERR_SPAWN, "Error in spawning processes"},
-    {MPI_ERR_PORT, "Invalid port name passed to MPI_COMM_CONNECT"},
-    {MPI_ERR_SERVICE, "Invalid service name passed to MPI_UNPUBLISH_NAME"},
-    {MPI_ERR_NAME, "Invalid service name passed to MPI_LOOKUP_NAME"},
-    {MPI_ERR_WIN, "Invalid win argument"},
-    {MPI_ERR_SIZE, "Invalid size argument"},
-    {MPI_ERR_DISP, "Invalid disp argument"},
-    {MPI_ERR_INFO, "Invalid info argument"},
-    {MPI_ERR_LOCKTYPE, "Invalid locktype argument"},
-    {MPI_ERR_ASSERT, "Invalid assert argument"},
-    {MPI_ERR_RMA_CONFLICT, "Conflicting accesses to window"},
-    {MPI_ERR_RMA_SYNC, "Wrong synchronization of RMA calls"},
-    {MPI_ERR_FILE, "Invalid file handle"},
-    {MPI_ERR_NOT_SAME, "Collective argument not identical on all processes"},
-    {MPI_ERR_AMODE, "Error related to the amode passed to MPI_FILE_OPEN"},
-    {MPI_ERR_UNSUPPORTED_DATAREP, "Unsupported datarep passed to MPI_FILE_SET_VIEW"},
-    {MPI_ERR_UNSUPPORTED_OPERATION, "Unsupported operation, such as seeking on a file which supports sequential access only"},
-    {MPI_ERR_NO_SUCH_FILE, "File does not exist"},
-    {MPI_ERR_FILE_EXISTS, "File exists"},
-    {MPI_ERR_BAD_FILE, "Invalid file name (e.g., path name too long)"},
-    {MPI_ERR_ACCESS, "Permission denied"},
-    {MPI_ERR_NO_SPACE, "Not enough space"},
-    {MPI_ERR_QUOTA, "Quota exceeded"},
-    {MPI_ERR_READ_ONLY, "Read-only file or file system"},
-    {MPI_ERR_FILE_IN_USE, "File operation could not be completed, as the file is currently open by some process"},
-    {MPI_ERR_DUP_DATAREP, "Conversion functions could not be registered because a data representation identifier was already defined"},
-    {MPI_ERR_CONVERSION, "An error occurred in a user-supplied data conversion function"},
-    {MPI_ERR_IO, "Other I/O error"},
-    {MPI_ERR_LASTCODE, "Last error code"}
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "gemm_kernel.hpp"
+#include "matrix_io.hpp"
+#include "mpi_async.hpp"
+#include "mpi_wrap.hpp"
+#include "thread_pool.hpp"
+
+// Distributed matrix multiplication C = A * B with A (N x K), B (K x M), C (N x M).
+//
+// The ranks form a Pr x Pc process grid and every matrix is split into Pr x Pc
+// blocks; rank (r, c) owns block (r, c) of A, B and C. Block sizes differ by at
+// most one row/column, so any N, M, K and any grid shape work. The product is
+// computed with SUMMA: K is walked in panels, the owner column of each A panel
+// broadcasts it along its grid row and the owner row of each B panel broadcasts
+// it along its grid column, and every rank adds panel_A * panel_B to its C block.
+// Neither panel is packed: a B panel is contiguous rows of the owner's block and
+// an A panel leaves the owner as strided columns through an MPI_Type_vector, and
+// the owner multiplies both in place.
+// No rank ever holds more than its own blocks plus one panel of A and B.
+//
+// C stays distributed unless --gather is given, which collects it on rank 0.
+//
+// A and B are generated in place from --seed, or read from PREFIX_A.bin and
+// PREFIX_B.bin with --load PREFIX (their headers give N, K and M). --store PREFIX
+// writes C (and A and B, when generated) to PREFIX_C.bin etc. Both go through
+// matrix_io.hpp: each rank reads or writes its own block of the file with one
+// collective MPI-IO call, so nothing is staged on rank 0 and the largest problem
+// is bounded by the total memory of all ranks. --verify checks against the
+// generator, so with --load it applies to files written by --store with the same
+// --seed.
+//
+// Hybrid mode (--threads T): each rank multiplies its strips of C on a pool of T
+// threads, so fewer, larger ranks cover the same cores and the panels and MPI
+// buffers exist once per rank instead of once per core. Only the main thread
+// calls MPI (MPI_THREAD_FUNNELED). With --comm-thread the main thread computes
+// nothing and drives the next panel's broadcast and the gather while the other
+// T - 1 threads multiply. Compare layouts at a fixed core count, e.g. 8 cores:
+//   mpirun -np 8 ./e8 --n 4000 ...
+//   mpirun -np 2 --map-by ppr:1:socket --bind-to socket ./e8 --threads 4 ...
+//   mpirun -np 1 --bind-to none ./e8 --threads 8 --comm-thread ...
+//
+// Shared-operand mode (--shared) replaces SUMMA by the plain row distribution,
+// in which every rank needs all of B. It compares every rank holding its own
+// copy of B (MPI_Allgatherv over all ranks) with one copy per node in an
+// MPI_Win_allocate_shared window that the node's leader fills over a
+// communicator of leaders and every rank on the node reads in place. --ppn P
+// groups P consecutive ranks into a node, to try this on a single machine.
+//
+// Tile mode (--schedule static|master|counter|all) hands out tiles of --tile
+// rows of C dynamically (see "Dynamic tile scheduling" below); a rank fetches the
+// rows of A of its tiles with MPI_Get. --slow R:F makes rank R F times slower to
+// show how each schedule copes with an imbalance.
+//
+// Usage: mpirun -np P ./e8 [--n N] [--m M] [--k K] [--grid PrxPc] [--nb panel]
+//                          [--seed S] [--verify] [--gather] [--threads T] [--comm-thread]
+//                          [--shared] [--ppn P]
+//                          [--schedule S] [--tile rows] [--chunk tiles] [--slow R:F]
+//                          [--load PREFIX] [--store PREFIX]
+
+struct Options {
+    int N = 5;      // Rows of A
+    int M = 10;     // Columns of B
+    int K = 5;      // Columns of A and rows of B
+    int Pr = 0;     // Grid rows (0 = let MPI_Dims_create choose)
+    int Pc = 0;     // Grid columns
+    int nb = 64;    // Panel width along K
+    uint64_t seed = 42;
+    bool verify = false;
+    bool gather = false;  // Collect C on rank 0
+    int threads = 1;      // Compute threads per rank
+    bool comm_thread = false;  // Main thread only drives communication
+    bool shared = false;  // Row-distributed multiply with B shared per node instead of SUMMA
+    int ppn = 0;          // Ranks per node (0 = real nodes); smaller values emulate nodes on one machine
+    std::string schedule; // Dynamic tile scheduling instead of SUMMA: static, master, counter or all
+    int tile = 8;         // Rows of C per tile
+    int chunk = 0;        // Tiles per claim (0 = guided)
+    int slow_rank = -1;   // Rank that is slow_factor times slower (--slow R:F)
+    double slow_factor = 1.0;
+    std::string load;     // Read A and B from PREFIX_A.bin and PREFIX_B.bin
+    std::string store;    // Write C (and generated A and B) to PREFIX_C.bin etc.
 };
 
-// Function to check MPI errors
-void checkMPIError(int err_code) {
-    if (err_code != MPI_SUCCESS) {
-        std::cout << "MPI Error: " << error_messages[err_code] << std::endl;
-        MPI_Abort(MPI_COMM_WORLD, err_code);
+// Parse "--key value" pairs; returns false on a malformed command line
+bool parse_options(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool* flag = arg == "--verify" ? &opt.verify : arg == "--gather" ? &opt.gather
+                   : arg == "--comm-thread" ? &opt.comm_thread : arg == "--shared" ? &opt.shared : nullptr;
+        if (flag != nullptr) {
+            *flag = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--n") {
+            opt.N = std::atoi(value.c_str());
+        } else if (arg == "--m") {
+            opt.M = std::atoi(value.c_str());
+        } else if (arg == "--k") {
+            opt.K = std::atoi(value.c_str());
+        } else if (arg == "--nb") {
+            opt.nb = std::atoi(value.c_str());
+        } else if (arg == "--load") {
+            opt.load = value;
+        } else if (arg == "--store") {
+            opt.store = value;
+        } else if (arg == "--schedule") {
+            opt.schedule = value;
+        } else if (arg == "--tile") {
+            opt.tile = std::atoi(value.c_str());
+        } else if (arg == "--chunk") {
+            opt.chunk = std::atoi(value.c_str());
+        } else if (arg == "--slow") {
+            if (std::sscanf(value.c_str(), "%d:%lf", &opt.slow_rank, &opt.slow_factor) != 2) {
+                return false;
+            }
+        } else if (arg == "--ppn") {
+            opt.ppn = std::atoi(value.c_str());
+        } else if (arg == "--threads") {
+            opt.threads = std::atoi(value.c_str());
+        } else if (arg == "--seed") {
+            opt.seed = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--grid") {
+            if (std::sscanf(value.c_str(), "%dx%d", &opt.Pr, &opt.Pc) != 2) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return opt.N >= 0 && opt.M >= 0 && opt.K >= 0 && opt.nb > 0 && opt.threads > 0 && opt.ppn >= 0 && opt.tile > 0
+           && opt.chunk >= 0 && (opt.schedule.empty() || opt.schedule == "all" || opt.schedule == "static"
+                                 || opt.schedule == "master" || opt.schedule == "counter")
+           && ((opt.load.empty() && opt.store.empty()) || (!opt.shared && opt.schedule.empty()));
+}
+
+// Block distribution of n items over p parts: the first n % p parts get one extra item
+int block_size(int n, int p, int i) {
+    return n / p + (i < n % p ? 1 : 0);
+}
+
+int block_start(int n, int p, int i) {
+    return i * (n / p) + std::min(i, n % p);
+}
+
+// Part that owns global index g
+int block_owner(int n, int p, int g) {
+    int q = n / p, r = n % p;
+    if (g < r * (q + 1)) {
+        return g / (q + 1);
     }
+    return r + (g - r * (q + 1)) / q;
 }
 
-// Random number generator
-void fill_matrix_with_random_values(std::vector<int>& matrix, int size) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dis(1, 10);
+// Deterministic value in [1, 10] for global element (i, j) of a matrix, so each
+// rank can generate its own block without any rank holding the whole matrix
+int matrix_value(uint64_t seed, int i, int j) {
+    uint64_t x = seed ^ ((uint64_t)i << 32 | (uint32_t)j);
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (int)(x % 10) + 1;
+}
 
-    for (int i = 0; i < size; ++i) {
-        matrix[i] = dis(gen);
+// Random number generator for a rows x cols block starting at global (row0, col0)
+void fill_block_with_random_values(int* block, uint64_t seed, int row0, int col0, int rows, int cols) {
+    for (int i = 0; i < rows; ++i) {
+        for (int j = 0; j < cols; ++j) {
+            block[(size_t)i * cols + j] = matrix_value(seed, row0 + i, col0 + j);
+        }
     }
 }
 
-int main(int argc, char** argv) {
+// C (rows x cols, leading dimension ldc) += A_panel (rows x w, leading dimension lda) * B_panel (w x cols)
+void multiply_panel(int rows, int cols, int w, const int* A_panel, int lda, const int* B_panel, int* C, int ldc) {
+    gemm::gemm(rows, cols, w, A_panel, lda, B_panel, cols, C, ldc);
+}
+
+// Process grid and the blocks owned by this rank
+struct Grid {
+    MPI_Comm cart, row_comm, col_comm;
+    int Pr, Pc, myrow, mycol;
+    MPI_Comm node_comm;    // Ranks sharing memory with this one
+    MPI_Comm leader_comm;  // Rank 0 of every node; MPI_COMM_NULL on the other ranks
+    int node_rank, node_size;
+};
+
+struct LocalBlocks {
+    int a_rows, a_cols, a_row0, a_col0;  // Block of A
+    int b_rows, b_cols, b_row0, b_col0;  // Block of B
+    std::vector<int> A, B, C;
+};
+
+// One SUMMA panel step: [k, k + w) lies inside a single A column block and a single B row block
+struct Panel {
+    int k, w, a_owner, b_owner;
+};
+
+std::vector<Panel> plan_panels(const Options& opt, const Grid& g) {
+    std::vector<Panel> panels;
+    for (int k = 0; k < opt.K;) {
+        int a_owner = block_owner(opt.K, g.Pc, k);
+        int b_owner = block_owner(opt.K, g.Pr, k);
+        int a_end = block_start(opt.K, g.Pc, a_owner) + block_size(opt.K, g.Pc, a_owner);
+        int b_end = block_start(opt.K, g.Pr, b_owner) + block_size(opt.K, g.Pr, b_owner);
+        int w = std::min({opt.nb, a_end - k, b_end - k});
+        panels.push_back({k, w, a_owner, b_owner});
+        k += w;
+    }
+    return panels;
+}
+
+// Panel of A as the multiply reads it: in place in the owner's block (columns
+// [k, k + w) of a_rows rows, a_cols apart), elsewhere the received contiguous copy
+struct APanel {
+    int* data;
+    int ld;
+};
+
+APanel locate_A_panel(const Grid& g, LocalBlocks& lb, const Panel& p, std::vector<int>& A_panel) {
+    if (g.mycol == p.a_owner) {
+        return {lb.A.data() + (p.k - lb.a_col0), lb.a_cols};
+    }
+    return {A_panel.data(), p.w};
+}
+
+// Start broadcasting a panel of A along the grid row without packing it. The
+// owner sends it from its block through an MPI_Type_vector of a_rows runs of w
+// ints; the others receive the same a_rows * w ints contiguously. The type may be
+// freed at once, MPI keeps it alive until the broadcast completes.
+MPI_Request ibcast_A_panel(const Grid& g, const LocalBlocks& lb, const Panel& p, APanel a) {
+    MPI_Request r;
+    if (g.mycol == p.a_owner) {
+        MPI_Datatype panel;
+        mpiw::check(MPI_Type_vector(lb.a_rows, p.w, lb.a_cols, MPI_INT, &panel), "MPI_Type_vector");
+        mpiw::check(MPI_Type_commit(&panel), "MPI_Type_commit");
+        mpiw::check(MPI_Ibcast(a.data, 1, panel, p.a_owner, g.row_comm, &r), "MPI_Ibcast");
+        MPI_Type_free(&panel);
+    } else {
+        mpiw::check(MPI_Ibcast(a.data, lb.a_rows * p.w, MPI_INT, p.a_owner, g.row_comm, &r), "MPI_Ibcast");
+    }
+    return r;
+}
+
+// Rows of C multiplied (and, with --gather, shipped to rank 0) as one unit
+const int strip_rows = 96;
+
+// Time spent waiting on communication and in the local multiply
+struct PhaseTimes {
+    double comm = 0.0;
+    double compute = 0.0;
+    double elapsed = 0.0; // Slowest rank, filled in by run_variant on rank 0
+};
+
+// Collects every C block on rank 0 with one message per strip of rows (--gather).
+// Rank 0 posts all receives up front, each into its place in C_flat through a
+// strided datatype, so strips can arrive in any order while others still compute.
+struct ResultGather {
+    std::vector<MPI_Request> requests;
+    std::vector<MPI_Datatype> types;
+    std::vector<int> C_flat;
+
+    void post_receives(const Options& opt, const Grid& g) {
+        int size;
+        MPI_Comm_size(MPI_COMM_WORLD, &size);
+        C_flat.assign((size_t)opt.N * opt.M, 0);
+        for (int r = 0; r < size; ++r) {
+            int coords[2];
+            MPI_Cart_coords(g.cart, r, 2, coords);
+            int rows = block_size(opt.N, g.Pr, coords[0]), row0 = block_start(opt.N, g.Pr, coords[0]);
+            int cols = block_size(opt.M, g.Pc, coords[1]), col0 = block_start(opt.M, g.Pc, coords[1]);
+            if (cols == 0) {
+                continue;
+            }
+            for (int s = 0; s * strip_rows < rows; ++s) {
+                MPI_Datatype strip;
+                mpiw::check(MPI_Type_vector(std::min(strip_rows, rows - s * strip_rows), cols, opt.M, MPI_INT, &strip),
+                            "MPI_Type_vector");
+                mpiw::check(MPI_Type_commit(&strip), "MPI_Type_commit");
+                types.push_back(strip);
+                requests.emplace_back();
+                mpiw::check(MPI_Irecv(&C_flat[(size_t)(row0 + s * strip_rows) * opt.M + col0], 1, strip, r, s,
+                                      g.cart, &requests.back()), "MPI_Irecv");
+            }
+        }
+    }
+
+    // Send the finished local rows [row0, row0 + rows); row0 must be a strip boundary
+    void send_rows(const Grid& g, const LocalBlocks& lb, int row0, int rows) {
+        if (lb.b_cols == 0) {
+            return;
+        }
+        for (int r = row0; r < row0 + rows; r += strip_rows) {
+            requests.emplace_back();
+            mpiw::check(MPI_Isend(&lb.C[(size_t)r * lb.b_cols], std::min(strip_rows, lb.a_rows - r) * lb.b_cols,
+                                  MPI_INT, 0, r / strip_rows, g.cart, &requests.back()), "MPI_Isend");
+        }
+    }
+
+    void finish() {
+        mpiw::check(MPI_Waitall((int)requests.size(), requests.data(), MPI_STATUSES_IGNORE), "MPI_Waitall");
+        for (MPI_Datatype& t : types) {
+            MPI_Type_free(&t);
+        }
+        requests.clear();
+        types.clear();
+    }
+};
+
+// Synchronous version: blocking broadcasts of every panel, each multiplied by the whole pool
+PhaseTimes summa_sync(const Options& opt, const Grid& g, LocalBlocks& lb, ThreadPool& pool, ResultGather* gather) {
+    PhaseTimes times;
+    std::vector<int> A_panel((size_t)lb.a_rows * opt.nb), B_panel((size_t)opt.nb * lb.b_cols);
+    std::fill(lb.C.begin(), lb.C.end(), 0);
+
+    for (const Panel& p : plan_panels(opt, g)) {
+        APanel a = locate_A_panel(g, lb, p, A_panel);
+        // Rows [k, k + w) of the local B block are already contiguous on the owner
+        int* B_src = g.myrow == p.b_owner ? &lb.B[(size_t)(p.k - lb.b_row0) * lb.b_cols] : B_panel.data();
+        double t = MPI_Wtime();
+        mpiw::Request(ibcast_A_panel(g, lb, p, a)).wait();
+        mpiw::bcast(B_src, p.w * lb.b_cols, p.b_owner, g.col_comm);
+        times.comm += MPI_Wtime() - t;
+
+        t = MPI_Wtime();
+        pool.parallel_for(0, lb.a_rows, strip_rows, [&](int lo, int hi) {
+            multiply_panel(hi - lo, lb.b_cols, p.w, a.data + (size_t)lo * a.ld, a.ld, B_src,
+                           &lb.C[(size_t)lo * lb.b_cols], lb.b_cols);
+        });
+        times.compute += MPI_Wtime() - t;
+    }
+
+    if (gather != nullptr) {
+        double t = MPI_Wtime();
+        gather->send_rows(g, lb, 0, lb.a_rows);
+        gather->finish();
+        times.comm += MPI_Wtime() - t;
+    }
+    return times;
+}
+
+// Asynchronous version: a double-buffered pipeline. The MPI_Ibcast of panel p + 1
+// is in flight while panel p is multiplied, in row strips spread over the pool.
+// Each panel's two broadcasts are one future (mpi_async.hpp); the main thread
+// drives the engine between its strips (or all the time, with --comm-thread) so
+// the broadcast keeps progressing. During the last panel each
+// finished strip of C is sent to rank 0 as soon as the strips before it are done
+// (--gather).
+PhaseTimes summa_async(const Options& opt, const Grid& g, LocalBlocks& lb, ThreadPool& pool, ResultGather* gather) {
+    PhaseTimes times;
+    std::vector<Panel> panels = plan_panels(opt, g);
+    std::vector<int> A_panel[2], B_panel[2];
+    APanel A_src[2];
+    int* B_src[2];
+    mpia::Engine engine;
+    mpia::Future<void> arrived[2];  // Both broadcasts of the panel in buffer b are complete
+    for (int b = 0; b < 2; ++b) {
+        A_panel[b].resize((size_t)lb.a_rows * opt.nb);
+        B_panel[b].resize((size_t)opt.nb * lb.b_cols);
+    }
+    std::fill(lb.C.begin(), lb.C.end(), 0);
+
+    // Start the broadcasts of panel p into buffer p % 2
+    auto post_panel = [&](size_t p) {
+        const Panel& pn = panels[p];
+        int b = p % 2;
+        A_src[b] = locate_A_panel(g, lb, pn, A_panel[b]);
+        B_src[b] = g.myrow == pn.b_owner ? &lb.B[(size_t)(pn.k - lb.b_row0) * lb.b_cols] : B_panel[b].data();
+        arrived[b] = mpia::when_all(std::vector<mpia::Future<MPI_Status>>{
+            engine.track(ibcast_A_panel(g, lb, pn, A_src[b])),
+            mpia::ibcast(engine, B_src[b], pn.w * lb.b_cols, pn.b_owner, g.col_comm)});
+    };
+
+    if (!panels.empty()) {
+        post_panel(0);
+    }
+    for (size_t p = 0; p < panels.size(); ++p) {
+        int b = p % 2;
+        bool prefetch = p + 1 < panels.size(), last = !prefetch;
+        if (prefetch) {
+            post_panel(p + 1);
+        }
+
+        // Only the part of the broadcast that the previous multiply did not cover is exposed here
+        double t = MPI_Wtime();
+        arrived[b].wait();
+        times.comm += MPI_Wtime() - t;
+
+        t = MPI_Wtime();
+        int w = panels[p].w, strips = (lb.a_rows + strip_rows - 1) / strip_rows, sent = 0;
+        std::unique_ptr<std::atomic<bool>[]> finished(new std::atomic<bool>[strips]());
+        auto multiply_rows = [&](int lo, int hi) {
+            multiply_panel(hi - lo, lb.b_cols, w, A_src[b].data + (size_t)lo * A_src[b].ld, A_src[b].ld, B_src[b],
+                           &lb.C[(size_t)lo * lb.b_cols], lb.b_cols);
+            finished[lo / strip_rows].store(true, std::memory_order_release);
+        };
+        // Runs on the main thread only
+        auto progress = [&] {
+            if (prefetch) {
+                engine.progress();
+            }
+            for (; last && gather != nullptr && sent < strips && finished[sent].load(std::memory_order_acquire); ++sent) {
+                gather->send_rows(g, lb, sent * strip_rows, std::min(strip_rows, lb.a_rows - sent * strip_rows));
+            }
+        };
+        pool.parallel_for(0, lb.a_rows, strip_rows, multiply_rows, progress, opt.comm_thread);
+        progress();
+        times.compute += MPI_Wtime() - t;
+    }
+
+    if (gather != nullptr) {
+        double t = MPI_Wtime();
+        if (panels.empty()) {
+            gather->send_rows(g, lb, 0, lb.a_rows);
+        }
+        gather->finish();
+        times.comm += MPI_Wtime() - t;
+    }
+    return times;
+}
+
+// Check a sample of local C entries against a dot product computed from the generator
+long long verify_result(const Options& opt, const LocalBlocks& lb) {
+    long long errors = 0;
+    int c_rows = lb.a_rows, c_cols = lb.b_cols;
+    int samples = std::min(c_rows * c_cols, 16);
+    for (int s = 0; s < samples; ++s) {
+        int i = (int)(((long long)s * 7919) % c_rows);
+        int j = (int)(((long long)s * 104729) % c_cols);
+        long long expected = 0;
+        for (int k = 0; k < opt.K; ++k) {
+            expected += (long long)matrix_value(opt.seed, lb.a_row0 + i, k) * matrix_value(opt.seed + 1, k, lb.b_col0 + j);
+        }
+        if (expected != lb.C[(size_t)i * c_cols + j]) {
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+// Check a sample of the gathered C_flat on rank 0
+long long verify_gathered(const Options& opt, const std::vector<int>& C_flat) {
+    long long errors = 0;
+    int samples = std::min(opt.N * opt.M, 16);
+    for (int s = 0; s < samples; ++s) {
+        int i = (int)(((long long)s * 7919) % opt.N);
+        int j = (int)(((long long)s * 104729) % opt.M);
+        long long expected = 0;
+        for (int k = 0; k < opt.K; ++k) {
+            expected += (long long)matrix_value(opt.seed, i, k) * matrix_value(opt.seed + 1, k, j);
+        }
+        if (expected != C_flat[(size_t)i * opt.M + j]) {
+            ++errors;
+        }
+    }
+    return errors;
+}
+
+// Run one variant and report its time (the slowest rank), throughput, average
+// per-rank communication and compute time, and the verification result
+PhaseTimes run_variant(const char* name, const Options& opt, const Grid& g, LocalBlocks& lb, ThreadPool& pool,
+                       PhaseTimes (*variant)(const Options&, const Grid&, LocalBlocks&, ThreadPool&, ResultGather*)) {
     int rank, size;
-    MPI_Init(&argc, &argv);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
+    ResultGather gather;
+
+    MPI_Barrier(MPI_COMM_WORLD); // Synchronize processes before starting the timer
+    double start_time = MPI_Wtime();
+    if (opt.gather && rank == 0) {
+        gather.post_receives(opt, g);
+    }
+    PhaseTimes times = variant(opt, g, lb, pool, opt.gather ? &gather : nullptr);
+    double elapsed = MPI_Wtime() - start_time, max_elapsed = 0.0;
+    mpiw::reduce(elapsed, max_elapsed, MPI_MAX, 0);
 
-    const int N = 5; // Rows of A
-    const int M = 10; // Columns of B
-    const int K = 5; // Columns of A and rows of B
+    PhaseTimes avg;
+    mpiw::reduce(times.comm, avg.comm, MPI_SUM, 0);
+    mpiw::reduce(times.compute, avg.compute, MPI_SUM, 0);
+    avg.comm /= size;
+    avg.compute /= size;
+    avg.elapsed = max_elapsed;
 
-    // Flattened matrices for communication
-    std::vector<int> A_flat(N * K);
-    std::vector<int> B_flat(K * M);
-    std::vector<int> C_flat(N * M, 0);
+    long long errors = 0, local_errors = opt.verify ? verify_result(opt, lb) : 0;
+    if (opt.verify && opt.gather && rank == 0) {
+        local_errors += verify_gathered(opt, gather.C_flat);
+    }
+    mpiw::reduce(local_errors, errors, MPI_SUM, 0);
 
-    // Fill matrices A and B with random values
     if (rank == 0) {
-        fill_matrix_with_random_values(A_flat, N * K);
-        fill_matrix_with_random_values(B_flat, K * M);
+        double flops = 2.0 * opt.N * opt.M * opt.K;
+        std::cout << name << " Matrix multiplication completed in " << max_elapsed << " seconds ("
+                  << flops / max_elapsed * 1e-9 << " GFLOP/s); per rank: communication " << avg.comm
+                  << " s, compute " << avg.compute << " s." << std::endl;
+        if (opt.verify) {
+            std::cout << name << " verification: " << (errors == 0 ? "passed" : "FAILED") << std::endl;
+        }
     }
+    return avg;
+}
 
-    MPI_Barrier(MPI_COMM_WORLD); // Synchronize processes before starting the timer
-    double start_time, end_time;
+// Row distribution for --shared: this rank owns rows [a_row0, a_row0 + a_rows)
+// of A and C and needs all of B. The rank (or node) that owns a block of rows of
+// B generates it; the others receive it.
 
-    // Synchronous version
+// C rows += A rows * B on the pool
+void multiply_rows(const Options& opt, LocalBlocks& lb, ThreadPool& pool, const int* B) {
+    std::fill(lb.C.begin(), lb.C.end(), 0);
+    pool.parallel_for(0, lb.a_rows, strip_rows, [&](int lo, int hi) {
+        multiply_panel(hi - lo, opt.M, opt.K, &lb.A[(size_t)lo * opt.K], opt.K, B, &lb.C[(size_t)lo * opt.M], opt.M);
+    });
+}
+
+// Every rank holds its own copy of B, assembled with MPI_Allgatherv over all ranks
+PhaseTimes rows_replicated_B(const Options& opt, const Grid&, LocalBlocks& lb, ThreadPool& pool, ResultGather*) {
+    PhaseTimes times;
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    std::vector<int> B((size_t)opt.K * opt.M), counts(size), displs(size);
+    for (int r = 0; r < size; ++r) {
+        counts[r] = block_size(opt.K, size, r) * opt.M;
+        displs[r] = block_start(opt.K, size, r) * opt.M;
+    }
+    fill_block_with_random_values(&B[displs[rank]], opt.seed + 1, block_start(opt.K, size, rank), 0,
+                                  block_size(opt.K, size, rank), opt.M);
+
+    double t = MPI_Wtime();
+    mpiw::check(MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, B.data(), counts.data(), displs.data(), MPI_INT,
+                               MPI_COMM_WORLD), "MPI_Allgatherv");
+    times.comm = MPI_Wtime() - t;
+
+    t = MPI_Wtime();
+    multiply_rows(opt, lb, pool, B.data());
+    times.compute = MPI_Wtime() - t;
+    return times;
+}
+
+// One copy of B per node in a shared window. Only node leaders take part in the
+// MPI_Allgatherv, each contributing the rows of B its node owns; the other ranks
+// wait at the node barrier and then read B in place. The window stays under
+// lock_all until free_node_shared_B.
+int* make_node_shared_B(const Options& opt, const Grid& g, MPI_Win& win) {
+    MPI_Aint bytes = g.node_rank == 0 ? (MPI_Aint)opt.K * opt.M * sizeof(int) : 0;
+    int* B = nullptr;
+    mpiw::check(MPI_Win_allocate_shared(bytes, sizeof(int), MPI_INFO_NULL, g.node_comm, &B, &win),
+                "MPI_Win_allocate_shared");
+    if (g.node_rank != 0) {
+        int disp_unit;
+        mpiw::check(MPI_Win_shared_query(win, 0, &bytes, &disp_unit, &B), "MPI_Win_shared_query");
+    }
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+
+    if (g.leader_comm != MPI_COMM_NULL) {
+        int node, nodes;
+        MPI_Comm_rank(g.leader_comm, &node);
+        MPI_Comm_size(g.leader_comm, &nodes);
+        std::vector<int> counts(nodes), displs(nodes);
+        for (int n = 0; n < nodes; ++n) {
+            counts[n] = block_size(opt.K, nodes, n) * opt.M;
+            displs[n] = block_start(opt.K, nodes, n) * opt.M;
+        }
+        fill_block_with_random_values(B + displs[node], opt.seed + 1, block_start(opt.K, nodes, node), 0,
+                                      block_size(opt.K, nodes, node), opt.M);
+        mpiw::check(MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, B, counts.data(), displs.data(), MPI_INT,
+                                   g.leader_comm), "MPI_Allgatherv");
+    }
+    // Make the leader's stores visible to the other ranks of the node
+    MPI_Win_sync(win);
+    MPI_Barrier(g.node_comm);
+    MPI_Win_sync(win);
+    return B;
+}
+
+void free_node_shared_B(MPI_Win& win) {
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+}
+
+PhaseTimes rows_node_shared_B(const Options& opt, const Grid& g, LocalBlocks& lb, ThreadPool& pool, ResultGather*) {
+    PhaseTimes times;
+    double t = MPI_Wtime();
+    MPI_Win win;
+    int* B = make_node_shared_B(opt, g, win);
+    times.comm = MPI_Wtime() - t;
+
+    t = MPI_Wtime();
+    multiply_rows(opt, lb, pool, B);
+    times.compute = MPI_Wtime() - t;
+
+    free_node_shared_B(win);
+    return times;
+}
+
+void run_shared_operand(const Options& opt, const Grid& g, ThreadPool& pool) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // A and C split by rows over all ranks, B whole; the C block is a_rows x b_cols as in SUMMA
+    LocalBlocks lb;
+    lb.a_rows = block_size(opt.N, size, rank);
+    lb.a_row0 = block_start(opt.N, size, rank);
+    lb.a_cols = lb.b_rows = opt.K;
+    lb.b_cols = opt.M;
+    lb.a_col0 = lb.b_row0 = lb.b_col0 = 0;
+    lb.A.resize((size_t)lb.a_rows * lb.a_cols);
+    lb.C.assign((size_t)lb.a_rows * lb.b_cols, 0);
+    fill_block_with_random_values(lb.A.data(), opt.seed, lb.a_row0, 0, lb.a_rows, lb.a_cols);
+
+    // Bytes of B held on a node and bytes of B it must receive from other nodes, per layout
+    long long b_bytes = (long long)opt.K * opt.M * sizeof(int), own_rows = block_size(opt.K, size, rank), node_rows = 0;
+    MPI_Reduce(&own_rows, &node_rows, 1, MPI_LONG_LONG, MPI_SUM, 0, g.node_comm);
+    long long node_stats[4] = {0, 0, 0, 0}, max_stats[4] = {0, 0, 0, 0}; // replicated, shared: memory, received
+    int nodes = 0;
+    if (g.leader_comm != MPI_COMM_NULL) {
+        int node;
+        MPI_Comm_rank(g.leader_comm, &node);
+        MPI_Comm_size(g.leader_comm, &nodes);
+        node_stats[0] = g.node_size * b_bytes;
+        node_stats[1] = g.node_size * (opt.K - node_rows) * opt.M * (long long)sizeof(int);
+        node_stats[2] = b_bytes;
+        node_stats[3] = (opt.K - block_size(opt.K, nodes, node)) * opt.M * (long long)sizeof(int);
+        MPI_Reduce(node_stats, max_stats, 4, MPI_LONG_LONG, MPI_MAX, 0, g.leader_comm);
+    }
     if (rank == 0) {
-        start_time = MPI_Wtime();
+        std::cout << "C(" << opt.N << "x" << opt.M << ") = A(" << opt.N << "x" << opt.K << ") * B(" << opt.K << "x" << opt.M
+                  << ") by rows over " << size << " ranks on " << nodes << " nodes x " << opt.threads << " threads, "
+                  << gemm::isa_name(gemm::best_isa()) << " kernel" << std::endl;
     }
 
-    // Scatter matrix A and B for multiplication
-    std::vector<int> local_A(K), local_C(M);
-    checkMPIError(MPI_Scatter(A_flat.data(), K, MPI_INT, local_A.data(), K, MPI_INT, 0, MPI_COMM_WORLD));
-    checkMPIError(MPI_Bcast(B_flat.data(), K * M, MPI_INT, 0, MPI_COMM_WORLD));
+    Options row_opt = opt;
+    row_opt.gather = false; // The strip gather is laid out for the SUMMA grid
+    run_variant("Replicated-B", row_opt, g, lb, pool, rows_replicated_B);
+    run_variant("Node-shared-B", row_opt, g, lb, pool, rows_node_shared_B);
+
+    if (rank == 0) {
+        std::cout << "B per node (busiest node): replicated " << max_stats[0] << " bytes held, " << max_stats[1]
+                  << " bytes received from other nodes; node-shared " << max_stats[2] << " bytes held, " << max_stats[3]
+                  << " bytes received from other nodes." << std::endl;
+    }
+}
+
+// Dynamic tile scheduling (--schedule): C is cut into tiles of opt.tile rows and
+// the tiles are handed out while the multiply runs, so a slow or busy rank simply
+// takes fewer of them. A is split by rows over the ranks as in --shared, each
+// rank's rows exposed in an MPI_Win_create window, and a rank fetches the rows of
+// every tile it takes from their owners with MPI_Get under a lock_all epoch: the
+// further a schedule hands tiles away from their owners, the more of A travels.
+// Fetching is timed apart from computing. Every tile needs all of B, which is
+// set up before timing as one copy per node (see --shared). With --gather the
+// finished tiles travel to rank 0 as well.
+//
+//   static   rank r computes the r-th contiguous block of tiles (the baseline)
+//   master   rank 0 hands out tile ranges in reply to work requests that it
+//            picks up with MPI_Irecv between its own tiles; workers ask for the
+//            next range before computing the current one
+//   counter  no master: ranks claim ranges from a counter on rank 0 with
+//            MPI_Compare_and_swap under a passive-target lock_all epoch
+//
+// Ranges are guided by default: a claim takes ceil(remaining / (2 P)) tiles, so
+// early claims are large and the last ones small enough to even out the finish
+// (--chunk C fixes the size instead).
+
+const int tag_work_request = 1, tag_work_assign = 2;
 
-    // Matrix multiplication for each process
-    for (int i = 0; i < M; ++i) {
-        local_C[i] = 0;
-        for (int j = 0; j < K; ++j) {
-            local_C[i] += local_A[j] * B_flat[j * M + i];  // Access flattened B_flat matrix
+// Tiles a claim takes when `remaining` tiles are left
+int claim_size(const Options& opt, int remaining, int size) {
+    if (opt.chunk > 0) {
+        return std::min(opt.chunk, remaining);
+    }
+    return std::max(1, (remaining + 2 * size - 1) / (2 * size));
+}
+
+// Per-rank state of one scheduled run
+struct TileRun {
+    int tiles = 0;                       // Tiles in C
+    int rank = 0, ranks = 1;             // In MPI_COMM_WORLD, over which A is split by rows
+    const int* B = nullptr;              // All of B, shared by the node
+    std::vector<int> A_rows;             // This rank's rows of A, exposed in A_win
+    MPI_Win A_win = MPI_WIN_NULL;
+    std::vector<int> A_tile;             // Rows of A for the tile being computed
+    std::vector<std::pair<int, std::vector<int>>> results;  // (tile, its rows of C)
+    std::vector<MPI_Request> requests;   // Tiles in flight to rank 0 (--gather)
+    double busy = 0.0;                   // Seconds computing
+    double fetch = 0.0;                  // Seconds fetching rows of A
+    long long fetched = 0;               // Bytes of A fetched from other ranks
+    double slow_factor = 1.0;            // --slow: this rank works slow_factor times longer
+};
+
+// Rows [row0, row0 + rows) of A into run.A_tile, from whichever ranks own them
+void fetch_A_rows(const Options& opt, TileRun& run, int row0, int rows) {
+    for (int row = row0; row < row0 + rows;) {
+        int owner = block_owner(opt.N, run.ranks, row), owner_row0 = block_start(opt.N, run.ranks, owner);
+        int end = std::min(row0 + rows, owner_row0 + block_size(opt.N, run.ranks, owner)), n = (end - row) * opt.K;
+        int* to = &run.A_tile[(size_t)(row - row0) * opt.K];
+        if (owner == run.rank) {
+            std::copy_n(&run.A_rows[(size_t)(row - owner_row0) * opt.K], n, to);
+        } else {
+            mpiw::check(MPI_Get(to, n, MPI_INT, owner, (MPI_Aint)(row - owner_row0) * opt.K, n, MPI_INT, run.A_win),
+                        "MPI_Get");
+            run.fetched += (long long)n * sizeof(int);
+        }
+        row = end;
+    }
+    mpiw::check(MPI_Win_flush_all(run.A_win), "MPI_Win_flush_all");
+}
+
+void compute_tiles(const Options& opt, TileRun& run, ThreadPool& pool, int first, int count) {
+    for (int t = first; t < first + count; ++t) {
+        double fetch_start = MPI_Wtime();
+        int row0 = t * opt.tile, rows = std::min(opt.tile, opt.N - row0);
+        fetch_A_rows(opt, run, row0, rows);
+        double start = MPI_Wtime();
+        run.fetch += start - fetch_start;
+        std::vector<int> C((size_t)rows * opt.M, 0);
+        pool.parallel_for(0, rows, 8, [&](int lo, int hi) {
+            multiply_panel(hi - lo, opt.M, opt.K, &run.A_tile[(size_t)lo * opt.K], opt.K, run.B, &C[(size_t)lo * opt.M],
+                           opt.M);
+        });
+        if (run.slow_factor > 1.0) {
+            double target = MPI_Wtime() + (run.slow_factor - 1.0) * (MPI_Wtime() - start);
+            while (MPI_Wtime() < target) {
+            }
+        }
+        run.results.emplace_back(t, std::move(C));
+        if (opt.gather) {
+            run.requests.emplace_back();
+            mpiw::check(MPI_Isend(run.results.back().second.data(), rows * opt.M, MPI_INT, 0, t, MPI_COMM_WORLD,
+                                  &run.requests.back()), "MPI_Isend");
+        }
+        run.busy += MPI_Wtime() - start;
+    }
+}
+
+void schedule_static(const Options& opt, TileRun& run, ThreadPool& pool, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    compute_tiles(opt, run, pool, block_start(run.tiles, size, rank), block_size(run.tiles, size, rank));
+}
+
+void schedule_master(const Options& opt, TileRun& run, ThreadPool& pool, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    if (rank != 0) {
+        // Keep one request ahead: ask for the next range, then compute the current one
+        int range[2];
+        mpiw::check(MPI_Send(nullptr, 0, MPI_INT, 0, tag_work_request, comm), "MPI_Send");
+        mpiw::check(MPI_Recv(range, 2, MPI_INT, 0, tag_work_assign, comm, MPI_STATUS_IGNORE), "MPI_Recv");
+        while (range[1] > 0) {
+            int next[2];
+            MPI_Request requests[2];
+            mpiw::check(MPI_Irecv(next, 2, MPI_INT, 0, tag_work_assign, comm, &requests[0]), "MPI_Irecv");
+            mpiw::check(MPI_Isend(nullptr, 0, MPI_INT, 0, tag_work_request, comm, &requests[1]), "MPI_Isend");
+            compute_tiles(opt, run, pool, range[0], range[1]);
+            mpiw::check(MPI_Waitall(2, requests, MPI_STATUSES_IGNORE), "MPI_Waitall");
+            range[0] = next[0];
+            range[1] = next[1];
         }
+        return;
     }
 
-    // Gather the results back to process 0
-    checkMPIError(MPI_Gather(local_C.data(), M, MPI_INT, C_flat.data(), M, MPI_INT, 0, MPI_COMM_WORLD));
+    // Rank 0 serves requests between its own tiles; a worker is finished once it got an empty range
+    int next_tile = 0, finished_workers = 0;
+    MPI_Request request;
+    MPI_Status status;
+    auto claim = [&](int range[2]) {
+        range[0] = next_tile;
+        range[1] = next_tile < run.tiles ? claim_size(opt, run.tiles - next_tile, size) : 0;
+        next_tile += range[1];
+    };
+    auto reply = [&] {
+        int range[2];
+        claim(range);
+        finished_workers += range[1] == 0;
+        mpiw::check(MPI_Send(range, 2, MPI_INT, status.MPI_SOURCE, tag_work_assign, comm), "MPI_Send");
+        if (finished_workers < size - 1) {
+            mpiw::check(MPI_Irecv(nullptr, 0, MPI_INT, MPI_ANY_SOURCE, tag_work_request, comm, &request), "MPI_Irecv");
+        }
+    };
+    if (size > 1) {
+        mpiw::check(MPI_Irecv(nullptr, 0, MPI_INT, MPI_ANY_SOURCE, tag_work_request, comm, &request), "MPI_Irecv");
+    }
+    for (;;) {
+        int range[2];
+        claim(range);
+        if (range[1] == 0) {
+            break;
+        }
+        // One tile at a time, answering the requests that came in meanwhile
+        for (int t = range[0]; t < range[0] + range[1]; ++t) {
+            int flag = 1;
+            while (finished_workers < size - 1 && flag) {
+                mpiw::check(MPI_Test(&request, &flag, &status), "MPI_Test");
+                if (flag) {
+                    reply();
+                }
+            }
+            compute_tiles(opt, run, pool, t, 1);
+        }
+    }
+    while (finished_workers < size - 1) {
+        mpiw::check(MPI_Wait(&request, &status), "MPI_Wait");
+        reply();
+    }
+}
 
+void schedule_counter(const Options& opt, TileRun& run, ThreadPool& pool, MPI_Comm comm) {
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    int* counter;
+    MPI_Win win;
+    mpiw::check(MPI_Win_allocate(rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL, comm, &counter, &win),
+                "MPI_Win_allocate");
     if (rank == 0) {
-        end_time = MPI_Wtime();
-        std::cout << "Synchronous Matrix multiplication completed in " << (end_time - start_time) << " seconds." << std::endl;
+        *counter = 0;
     }
+    MPI_Barrier(comm);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
 
-    // Asynchronous version
-    MPI_Request send_request, recv_request;
-    MPI_Status send_status, recv_status;
+    int seen = 0;
+    MPI_Fetch_and_op(nullptr, &seen, MPI_INT, 0, 0, MPI_NO_OP, win);
+    MPI_Win_flush(0, win);
+    while (seen < run.tiles) {
+        // Claim [seen, seen + n) if nobody moved the counter since it was read
+        int n = claim_size(opt, run.tiles - seen, size), wanted = seen + n, found;
+        MPI_Compare_and_swap(&wanted, &seen, &found, MPI_INT, 0, 0, win);
+        MPI_Win_flush(0, win);
+        if (found == seen) {
+            compute_tiles(opt, run, pool, seen, n);
+            seen = wanted;
+        } else {
+            seen = found;
+        }
+    }
+
+    MPI_Win_unlock_all(win);
+    MPI_Win_free(&win);
+}
+
+// Check a sample of every computed tile against the generator
+long long verify_tiles(const Options& opt, const TileRun& run) {
+    long long errors = 0;
+    for (const auto& result : run.results) {
+        int row0 = result.first * opt.tile, rows = (int)(result.second.size() / std::max(opt.M, 1));
+        for (int s = 0; s < std::min(rows * opt.M, 4); ++s) {
+            int i = (int)(((long long)s * 7919) % rows), j = (int)(((long long)s * 104729) % opt.M);
+            long long expected = 0;
+            for (int k = 0; k < opt.K; ++k) {
+                expected += (long long)matrix_value(opt.seed, row0 + i, k) * matrix_value(opt.seed + 1, k, j);
+            }
+            errors += expected != result.second[(size_t)i * opt.M + j];
+        }
+    }
+    return errors;
+}
+
+void run_schedule(const char* name, const Options& opt, const Grid& g, ThreadPool& pool,
+                  void (*schedule)(const Options&, TileRun&, ThreadPool&, MPI_Comm)) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    MPI_Comm comm; // Scheduling traffic stays apart from the result tiles
+    MPI_Comm_dup(MPI_COMM_WORLD, &comm);
+
+    // Inputs, outside the timed run: this rank's rows of A in a window, B once per node
+    TileRun run;
+    run.tiles = (opt.N + opt.tile - 1) / opt.tile;
+    run.rank = rank;
+    run.ranks = size;
+    int my_rows = block_size(opt.N, size, rank);
+    run.A_rows.resize((size_t)my_rows * opt.K);
+    fill_block_with_random_values(run.A_rows.data(), opt.seed, block_start(opt.N, size, rank), 0, my_rows, opt.K);
+    mpiw::check(MPI_Win_create(run.A_rows.data(), (MPI_Aint)run.A_rows.size() * sizeof(int), sizeof(int), MPI_INFO_NULL,
+                               MPI_COMM_WORLD, &run.A_win), "MPI_Win_create");
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, run.A_win);
+    run.A_tile.resize((size_t)opt.tile * opt.K);
+    double b_start = MPI_Wtime();
+    MPI_Win B_win;
+    run.B = make_node_shared_B(opt, g, B_win);
+    double b_setup = MPI_Wtime() - b_start, max_b_setup = 0.0;
+    mpiw::reduce(b_setup, max_b_setup, MPI_MAX, 0);
+    if (rank == opt.slow_rank) {
+        run.slow_factor = opt.slow_factor;
+    }
+
+    // Rank 0 posts a receive for every tile; any rank may send it
+    std::vector<int> C_flat;
+    std::vector<MPI_Request> receives;
+    if (opt.gather && rank == 0) {
+        C_flat.resize((size_t)opt.N * opt.M);
+        receives.resize(run.tiles);
+        for (int t = 0; t < run.tiles; ++t) {
+            int rows = std::min(opt.tile, opt.N - t * opt.tile);
+            mpiw::check(MPI_Irecv(&C_flat[(size_t)t * opt.tile * opt.M], rows * opt.M, MPI_INT, MPI_ANY_SOURCE, t,
+                                  MPI_COMM_WORLD, &receives[t]), "MPI_Irecv");
+        }
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    schedule(opt, run, pool, comm);
+    double finish = MPI_Wtime() - start; // When this rank ran out of work
+    mpiw::check(MPI_Waitall((int)run.requests.size(), run.requests.data(), MPI_STATUSES_IGNORE), "MPI_Waitall");
+    mpiw::check(MPI_Waitall((int)receives.size(), receives.data(), MPI_STATUSES_IGNORE), "MPI_Waitall");
+    double elapsed = MPI_Wtime() - start;
+
+    // Utilization: share of the whole run this rank spent computing tiles
+    double max_elapsed = 0.0, first_finish = 0.0, last_finish = 0.0;
+    mpiw::allreduce(elapsed, max_elapsed, MPI_MAX);
+    mpiw::reduce(finish, first_finish, MPI_MIN, 0);
+    mpiw::reduce(finish, last_finish, MPI_MAX, 0);
+    double utilization = max_elapsed > 0.0 ? run.busy / max_elapsed : 1.0;
+    int my_tiles = (int)run.results.size();
+    std::vector<double> utilizations(size);
+    std::vector<int> tiles(size);
+    mpiw::gather(&utilization, utilizations.data(), 1, 0);
+    mpiw::gather(&my_tiles, tiles.data(), 1, 0);
+    double fetch = 0.0;
+    long long fetched = 0;
+    mpiw::reduce(run.fetch, fetch, MPI_SUM, 0);
+    mpiw::reduce(run.fetched, fetched, MPI_SUM, 0);
+
+    long long errors = 0, local_errors = opt.verify ? verify_tiles(opt, run) : 0;
+    if (opt.verify && opt.gather && rank == 0) {
+        local_errors += verify_gathered(opt, C_flat);
+    }
+    mpiw::reduce(local_errors, errors, MPI_SUM, 0);
+
+    if (rank == 0) {
+        double flops = 2.0 * opt.N * opt.M * opt.K;
+        std::cout << name << " schedule completed in " << max_elapsed << " seconds (" << flops / max_elapsed * 1e-9
+                  << " GFLOP/s); tail (last minus first rank out of work) " << last_finish - first_finish << " s."
+                  << std::endl;
+        std::cout << name << " per-rank utilization (tiles):";
+        for (int r = 0; r < size; ++r) {
+            std::printf(" %.0f%% (%d)", 100.0 * utilizations[r], tiles[r]);
+        }
+        std::cout << std::endl;
+        std::cout << name << " inputs: " << fetched / size << " bytes of A fetched from other ranks in " << fetch / size
+                  << " s per rank; B assembled once per node in " << max_b_setup << " s before timing." << std::endl;
+        if (opt.verify) {
+            std::cout << name << " verification: " << (errors == 0 ? "passed" : "FAILED") << std::endl;
+        }
+    }
+    free_node_shared_B(B_win);
+    MPI_Win_unlock_all(run.A_win);
+    MPI_Win_free(&run.A_win);
+    MPI_Comm_free(&comm);
+}
+
+void run_tiled(const Options& opt, const Grid& g, ThreadPool& pool) {
+    int rank, flag, *tag_ub;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_get_attr(MPI_COMM_WORLD, MPI_TAG_UB, &tag_ub, &flag);
+    if (opt.gather && (opt.N + opt.tile - 1) / opt.tile > *tag_ub) {
+        if (rank == 0) {
+            std::cerr << "Too many tiles to tag each one for --gather; use a larger --tile" << std::endl;
+        }
+        return;
+    }
+    if (rank == 0) {
+        std::cout << "C(" << opt.N << "x" << opt.M << ") = A(" << opt.N << "x" << opt.K << ") * B(" << opt.K << "x" << opt.M
+                  << ") in " << (opt.N + opt.tile - 1) / opt.tile << " tiles of " << opt.tile << " rows, "
+                  << (opt.chunk > 0 ? "fixed" : "guided") << " claims";
+        if (opt.slow_rank >= 0) {
+            std::cout << ", rank " << opt.slow_rank << " " << opt.slow_factor << "x slower";
+        }
+        std::cout << std::endl;
+    }
+    if (opt.schedule == "all" || opt.schedule == "static") {
+        run_schedule("Static", opt, g, pool, schedule_static);
+    }
+    if (opt.schedule == "all" || opt.schedule == "master") {
+        run_schedule("Master", opt, g, pool, schedule_master);
+    }
+    if (opt.schedule == "all" || opt.schedule == "counter") {
+        run_schedule("Counter", opt, g, pool, schedule_counter);
+    }
+}
+
+void free_grid(Grid& g) {
+    if (g.leader_comm != MPI_COMM_NULL) {
+        MPI_Comm_free(&g.leader_comm);
+    }
+    MPI_Comm_free(&g.node_comm);
+    MPI_Comm_free(&g.row_comm);
+    MPI_Comm_free(&g.col_comm);
+    MPI_Comm_free(&g.cart);
+}
+
+// Peak resident set size of this process in bytes (VmHWM), 0 where /proc is not available.
+// Unlike the matrix buffers counted above it includes the MPI library's own buffers.
+long long peak_resident_bytes() {
+    long long kb = 0;
+    FILE* f = std::fopen("/proc/self/status", "r");
+    if (f != nullptr) {
+        char line[256];
+        while (std::fgets(line, sizeof(line), f) != nullptr) {
+            if (std::sscanf(line, "VmHWM: %lld kB", &kb) == 1) {
+                break;
+            }
+        }
+        std::fclose(f);
+    }
+    return kb * 1024;
+}
+
+// Matrix files (--load, --store)
+
+std::string matrix_path(const std::string& prefix, const char* name) {
+    return prefix + "_" + name + ".bin";
+}
+
+// Set N, K and M from the headers of the --load files; false (reported on rank 0) if they cannot be used
+bool load_dimensions(Options& opt) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    std::string a_path = matrix_path(opt.load, "A"), b_path = matrix_path(opt.load, "B"), error;
+    matio::Header a, b;
+    if (!matio::read_header(a_path.c_str(), MPI_COMM_WORLD, a, error)) {
+        error = a_path + ": " + error;
+    } else if (!matio::read_header(b_path.c_str(), MPI_COMM_WORLD, b, error)) {
+        error = b_path + ": " + error;
+    } else if (a.dtype != matio::dtype_code<int>::value || b.dtype != matio::dtype_code<int>::value) {
+        error = "A and B must hold int32 elements";
+    } else if (a.cols != b.rows) {
+        error = "A is " + std::to_string(a.rows) + "x" + std::to_string(a.cols) + " but B is "
+                + std::to_string(b.rows) + "x" + std::to_string(b.cols);
+    } else {
+        opt.N = (int)a.rows;
+        opt.K = (int)a.cols;
+        opt.M = (int)b.cols;
+        return true;
+    }
+    if (rank == 0) {
+        std::cerr << "Cannot load " << opt.load << ": " << error << std::endl;
+    }
+    return false;
+}
+
+// Report the time of the slowest rank for moving `bytes` in total
+void report_io(const char* what, const std::string& prefix, double seconds, double bytes) {
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    double max_seconds = 0.0;
+    mpiw::reduce(seconds, max_seconds, MPI_MAX, 0);
+    if (rank == 0) {
+        std::cout << what << " " << prefix << "_*.bin: " << bytes << " bytes in " << max_seconds << " seconds ("
+                  << (max_seconds > 0.0 ? bytes / max_seconds * 1e-9 : 0.0) << " GB/s)." << std::endl;
+    }
+}
+
+// Read this rank's blocks of A and B (--load), or generate them and, with --store, write them out
+void load_inputs(const Options& opt, LocalBlocks& lb) {
+    double bytes = ((double)opt.N * opt.K + (double)opt.K * opt.M) * sizeof(int);
+    if (!opt.load.empty()) {
+        double t = MPI_Wtime();
+        matio::read_block(matrix_path(opt.load, "A").c_str(), MPI_COMM_WORLD, lb.a_row0, lb.a_col0, lb.a_rows,
+                          lb.a_cols, lb.A.data());
+        matio::read_block(matrix_path(opt.load, "B").c_str(), MPI_COMM_WORLD, lb.b_row0, lb.b_col0, lb.b_rows,
+                          lb.b_cols, lb.B.data());
+        report_io("Read A and B from", opt.load, MPI_Wtime() - t, bytes);
+        return;
+    }
+    fill_block_with_random_values(lb.A.data(), opt.seed, lb.a_row0, lb.a_col0, lb.a_rows, lb.a_cols);
+    fill_block_with_random_values(lb.B.data(), opt.seed + 1, lb.b_row0, lb.b_col0, lb.b_rows, lb.b_cols);
+    if (!opt.store.empty()) {
+        double t = MPI_Wtime();
+        matio::write_block(matrix_path(opt.store, "A").c_str(), MPI_COMM_WORLD, opt.N, opt.K, lb.a_row0, lb.a_col0,
+                           lb.a_rows, lb.a_cols, lb.A.data());
+        matio::write_block(matrix_path(opt.store, "B").c_str(), MPI_COMM_WORLD, opt.K, opt.M, lb.b_row0, lb.b_col0,
+                           lb.b_rows, lb.b_cols, lb.B.data());
+        report_io("Wrote A and B to", opt.store, MPI_Wtime() - t, bytes);
+    }
+}
+
+// Write every rank's block of C to PREFIX_C.bin (--store)
+void store_result(const Options& opt, const LocalBlocks& lb) {
+    double t = MPI_Wtime();
+    matio::write_block(matrix_path(opt.store, "C").c_str(), MPI_COMM_WORLD, opt.N, opt.M, lb.a_row0, lb.b_col0,
+                       lb.a_rows, lb.b_cols, lb.C.data());
+    report_io("Wrote C to", opt.store, MPI_Wtime() - t, (double)opt.N * opt.M * sizeof(int));
+}
+
+int main(int argc, char** argv) {
+    int rank, size, provided;
+    // Worker threads never call MPI, so FUNNELED is enough for the hybrid mode
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Options opt;
+    if (!parse_options(argc, argv, opt)) {
+        if (rank == 0) {
+            std::cerr << "Usage: " << argv[0] << " [--n N] [--m M] [--k K] [--grid PrxPc] [--nb panel] [--seed S] [--verify] [--gather]"
+                      << " [--threads T] [--comm-thread] [--shared] [--ppn P]"
+                      << " [--schedule static|master|counter|all] [--tile rows] [--chunk tiles] [--slow R:F]"
+                      << " [--load PREFIX] [--store PREFIX] (--load and --store only without --shared and --schedule)"
+                      << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (opt.threads > 1 && provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) {
+            std::cerr << "The MPI library does not support MPI_THREAD_FUNNELED, needed by --threads" << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (!opt.load.empty() && !load_dimensions(opt)) {
+        MPI_Finalize();
+        return 1;
+    }
+    ThreadPool pool(opt.threads);
+
+    // Build the Pr x Pc process grid
+    int dims[2] = {opt.Pr, opt.Pc}, periods[2] = {0, 0};
+    if (opt.Pr * opt.Pc != 0 && opt.Pr * opt.Pc != size) {
+        if (rank == 0) {
+            std::cerr << "Grid " << opt.Pr << "x" << opt.Pc << " does not match " << size << " processes" << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    mpiw::check(MPI_Dims_create(size, 2, dims), "MPI_Dims_create");
 
-    // Scatter matrix A and B for multiplication asynchronously
-    checkMPIError(MPI_Iscatter(A_flat.data(), K, MPI_INT, local_A.data(), K, MPI_INT, 0, MPI_COMM_WORLD, &recv_request));
-    checkMPIError(MPI_Ibcast(B_flat.data(), K * M, MPI_INT, 0, MPI_COMM_WORLD, &send_request));
+    Grid g;
+    g.Pr = dims[0];
+    g.Pc = dims[1];
+    mpiw::check(MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &g.cart), "MPI_Cart_create");
+    int cart_rank, coords[2];
+    MPI_Comm_rank(g.cart, &cart_rank);
+    MPI_Cart_coords(g.cart, cart_rank, 2, coords);
+    g.myrow = coords[0];
+    g.mycol = coords[1];
+    int keep_cols[2] = {0, 1}, keep_rows[2] = {1, 0};
+    mpiw::check(MPI_Cart_sub(g.cart, keep_cols, &g.row_comm), "MPI_Cart_sub");  // Ranks in my grid row, ordered by column
+    mpiw::check(MPI_Cart_sub(g.cart, keep_rows, &g.col_comm), "MPI_Cart_sub");  // Ranks in my grid column, ordered by row
 
-    // Wait for scatter and broadcast to complete
-    checkMPIError(MPI_Wait(&recv_request, &recv_status));
-    checkMPIError(MPI_Wait(&send_request, &send_status));
+    // Ranks of this node, and one leader per node
+    if (opt.ppn > 0) {
+        mpiw::check(MPI_Comm_split(MPI_COMM_WORLD, rank / opt.ppn, rank, &g.node_comm), "MPI_Comm_split");
+    } else {
+        mpiw::check(MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &g.node_comm),
+                    "MPI_Comm_split_type");
+    }
+    MPI_Comm_rank(g.node_comm, &g.node_rank);
+    MPI_Comm_size(g.node_comm, &g.node_size);
+    mpiw::check(MPI_Comm_split(MPI_COMM_WORLD, g.node_rank == 0 ? 0 : MPI_UNDEFINED, rank, &g.leader_comm),
+                "MPI_Comm_split");
 
-    // Matrix multiplication for each process
-    for (int i = 0; i < M; ++i) {
-        local_C[i] = 0;
-        for (int j = 0; j < K; ++j) {
-            local_C[i] += local_A[j] * B_flat[j * M + i];  // Access flattened B_flat matrix
+    if (opt.shared || !opt.schedule.empty()) {
+        if (opt.shared) {
+            run_shared_operand(opt, g, pool);
+        } else {
+            run_tiled(opt, g, pool);
         }
+        free_grid(g);
+        MPI_Finalize();
+        return 0;
+    }
+
+    // Local blocks of A (rows split over Pr, K over Pc) and B (K over Pr, columns over Pc)
+    LocalBlocks lb;
+    lb.a_rows = block_size(opt.N, g.Pr, g.myrow);
+    lb.a_row0 = block_start(opt.N, g.Pr, g.myrow);
+    lb.a_cols = block_size(opt.K, g.Pc, g.mycol);
+    lb.a_col0 = block_start(opt.K, g.Pc, g.mycol);
+    lb.b_rows = block_size(opt.K, g.Pr, g.myrow);
+    lb.b_row0 = block_start(opt.K, g.Pr, g.myrow);
+    lb.b_cols = block_size(opt.M, g.Pc, g.mycol);
+    lb.b_col0 = block_start(opt.M, g.Pc, g.mycol);
+    lb.A.resize((size_t)lb.a_rows * lb.a_cols);
+    lb.B.resize((size_t)lb.b_rows * lb.b_cols);
+    lb.C.assign((size_t)lb.a_rows * lb.b_cols, 0);
+
+    // Fill matrices A and B with random values, or read them
+    load_inputs(opt, lb);
+
+    long long local_bytes = (long long)(lb.A.size() + lb.B.size() + lb.C.size()
+                                        + (size_t)opt.nb * (lb.a_rows + lb.b_cols)) * sizeof(int);
+    long long max_bytes = 0, total_bytes = 0;
+    mpiw::reduce(local_bytes, max_bytes, MPI_MAX, 0);
+    mpiw::reduce(local_bytes, total_bytes, MPI_SUM, 0);
+    if (rank == 0) {
+        std::cout << "C(" << opt.N << "x" << opt.M << ") = A(" << opt.N << "x" << opt.K << ") * B(" << opt.K << "x" << opt.M
+                  << ") on a " << g.Pr << "x" << g.Pc << " grid x " << opt.threads << " threads"
+                  << (opt.comm_thread ? " (1 driving communication)" : "") << ", panel width " << opt.nb
+                  << ", matrix memory max per rank " << max_bytes << " bytes, total " << total_bytes << " bytes, "
+                  << gemm::isa_name(gemm::best_isa()) << " kernel" << std::endl;
     }
 
-    // Gather the results back to process 0
-    checkMPIError(MPI_Igather(local_C.data(), M, MPI_INT, C_flat.data(), M, MPI_INT, 0, MPI_COMM_WORLD, &recv_request));
-    checkMPIError(MPI_Wait(&recv_request, &recv_status));
+    // One untimed run of each version first: connection setup and the first touch
+    // of the panel buffers would otherwise all land on whichever is timed first
+    summa_sync(opt, g, lb, pool, nullptr);
+    summa_async(opt, g, lb, pool, nullptr);
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // Synchronous version
+    PhaseTimes sync_times = run_variant("Synchronous", opt, g, lb, pool, summa_sync);
+
+    // Asynchronous version
+    PhaseTimes async_times = run_variant("Asynchronous", opt, g, lb, pool, summa_async);
+
+    // Communication the pipeline overlapped with computation: the wall time it
+    // saved over the blocking version, at most all of that version's communication.
+    // Not the difference of the comm times: the pipeline's waits for slow ranks
+    // move into its compute time without making it any faster
+    if (rank == 0) {
+        double hidden = std::min(sync_times.comm, std::max(0.0, sync_times.elapsed - async_times.elapsed));
+        std::cout << "Communication hidden by the pipeline: " << hidden << " s of " << sync_times.comm << " s ("
+                  << (sync_times.comm > 0.0 ? 100.0 * hidden / sync_times.comm : 0.0) << "%)." << std::endl;
+    }
+    if (!opt.store.empty()) {
+        store_result(opt, lb);
+    }
 
+    // Whole-process footprint of this ranks x threads layout
+    long long rss = peak_resident_bytes(), max_rss = 0, total_rss = 0, steals = pool.steals(), total_steals = 0;
+    mpiw::reduce(rss, max_rss, MPI_MAX, 0);
+    mpiw::reduce(rss, total_rss, MPI_SUM, 0);
+    mpiw::reduce(steals, total_steals, MPI_SUM, 0);
     if (rank == 0) {
-        end_time = MPI_Wtime();
-        std::cout << "Asynchronous Matrix multiplication completed in " << (end_time - start_time) << " seconds." << std::endl;
+        std::cout << "Layout " << size << " ranks x " << opt.threads << " threads: peak resident memory max per rank "
+                  << max_rss / (1 << 20) << " MiB, total " << total_rss / (1 << 20) << " MiB; " << total_steals
+                  << " strips stolen." << std::endl;
     }
 
+    free_grid(g);
     MPI_Finalize();
     return 0;
 }
@@ -0,0 +1,108 @@
+#include <mpi.h>
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cmath>
+#include <type_traits>
+#include "gemm_kernel.hpp"
+
+// Single-rank GFLOP/s benchmark of the local multiply used by e8_matops: the
+// original loop (column-wise walk of B) against the blocked kernel for every
+// instruction set this CPU supports, for int, float and double.
+//
+// Usage: mpirun -np 1 ./e8b [size ...]   (default sizes 128 256 512 1024)
+
+// The loop e8_matops used before the blocked kernel
+template <typename T>
+void naive_multiply(int m, int n, int k, const T* A, const T* B, T* C) {
+    for (int r = 0; r < m; ++r) {
+        for (int i = 0; i < n; ++i) {
+            C[(size_t)r * n + i] = 0;
+            for (int j = 0; j < k; ++j) {
+                C[(size_t)r * n + i] += A[(size_t)r * k + j] * B[(size_t)j * n + i];  // Access flattened B matrix
+            }
+        }
+    }
+}
+
+// Repeat fn until at least min_time has passed and return the best single run
+template <typename Fn>
+double best_time(Fn&& fn, double min_time = 0.2) {
+    double best = 1e30, total = 0.0;
+    int runs = 0;
+    while (total < min_time || runs < 3) {
+        double start = MPI_Wtime();
+        fn();
+        double elapsed = MPI_Wtime() - start;
+        best = std::min(best, elapsed);
+        total += elapsed;
+        ++runs;
+    }
+    return best;
+}
+
+template <typename T>
+bool same_result(const std::vector<T>& x, const std::vector<T>& y) {
+    for (size_t i = 0; i < x.size(); ++i) {
+        if (std::is_integral<T>::value ? x[i] != y[i]
+                                       : std::abs((double)x[i] - (double)y[i]) > 1e-3 * std::abs((double)y[i]) + 1e-3) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename T>
+void bench_type(const char* type_name, int n) {
+    std::vector<T> A((size_t)n * n), B((size_t)n * n), C_ref((size_t)n * n), C((size_t)n * n);
+    for (size_t i = 0; i < A.size(); ++i) {
+        A[i] = T((i * 7 + 3) % 10 + 1);
+        B[i] = T((i * 13 + 5) % 10 + 1);
+    }
+    double flops = 2.0 * n * n * n;
+
+    double naive = best_time([&] { naive_multiply(n, n, n, A.data(), B.data(), C_ref.data()); });
+    std::cout << type_name << "\t" << n << "\tnaive\t" << flops / naive * 1e-9 << " GFLOP/s" << std::endl;
+
+    for (gemm::Isa isa : {gemm::Isa::generic, gemm::Isa::avx2, gemm::Isa::avx512}) {
+        if (!gemm::isa_supported(isa)) {
+            continue;
+        }
+        double t = best_time([&] {
+            std::fill(C.begin(), C.end(), T(0));
+            gemm::gemm(n, n, n, A.data(), n, B.data(), n, C.data(), n, isa);
+        });
+        std::cout << type_name << "\t" << n << "\t" << gemm::isa_name(isa) << "\t" << flops / t * 1e-9
+                  << " GFLOP/s\tspeedup " << naive / t << "x"
+                  << (same_result(C, C_ref) ? "" : "\tMISMATCH") << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    int rank;
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; ++i) {
+        sizes.push_back(std::atoi(argv[i]));
+    }
+    if (sizes.empty()) {
+        sizes = {128, 256, 512, 1024};
+    }
+
+    // Only rank 0 runs so the numbers are for a single core
+    if (rank == 0) {
+        std::cout << "Selected instruction set: " << gemm::isa_name(gemm::best_isa()) << std::endl;
+        std::cout << "type\tsize\tkernel\tthroughput" << std::endl;
+        for (int n : sizes) {
+            bench_type<int>("int", n);
+            bench_type<float>("float", n);
+            bench_type<double>("double", n);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "mpi_wrap.hpp"
+
+// Moving a block of a flattened N x N int matrix between ranks 0 and 1, with
+// manual packing against MPI derived datatypes. The block lands in the same
+// place of the receiver's matrix. Each shape is timed as a ping-pong in rounds
+// that alternate the methods so all of them see the same machine state; the
+// report is the median one-way time per round.
+//
+//   pack       copy the block row by row into a buffer, send it, copy it out
+//              into place on the other side
+//   vector     MPI_Type_vector(rows, cols, N), sent from and received into
+//              the matrix itself
+//   subarray   MPI_Type_create_subarray of the whole matrix, same buffers
+//
+// Shapes: a block of rows (contiguous, the case that needs no type), a block of
+// columns, a 2D sub-block as in e8's grid, and a single column (the worst case
+// for strided access: every run is one int).
+//
+// Usage: mpirun -np 2 ./e8c [--n N] [--iters N] [--rounds N]
+
+struct Config {
+    int n = 2048;
+    int iters = 20;
+    int rounds = 7;
+};
+
+struct Shape {
+    const char* name;
+    int row0, col0, rows, cols;
+};
+
+enum Method { pack, vector, subarray, methods };
+
+// One block transfer by one method; buffer is the packing buffer
+void send_block(std::vector<int>& matrix, std::vector<int>& buffer, const Shape& s, int n, Method m,
+                MPI_Datatype vec, MPI_Datatype sub, int peer) {
+    int* origin = &matrix[(size_t)s.row0 * n + s.col0];
+    if (m == pack) {
+        for (int i = 0; i < s.rows; ++i) {
+            memcpy(&buffer[(size_t)i * s.cols], origin + (size_t)i * n, s.cols * sizeof(int));
+        }
+        mpiw::send(buffer.data(), s.rows * s.cols, peer, 0);
+    } else if (m == vector) {
+        mpiw::check(MPI_Send(origin, 1, vec, peer, 0, MPI_COMM_WORLD), "MPI_Send");
+    } else {
+        mpiw::check(MPI_Send(matrix.data(), 1, sub, peer, 0, MPI_COMM_WORLD), "MPI_Send");
+    }
+}
+
+void recv_block(std::vector<int>& matrix, std::vector<int>& buffer, const Shape& s, int n, Method m,
+                MPI_Datatype vec, MPI_Datatype sub, int peer) {
+    int* origin = &matrix[(size_t)s.row0 * n + s.col0];
+    if (m == pack) {
+        mpiw::recv(buffer.data(), s.rows * s.cols, peer, 0);
+        for (int i = 0; i < s.rows; ++i) {
+            memcpy(origin + (size_t)i * n, &buffer[(size_t)i * s.cols], s.cols * sizeof(int));
+        }
+    } else if (m == vector) {
+        mpiw::check(MPI_Recv(origin, 1, vec, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE), "MPI_Recv");
+    } else {
+        mpiw::check(MPI_Recv(matrix.data(), 1, sub, peer, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE), "MPI_Recv");
+    }
+}
+
+// One-way time in seconds of iters round trips of the block
+double pingpong(std::vector<int>& matrix, std::vector<int>& buffer, const Shape& s, int n, Method m, MPI_Datatype vec,
+                MPI_Datatype sub, int rank, int iters) {
+    int peer = 1 - rank;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    for (int i = 0; i < iters; ++i) {
+        if (rank == 0) {
+            send_block(matrix, buffer, s, n, m, vec, sub, peer);
+            recv_block(matrix, buffer, s, n, m, vec, sub, peer);
+        } else {
+            recv_block(matrix, buffer, s, n, m, vec, sub, peer);
+            send_block(matrix, buffer, s, n, m, vec, sub, peer);
+        }
+    }
+    return (MPI_Wtime() - start) / (2.0 * iters);
+}
+
+// Rank 0 sends its block once by method m into a cleared matrix on rank 1, which
+// checks the block arrived in place and nothing else changed; the count of wrong
+// entries is returned on both ranks
+long long check_method(std::vector<int>& matrix, std::vector<int>& buffer, const Shape& s, int n, Method m,
+                       MPI_Datatype vec, MPI_Datatype sub, int rank) {
+    long long errors = 0;
+    if (rank == 0) {
+        send_block(matrix, buffer, s, n, m, vec, sub, 1);
+    } else {
+        std::vector<int> received((size_t)n * n, -1);
+        recv_block(received, buffer, s, n, m, vec, sub, 0);
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) {
+                bool inside = i >= s.row0 && i < s.row0 + s.rows && j >= s.col0 && j < s.col0 + s.cols;
+                int expected = inside ? i * n + j : -1;
+                errors += received[(size_t)i * n + j] != expected;
+            }
+        }
+    }
+    mpiw::bcast(&errors, 1, 1);
+    return errors;
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Config cfg;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--n") == 0 && i + 1 < argc) {
+            cfg.n = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            cfg.iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            cfg.rounds = atoi(argv[++i]);
+        } else {
+            if (rank == 0) {
+                fprintf(stderr, "Usage: %s [--n N] [--iters N] [--rounds N]\n", argv[0]);
+            }
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    if (size != 2 || cfg.n < 4 || cfg.iters < 1 || cfg.rounds < 1) {
+        if (rank == 0) {
+            fprintf(stderr, "Run with exactly 2 processes, --n at least 4 and positive --iters/--rounds\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    int n = cfg.n;
+    std::vector<int> matrix((size_t)n * n), buffer((size_t)n * n);
+    for (size_t i = 0; i < matrix.size(); ++i) {
+        matrix[i] = (int)i;
+    }
+    const Shape shapes[] = {
+        {"row_block", n / 4, 0, n / 4, n},
+        {"column_block", 0, n / 4, n, n / 4},
+        {"sub_block", n / 4, n / 4, n / 2, n / 2},
+        {"single_column", 0, n / 2, n, 1},
+    };
+    const char* names[methods] = {"pack", "vector", "subarray"};
+
+    if (rank == 0) {
+        printf("shape,rows,cols,bytes,pack_us,vector_us,subarray_us,vector_speedup,subarray_speedup\n");
+    }
+    for (const Shape& s : shapes) {
+        MPI_Datatype vec, sub;
+        int sizes[2] = {n, n}, subsizes[2] = {s.rows, s.cols}, starts[2] = {s.row0, s.col0};
+        mpiw::check(MPI_Type_vector(s.rows, s.cols, n, MPI_INT, &vec), "MPI_Type_vector");
+        mpiw::check(MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_INT, &sub),
+                    "MPI_Type_create_subarray");
+        MPI_Type_commit(&vec);
+        MPI_Type_commit(&sub);
+
+        for (int m = 0; m < methods; ++m) {
+            if (check_method(matrix, buffer, s, n, (Method)m, vec, sub, rank) != 0) {
+                if (rank == 0) {
+                    fprintf(stderr, "%s: %s transfer delivered wrong data\n", s.name, names[m]);
+                }
+                MPI_Abort(MPI_COMM_WORLD, 1);
+            }
+        }
+
+        std::vector<double> times[methods];
+        for (int r = 0; r < cfg.rounds; ++r) {
+            for (int m = 0; m < methods; ++m) {
+                times[m].push_back(pingpong(matrix, buffer, s, n, (Method)m, vec, sub, rank, cfg.iters));
+            }
+        }
+        if (rank == 0) {
+            double median[methods];
+            for (int m = 0; m < methods; ++m) {
+                std::sort(times[m].begin(), times[m].end());
+                median[m] = times[m][cfg.rounds / 2];
+            }
+            printf("%s,%d,%d,%zu,%.2f,%.2f,%.2f,%.2f,%.2f\n", s.name, s.rows, s.cols, (size_t)s.rows * s.cols * sizeof(int),
+                   median[pack] * 1e6, median[vector] * 1e6, median[subarray] * 1e6, median[pack] / median[vector],
+                   median[pack] / median[subarray]);
+            fflush(stdout);
+        }
+        MPI_Type_free(&vec);
+        MPI_Type_free(&sub);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -0,0 +1,491 @@
+#include <mpi.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cmath>
+
+// Distributed sparse matrix-vector multiply y = A x.
+//
+// Rows of A and y, and entries of x, are split into contiguous blocks over the
+// ranks. Each rank stores its rows as two CSR matrices: the local part, whose
+// columns it owns, and the remote part, whose columns index a halo buffer that
+// holds exactly the x entries it needs from other ranks. The exchange pattern
+// (which x entries go to which rank) is built once from the column indices and
+// turned into persistent requests; every multiply starts the halo exchange,
+// multiplies the local part while it is in flight, waits, and then adds the
+// remote part.
+//
+// The local part can also be stored as SELL-C-sigma (--format sell): rows are
+// sorted by length within windows of sigma rows and packed into chunks of C rows
+// stored column by column, so the inner loop runs over C independent rows.
+//
+// The matrix comes from a Matrix Market file (coordinate; real, integer or
+// pattern; general, symmetric or skew-symmetric) of which every rank keeps only
+// its own rows, or is the 5-point Laplacian of an n x n grid (--laplace n).
+//
+// Usage: mpirun -np P ./e9 (FILE.mtx | --laplace n) [--iters N] [--format csr|sell]
+//                          [--chunk C] [--sigma S]
+
+struct Entry {
+    int row, col;
+    double val;
+};
+
+struct Csr {
+    int rows = 0;
+    std::vector<int> ptr, col;
+    std::vector<double> val;
+};
+
+// Block distribution of n items over p parts: the first n % p parts get one extra item
+int block_size(int n, int p, int i) {
+    return n / p + (i < n % p ? 1 : 0);
+}
+
+int block_start(int n, int p, int i) {
+    return i * (n / p) + std::min(i, n % p);
+}
+
+int block_owner(int n, int p, int g) {
+    int q = n / p, r = n % p;
+    if (g < r * (q + 1)) {
+        return g / (q + 1);
+    }
+    return r + (g - r * (q + 1)) / q;
+}
+
+// Read the entries of rows [row0, row0 + rows) of a Matrix Market file (0-based).
+// Every rank reads the file; nrows/ncols are filled in from the size line.
+bool read_matrix_market(const char* path, int rank, int size, int& nrows, int& ncols, std::vector<Entry>& mine) {
+    FILE* f = fopen(path, "r");
+    if (f == nullptr) {
+        return false;
+    }
+    char line[1024], object[64], format[64], field[64], symmetry[64];
+    if (fgets(line, sizeof(line), f) == nullptr
+        || sscanf(line, "%%%%MatrixMarket %63s %63s %63s %63s", object, format, field, symmetry) != 4
+        || strcmp(format, "coordinate") != 0 || strcmp(field, "complex") == 0) {
+        fclose(f);
+        return false;
+    }
+    bool pattern = strcmp(field, "pattern") == 0;
+    bool symmetric = strcmp(symmetry, "symmetric") == 0, skew = strcmp(symmetry, "skew-symmetric") == 0;
+
+    long long nnz = 0;
+    do {
+        if (fgets(line, sizeof(line), f) == nullptr) {
+            fclose(f);
+            return false;
+        }
+    } while (line[0] == '%');
+    if (sscanf(line, "%d %d %lld", &nrows, &ncols, &nnz) != 3) {
+        fclose(f);
+        return false;
+    }
+
+    int row0 = block_start(nrows, size, rank), row1 = row0 + block_size(nrows, size, rank);
+    auto keep = [&](int i, int j, double v) {
+        if (i >= row0 && i < row1) {
+            mine.push_back({i, j, v});
+        }
+    };
+    for (long long e = 0; e < nnz && fgets(line, sizeof(line), f) != nullptr;) {
+        int i, j;
+        double v = 1.0;
+        if (line[0] == '%' || sscanf(line, "%d %d %lf", &i, &j, &v) < (pattern ? 2 : 3)) {
+            continue;
+        }
+        ++e;
+        keep(i - 1, j - 1, v);
+        if ((symmetric || skew) && i != j) {
+            keep(j - 1, i - 1, skew ? -v : v);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+// Rows [row0, row0 + rows) of the 5-point Laplacian on an n x n grid
+void laplace_rows(int n, int row0, int rows, std::vector<Entry>& mine) {
+    for (int r = row0; r < row0 + rows; ++r) {
+        int i = r / n, j = r % n;
+        mine.push_back({r, r, 4.0});
+        if (i > 0) mine.push_back({r, r - n, -1.0});
+        if (i < n - 1) mine.push_back({r, r + n, -1.0});
+        if (j > 0) mine.push_back({r, r - 1, -1.0});
+        if (j < n - 1) mine.push_back({r, r + 1, -1.0});
+    }
+}
+
+// Row-sorted entries -> CSR over local rows, with the column index mapped by col_of
+template <typename F>
+Csr build_csr(int rows, int row0, const std::vector<Entry>& entries, F col_of) {
+    Csr a;
+    a.rows = rows;
+    a.ptr.assign(rows + 1, 0);
+    for (const Entry& e : entries) {
+        a.ptr[e.row - row0 + 1]++;
+    }
+    for (int i = 0; i < rows; ++i) {
+        a.ptr[i + 1] += a.ptr[i];
+    }
+    a.col.reserve(entries.size());
+    a.val.reserve(entries.size());
+    for (const Entry& e : entries) {
+        a.col.push_back(col_of(e.col));
+        a.val.push_back(e.val);
+    }
+    return a;
+}
+
+// y = A x (accumulate: y += A x)
+void spmv_csr(const Csr& a, const double* x, double* y, bool accumulate) {
+    for (int i = 0; i < a.rows; ++i) {
+        double sum = accumulate ? y[i] : 0.0;
+        for (int k = a.ptr[i]; k < a.ptr[i + 1]; ++k) {
+            sum += a.val[k] * x[a.col[k]];
+        }
+        y[i] = sum;
+    }
+}
+
+// SELL-C-sigma: slot s of chunk c is row perm[c * C + s]; entry j of that slot is
+// at chunk_ptr[c] + j * C + s. Padding entries have value 0 and column 0.
+struct Sell {
+    int C = 8, rows = 0, chunks = 0;
+    std::vector<int> chunk_ptr, chunk_len, perm, col;
+    std::vector<double> val;
+};
+
+Sell build_sell(const Csr& a, int C, int sigma) {
+    Sell s;
+    s.C = C;
+    s.rows = a.rows;
+    s.chunks = (a.rows + C - 1) / C;
+    s.perm.resize((size_t)s.chunks * C);
+    for (int i = 0; i < (int)s.perm.size(); ++i) {
+        s.perm[i] = i;
+    }
+    auto length = [&](int r) { return r < a.rows ? a.ptr[r + 1] - a.ptr[r] : 0; };
+    for (int w = 0; w < a.rows; w += sigma) {
+        std::stable_sort(s.perm.begin() + w, s.perm.begin() + std::min(w + sigma, a.rows),
+                         [&](int x, int y) { return length(x) > length(y); });
+    }
+    s.chunk_ptr.resize(s.chunks + 1, 0);
+    s.chunk_len.resize(s.chunks, 0);
+    for (int c = 0; c < s.chunks; ++c) {
+        for (int r = 0; r < C; ++r) {
+            s.chunk_len[c] = std::max(s.chunk_len[c], length(s.perm[c * C + r]));
+        }
+        s.chunk_ptr[c + 1] = s.chunk_ptr[c] + s.chunk_len[c] * C;
+    }
+    s.col.assign(s.chunk_ptr[s.chunks], 0);
+    s.val.assign(s.chunk_ptr[s.chunks], 0.0);
+    for (int c = 0; c < s.chunks; ++c) {
+        for (int r = 0; r < C; ++r) {
+            int row = s.perm[c * C + r];
+            for (int j = 0; j < length(row); ++j) {
+                s.col[s.chunk_ptr[c] + j * C + r] = a.col[a.ptr[row] + j];
+                s.val[s.chunk_ptr[c] + j * C + r] = a.val[a.ptr[row] + j];
+            }
+        }
+    }
+    return s;
+}
+
+// Chunks of CW rows; CW is a compile-time constant so the row loop is unrolled and vectorised
+template <int CW>
+void spmv_sell_fixed(const Sell& s, const double* x, double* y) {
+    for (int c = 0; c < s.chunks; ++c) {
+        double sum[CW] = {};
+        const int* col = &s.col[s.chunk_ptr[c]];
+        const double* val = &s.val[s.chunk_ptr[c]];
+        for (int j = 0; j < s.chunk_len[c]; ++j) {
+            for (int r = 0; r < CW; ++r) {
+                sum[r] += val[j * CW + r] * x[col[j * CW + r]];
+            }
+        }
+        for (int r = 0; r < CW; ++r) {
+            int row = s.perm[c * CW + r];
+            if (row < s.rows) {
+                y[row] = sum[r];
+            }
+        }
+    }
+}
+
+void spmv_sell(const Sell& s, const double* x, double* y) {
+    switch (s.C) {
+    case 4: spmv_sell_fixed<4>(s, x, y); return;
+    case 8: spmv_sell_fixed<8>(s, x, y); return;
+    case 16: spmv_sell_fixed<16>(s, x, y); return;
+    }
+    std::vector<double> sum(s.C);
+    for (int c = 0; c < s.chunks; ++c) {
+        std::fill(sum.begin(), sum.end(), 0.0);
+        const int* col = &s.col[s.chunk_ptr[c]];
+        const double* val = &s.val[s.chunk_ptr[c]];
+        for (int j = 0; j < s.chunk_len[c]; ++j) {
+            for (int r = 0; r < s.C; ++r) {
+                sum[r] += val[j * s.C + r] * x[col[j * s.C + r]];
+            }
+        }
+        for (int r = 0; r < s.C; ++r) {
+            int row = s.perm[c * s.C + r];
+            if (row < s.rows) {
+                y[row] = sum[r];
+            }
+        }
+    }
+}
+
+// Halo exchange pattern, built once. Halo entries are ordered by global column,
+// so the entries from one rank are contiguous.
+struct Halo {
+    std::vector<int> halo_cols;                 // Global column of each halo entry
+    std::vector<int> send_idx;                  // Local x entries to send, grouped by destination
+    std::vector<double> send_buf, recv_buf;
+    std::vector<MPI_Request> requests;          // Persistent: receives first, then sends
+    long long send_bytes = 0;
+    int messages = 0;
+
+    void build(const std::vector<int>& needed, int ncols, int col0, MPI_Comm comm) {
+        int size;
+        MPI_Comm_size(comm, &size);
+        halo_cols = needed;
+        std::vector<int> recv_counts(size, 0), send_counts(size), recv_displs(size + 1, 0), send_displs(size + 1, 0);
+        for (int c : halo_cols) {
+            recv_counts[block_owner(ncols, size, c)]++;
+        }
+        // Tell every owner which of its entries this rank needs
+        MPI_Alltoall(recv_counts.data(), 1, MPI_INT, send_counts.data(), 1, MPI_INT, comm);
+        for (int p = 0; p < size; ++p) {
+            recv_displs[p + 1] = recv_displs[p] + recv_counts[p];
+            send_displs[p + 1] = send_displs[p] + send_counts[p];
+        }
+        send_idx.resize(send_displs[size]);
+        MPI_Alltoallv(halo_cols.data(), recv_counts.data(), recv_displs.data(), MPI_INT, send_idx.data(),
+                      send_counts.data(), send_displs.data(), MPI_INT, comm);
+        for (int& i : send_idx) {
+            i -= col0;
+        }
+
+        send_buf.resize(send_idx.size());
+        recv_buf.resize(halo_cols.size());
+        for (int p = 0; p < size; ++p) {
+            if (recv_counts[p] > 0) {
+                requests.emplace_back();
+                MPI_Recv_init(&recv_buf[recv_displs[p]], recv_counts[p], MPI_DOUBLE, p, 0, comm, &requests.back());
+            }
+        }
+        for (int p = 0; p < size; ++p) {
+            if (send_counts[p] > 0) {
+                requests.emplace_back();
+                MPI_Send_init(&send_buf[send_displs[p]], send_counts[p], MPI_DOUBLE, p, 0, comm, &requests.back());
+                send_bytes += send_counts[p] * (long long)sizeof(double);
+                ++messages;
+            }
+        }
+    }
+
+    void start(const double* x) {
+        for (size_t i = 0; i < send_idx.size(); ++i) {
+            send_buf[i] = x[send_idx[i]];
+        }
+        if (!requests.empty()) {
+            MPI_Startall((int)requests.size(), requests.data());
+        }
+    }
+
+    void finish() {
+        MPI_Waitall((int)requests.size(), requests.data(), MPI_STATUSES_IGNORE);
+    }
+
+    void free() {
+        for (MPI_Request& r : requests) {
+            MPI_Request_free(&r);
+        }
+        requests.clear();
+    }
+};
+
+struct Options {
+    std::string path;
+    int laplace = 0;
+    int iters = 100;
+    std::string format = "csr";
+    int chunk = 8;
+    int sigma = 256;
+};
+
+// Time and check one way of multiplying; the slowest rank defines the time
+void run_variant(const char* name, long long nnz, int iters, int rank, Halo& halo, const std::vector<double>& x,
+                 std::vector<double>& y, const std::vector<double>& reference, bool overlap,
+                 void (*local)(const void* a, const double* x, double* y), const void* local_a, const Csr& remote) {
+    double comm = 0.0;
+    MPI_Barrier(MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    for (int it = 0; it < iters; ++it) {
+        double t = MPI_Wtime();
+        halo.start(x.data());
+        if (!overlap) {
+            halo.finish();
+        }
+        comm += MPI_Wtime() - t;
+        local(local_a, x.data(), y.data());
+        t = MPI_Wtime();
+        if (overlap) {
+            halo.finish(); // Only what the local multiply did not cover is exposed here
+        }
+        comm += MPI_Wtime() - t;
+        spmv_csr(remote, halo.recv_buf.data(), y.data(), true);
+    }
+    double elapsed = (MPI_Wtime() - start) / iters, max_elapsed = 0.0, avg_comm = 0.0;
+    comm /= iters;
+    MPI_Reduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&comm, &avg_comm, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    double error = 0.0, max_error = 0.0;
+    for (size_t i = 0; i < y.size(); ++i) {
+        error = std::max(error, std::abs(y[i] - reference[i]) / std::max(1.0, std::abs(reference[i])));
+    }
+    MPI_Reduce(&error, &max_error, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    if (rank == 0) {
+        printf("%-13s %9.3f us/iter  %8.3f GFLOP/s  comm wait %8.3f us/rank  max rel. error %.1e\n", name,
+               max_elapsed * 1e6, 2.0 * nnz / max_elapsed * 1e-9, avg_comm / size * 1e6, max_error);
+    }
+}
+
+void local_csr(const void* a, const double* x, double* y) {
+    spmv_csr(*static_cast<const Csr*>(a), x, y, false);
+}
+
+void local_sell(const void* a, const double* x, double* y) {
+    spmv_sell(*static_cast<const Sell*>(a), x, y);
+}
+
+int main(int argc, char** argv) {
+    MPI_Init(&argc, &argv);
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    Options opt;
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--laplace") == 0 && i + 1 < argc) {
+            opt.laplace = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--iters") == 0 && i + 1 < argc) {
+            opt.iters = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            opt.format = argv[++i];
+        } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            opt.chunk = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sigma") == 0 && i + 1 < argc) {
+            opt.sigma = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && opt.path.empty()) {
+            opt.path = argv[i];
+        } else {
+            ok = false;
+        }
+    }
+    ok = ok && (opt.path.empty() != (opt.laplace == 0)) && opt.iters > 0 && opt.chunk > 0 && opt.sigma > 0
+         && (opt.format == "csr" || opt.format == "sell");
+    if (!ok) {
+        if (rank == 0) {
+            fprintf(stderr, "Usage: %s (FILE.mtx | --laplace n) [--iters N] [--format csr|sell] [--chunk C] [--sigma S]\n",
+                    argv[0]);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    // This rank's rows
+    int nrows = 0, ncols = 0;
+    std::vector<Entry> mine;
+    if (opt.laplace > 0) {
+        nrows = ncols = opt.laplace * opt.laplace;
+        laplace_rows(opt.laplace, block_start(nrows, size, rank), block_size(nrows, size, rank), mine);
+    } else if (!read_matrix_market(opt.path.c_str(), rank, size, nrows, ncols, mine)) {
+        if (rank == 0) {
+            fprintf(stderr, "Cannot read %s as a coordinate Matrix Market file\n", opt.path.c_str());
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    int row0 = block_start(nrows, size, rank), rows = block_size(nrows, size, rank);
+    int col0 = block_start(ncols, size, rank), cols = block_size(ncols, size, rank);
+    std::sort(mine.begin(), mine.end(), [](const Entry& a, const Entry& b) {
+        return a.row != b.row ? a.row < b.row : a.col < b.col;
+    });
+
+    // Split into the local part and the remote part, which indexes the halo
+    std::vector<Entry> local_entries, remote_entries;
+    std::vector<int> needed;
+    for (const Entry& e : mine) {
+        if (e.col >= col0 && e.col < col0 + cols) {
+            local_entries.push_back(e);
+        } else {
+            remote_entries.push_back(e);
+            needed.push_back(e.col);
+        }
+    }
+    std::sort(needed.begin(), needed.end());
+    needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+    Csr local = build_csr(rows, row0, local_entries, [&](int c) { return c - col0; });
+    Csr remote = build_csr(rows, row0, remote_entries, [&](int c) {
+        return (int)(std::lower_bound(needed.begin(), needed.end(), c) - needed.begin());
+    });
+    Halo halo;
+    halo.build(needed, ncols, col0, MPI_COMM_WORLD);
+
+    // x_i = 1 + (i mod 7) / 7; the reference y uses a replicated x and the unsplit rows
+    std::vector<double> x(std::max(cols, 1)), x_all(ncols), y(rows), reference(rows, 0.0);
+    for (int i = 0; i < ncols; ++i) {
+        x_all[i] = 1.0 + (i % 7) / 7.0;
+    }
+    std::copy(x_all.begin() + col0, x_all.begin() + col0 + cols, x.begin());
+    for (const Entry& e : mine) {
+        reference[e.row - row0] += e.val * x_all[e.col];
+    }
+
+    long long nnz = 0, my_nnz = (long long)mine.size(), max_nnz = 0, volume = 0, messages = 0, max_volume = 0;
+    long long my_messages = halo.messages;
+    MPI_Reduce(&my_nnz, &nnz, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&my_nnz, &max_nnz, 1, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&halo.send_bytes, &volume, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&halo.send_bytes, &max_volume, 1, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&my_messages, &messages, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&nnz, 1, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+        printf("%d x %d matrix, %lld nonzeros on %d ranks (max %lld per rank, %.2f x the mean)\n", nrows, ncols, nnz, size,
+               max_nnz, nnz > 0 ? (double)max_nnz * size / nnz : 1.0);
+        printf("Halo exchange per iteration: %lld messages, %lld bytes in total, at most %lld bytes sent by one rank\n",
+               messages, volume, max_volume);
+    }
+
+    run_variant("csr blocking", nnz, opt.iters, rank, halo, x, y, reference, false, local_csr, &local, remote);
+    run_variant("csr overlap", nnz, opt.iters, rank, halo, x, y, reference, true, local_csr, &local, remote);
+    if (opt.format == "sell") {
+        Sell sell = build_sell(local, opt.chunk, opt.sigma); // Padding reads x[0], which exists even when cols == 0
+        long long padded = (long long)sell.val.size(), total_padded = 0, local_nnz = (long long)local.val.size(),
+                  total_local = 0;
+        MPI_Reduce(&padded, &total_padded, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        MPI_Reduce(&local_nnz, &total_local, 1, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        if (rank == 0) {
+            printf("SELL-%d-%d local part: %.1f%% padding\n", opt.chunk, opt.sigma,
+                   total_padded > 0 ? 100.0 * (total_padded - total_local) / total_padded : 0.0);
+        }
+        run_variant("sell overlap", nnz, opt.iters, rank, halo, x, y, reference, true, local_sell, &sell, remote);
+    }
+
+    halo.free();
+    MPI_Finalize();
+    return 0;
+}
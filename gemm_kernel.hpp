@@ -0,0 +1,217 @@
+#ifndef GEMM_KERNEL_HPP
+#define GEMM_KERNEL_HPP
+
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+// Local matrix multiply kernel: C (m x n) += A (m x k) * B (k x n), all row-major
+// with leading dimensions lda/ldb/ldc. Works for int, float and double.
+//
+// The loops are blocked for the caches (KC x NC panels of B, MC x KC blocks of A)
+// and both operands are packed so the innermost loop streams contiguous memory.
+// The MR x NR micro-kernel keeps C in vector registers; it is written with GCC
+// vector extensions and compiled once per instruction set, and the widest one the
+// CPU supports is chosen at runtime (override with GEMM_ISA=generic|avx2|avx512).
+
+namespace gemm {
+
+enum class Isa { generic, avx2, avx512 };
+
+inline const char* isa_name(Isa isa) {
+    switch (isa) {
+    case Isa::avx512: return "avx512";
+    case Isa::avx2: return "avx2";
+    default: return "generic";
+    }
+}
+
+inline bool isa_supported(Isa isa) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (isa == Isa::avx512) {
+        return __builtin_cpu_supports("avx512f");
+    }
+    if (isa == Isa::avx2) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+#else
+    if (isa != Isa::generic) {
+        return false;
+    }
+#endif
+    return true;
+}
+
+// Widest supported instruction set, detected once
+inline Isa best_isa() {
+    static const Isa isa = [] {
+        const char* env = std::getenv("GEMM_ISA");
+        if (env != nullptr) {
+            for (Isa candidate : {Isa::generic, Isa::avx2, Isa::avx512}) {
+                if (std::strcmp(env, isa_name(candidate)) == 0 && isa_supported(candidate)) {
+                    return candidate;
+                }
+            }
+        }
+        if (isa_supported(Isa::avx512)) {
+            return Isa::avx512;
+        }
+        return isa_supported(Isa::avx2) ? Isa::avx2 : Isa::generic;
+    }();
+    return isa;
+}
+
+namespace detail {
+
+constexpr int MR = 6;     // Rows of C held in registers by the micro-kernel
+constexpr int KC = 256;   // Depth of a packed panel
+constexpr int MC = 96;    // Rows of A per packed block (multiple of MR)
+constexpr int NC = 2048;  // Columns of B per packed panel
+
+// Pack rows [0, mc) x depth [0, kc) of A into MR-row slivers: sliver s holds
+// a[s*MR + i][p] at position p*MR + i, zero-padded past mc
+template <typename T>
+void pack_A(int mc, int kc, const T* A, int lda, T* packed) {
+    for (int s = 0; s < mc; s += MR) {
+        int rows = std::min(MR, mc - s);
+        for (int p = 0; p < kc; ++p) {
+            for (int i = 0; i < rows; ++i) {
+                packed[p * MR + i] = A[(size_t)(s + i) * lda + p];
+            }
+            for (int i = rows; i < MR; ++i) {
+                packed[p * MR + i] = T(0);
+            }
+        }
+        packed += (size_t)kc * MR;
+    }
+}
+
+// Pack depth [0, kc) x columns [0, nc) of B into NR-column strips, zero-padded past nc
+template <typename T>
+void pack_B(int kc, int nc, int NR, const T* B, int ldb, T* packed) {
+    for (int s = 0; s < nc; s += NR) {
+        int cols = std::min(NR, nc - s);
+        for (int p = 0; p < kc; ++p) {
+            const T* row = B + (size_t)p * ldb + s;
+            std::memcpy(packed + p * NR, row, cols * sizeof(T));
+            std::fill(packed + p * NR + cols, packed + (p + 1) * NR, T(0));
+        }
+        packed += (size_t)kc * NR;
+    }
+}
+
+// MR x (2 vectors) block of C += packed A sliver * packed B strip
+template <typename T, int VB>
+inline __attribute__((always_inline)) void micro_kernel(int kc, const T* a, const T* b, T* C, int ldc, int mr, int nr) {
+    typedef T V __attribute__((vector_size(VB)));
+    constexpr int L = VB / sizeof(T);
+    V acc[MR][2];
+    for (int i = 0; i < MR; ++i) {
+        acc[i][0] = V{};
+        acc[i][1] = V{};
+    }
+    for (int p = 0; p < kc; ++p) {
+        V b0, b1;
+        std::memcpy(&b0, b + p * 2 * L, VB);
+        std::memcpy(&b1, b + p * 2 * L + L, VB);
+#pragma GCC unroll 8
+        for (int i = 0; i < MR; ++i) {
+            T ai = a[p * MR + i];
+            acc[i][0] += ai * b0;
+            acc[i][1] += ai * b1;
+        }
+    }
+    if (mr == MR && nr == 2 * L) {
+        for (int i = 0; i < MR; ++i) {
+            V c0, c1;
+            std::memcpy(&c0, C + (size_t)i * ldc, VB);
+            std::memcpy(&c1, C + (size_t)i * ldc + L, VB);
+            c0 += acc[i][0];
+            c1 += acc[i][1];
+            std::memcpy(C + (size_t)i * ldc, &c0, VB);
+            std::memcpy(C + (size_t)i * ldc + L, &c1, VB);
+        }
+    } else {
+        // Edge tile: spill the accumulators and add only the valid part
+        T tile[MR][2 * L];
+        std::memcpy(tile, acc, sizeof(tile));
+        for (int i = 0; i < mr; ++i) {
+            for (int j = 0; j < nr; ++j) {
+                C[(size_t)i * ldc + j] += tile[i][j];
+            }
+        }
+    }
+}
+
+// Blocked driver; VB is the vector width in bytes of the instruction set it is inlined into
+template <typename T, int VB>
+inline __attribute__((always_inline)) void gemm_blocked(int m, int n, int k, const T* A, int lda, const T* B, int ldb, T* C, int ldc) {
+    constexpr int NR = 2 * VB / (int)sizeof(T);
+    static thread_local std::vector<T> packed_A, packed_B;
+    packed_A.resize((size_t)MC * KC);
+    packed_B.resize((size_t)KC * ((NC + NR - 1) / NR * NR));
+
+    for (int jc = 0; jc < n; jc += NC) {
+        int nc = std::min(NC, n - jc);
+        for (int pc = 0; pc < k; pc += KC) {
+            int kc = std::min(KC, k - pc);
+            pack_B(kc, nc, NR, B + (size_t)pc * ldb + jc, ldb, packed_B.data());
+            for (int ic = 0; ic < m; ic += MC) {
+                int mc = std::min(MC, m - ic);
+                pack_A(mc, kc, A + (size_t)ic * lda + pc, lda, packed_A.data());
+                for (int jr = 0; jr < nc; jr += NR) {
+                    const T* b = packed_B.data() + (size_t)(jr / NR) * kc * NR;
+                    for (int ir = 0; ir < mc; ir += MR) {
+                        const T* a = packed_A.data() + (size_t)(ir / MR) * kc * MR;
+                        micro_kernel<T, VB>(kc, a, b, C + (size_t)(ic + ir) * ldc + jc + jr, ldc,
+                                            std::min(MR, mc - ir), std::min(NR, nc - jr));
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <typename T>
+void gemm_generic(int m, int n, int k, const T* A, int lda, const T* B, int ldb, T* C, int ldc) {
+    gemm_blocked<T, 16>(m, n, k, A, lda, B, ldb, C, ldc);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template <typename T>
+__attribute__((target("avx2,fma"))) void gemm_avx2(int m, int n, int k, const T* A, int lda, const T* B, int ldb, T* C, int ldc) {
+    gemm_blocked<T, 32>(m, n, k, A, lda, B, ldb, C, ldc);
+}
+
+template <typename T>
+__attribute__((target("avx512f"))) void gemm_avx512(int m, int n, int k, const T* A, int lda, const T* B, int ldb, T* C, int ldc) {
+    gemm_blocked<T, 64>(m, n, k, A, lda, B, ldb, C, ldc);
+}
+#endif
+
+} // namespace detail
+
+// C (m x n, ldc) += A (m x k, lda) * B (k x n, ldb)
+template <typename T>
+void gemm(int m, int n, int k, const T* A, int lda, const T* B, int ldb, T* C, int ldc, Isa isa = best_isa()) {
+    if (m <= 0 || n <= 0 || k <= 0) {
+        return;
+    }
+#if defined(__x86_64__) || defined(__i386__)
+    if (isa == Isa::avx512) {
+        detail::gemm_avx512(m, n, k, A, lda, B, ldb, C, ldc);
+        return;
+    }
+    if (isa == Isa::avx2) {
+        detail::gemm_avx2(m, n, k, A, lda, B, ldb, C, ldc);
+        return;
+    }
+#endif
+    detail::gemm_generic(m, n, k, A, lda, B, ldb, C, ldc);
+}
+
+} // namespace gemm
+
+#endif // GEMM_KERNEL_HPP
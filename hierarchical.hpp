@@ -0,0 +1,263 @@
+#ifndef HIERARCHICAL_HPP
+#define HIERARCHICAL_HPP
+
+#include <mpi.h>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "allreduce.hpp"
+#include "mpi_wrap.hpp"
+
+// Topology-aware reduce, allreduce and broadcast in two levels.
+//
+// A Communicator splits comm into nodes (MPI_Comm_split_type with
+// MPI_COMM_TYPE_SHARED) and a communicator of one leader per node, and gives
+// every node an MPI_Win_allocate_shared window with one segment per rank plus
+// two result segments. A collective then moves data across the network only
+// between leaders, once per node instead of once per rank:
+//
+//   reduce, allreduce  every rank copies its vector into its segment; the ranks
+//                      of the node each combine a slice of all segments into
+//                      the result (intra-node, in shared memory); the leaders
+//                      MPI_Reduce / MPI_Allreduce the node results (inter-node);
+//                      the root, or every rank, copies the result out
+//   bcast              the root copies the message into its node's result
+//                      segment, the leaders MPI_Bcast it into theirs, and every
+//                      rank copies it out
+//
+// Messages longer than a segment (--segment, 1 MB by default) go through in
+// segments. Collectives may follow each other directly: each one fences the node
+// before it overwrites anything another rank may still be reading. Mode::flat is
+// the plain MPI collective on comm, to compare against; Mode::automatic is
+// hierarchical when there are several nodes with several ranks on some node,
+// flat otherwise. ppn > 0 splits every node further into groups of ppn
+// consecutive ranks, to emulate small nodes on one machine.
+//
+// Collectives return the first MPI error code, or MPI_SUCCESS. Ops are those of
+// allreduce.hpp (commutative); Sum, Max and Min map to the MPI built-ins for the
+// inter-node phase. Not thread-safe.
+
+namespace hier {
+
+enum class Mode { flat, hierarchical, automatic };
+
+inline const char* name(Mode mode) {
+    switch (mode) {
+    case Mode::flat: return "flat";
+    case Mode::hierarchical: return "hier";
+    default: return "auto";
+    }
+}
+
+inline bool parse(const char* text, Mode& mode) {
+    for (Mode m : {Mode::flat, Mode::hierarchical, Mode::automatic}) {
+        if (std::strcmp(text, name(m)) == 0) {
+            mode = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+// MPI_Op for an allreduce.hpp op: the built-in where there is one
+template <typename Op>
+struct mpi_op {
+    template <typename T>
+    static MPI_Op get() { return allreduce::op_handle<Op, T>(); }
+};
+template <> struct mpi_op<allreduce::Sum> { template <typename T> static MPI_Op get() { return MPI_SUM; } };
+template <> struct mpi_op<allreduce::Max> { template <typename T> static MPI_Op get() { return MPI_MAX; } };
+template <> struct mpi_op<allreduce::Min> { template <typename T> static MPI_Op get() { return MPI_MIN; } };
+
+class Communicator {
+public:
+    explicit Communicator(MPI_Comm comm, int ppn = 0, size_t segment_bytes = 1 << 20)
+        : comm_(comm), segment_(std::max<size_t>(segment_bytes, 64) / 64 * 64) {
+        MPI_Comm_rank(comm, &rank_);
+        MPI_Comm_size(comm, &size_);
+        mpiw::check(MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank_, MPI_INFO_NULL, &node_), "MPI_Comm_split_type");
+        if (ppn > 0) {
+            MPI_Comm shared = node_;
+            int shared_rank;
+            MPI_Comm_rank(shared, &shared_rank);
+            mpiw::check(MPI_Comm_split(shared, shared_rank / ppn, rank_, &node_), "MPI_Comm_split");
+            MPI_Comm_free(&shared);
+        }
+        MPI_Comm_rank(node_, &node_rank_);
+        MPI_Comm_size(node_, &node_size_);
+        mpiw::check(MPI_Comm_split(comm, node_rank_ == 0 ? 0 : MPI_UNDEFINED, rank_, &leaders_), "MPI_Comm_split");
+
+        // Node index of every rank: the leader's rank among the leaders
+        int node = 0, largest_node = 0;
+        if (leaders_ != MPI_COMM_NULL) {
+            MPI_Comm_rank(leaders_, &node);
+            MPI_Comm_size(leaders_, &nodes_);
+        }
+        MPI_Bcast(&node, 1, MPI_INT, 0, node_);
+        MPI_Bcast(&nodes_, 1, MPI_INT, 0, node_);
+        node_of_.resize(size_);
+        MPI_Allgather(&node, 1, MPI_INT, node_of_.data(), 1, MPI_INT, comm);
+        MPI_Allreduce(&node_size_, &largest_node, 1, MPI_INT, MPI_MAX, comm);
+        worthwhile_ = nodes_ > 1 && largest_node > 1;
+
+        // Segments of the node's ranks, in node rank order, then the leader's two results
+        MPI_Aint bytes = (MPI_Aint)segment_ * (node_rank_ == 0 ? 3 : 1);
+        char* base;
+        mpiw::check(MPI_Win_allocate_shared(bytes, 1, MPI_INFO_NULL, node_, &base, &win_), "MPI_Win_allocate_shared");
+        slots_.resize(node_size_);
+        for (int r = 0; r < node_size_; ++r) {
+            MPI_Aint size;
+            int disp_unit;
+            mpiw::check(MPI_Win_shared_query(win_, r, &size, &disp_unit, &slots_[r]), "MPI_Win_shared_query");
+        }
+        result_[0] = slots_[0] + segment_;
+        result_[1] = slots_[0] + 2 * segment_;
+        MPI_Win_lock_all(MPI_MODE_NOCHECK, win_);
+    }
+
+    ~Communicator() {
+        MPI_Win_unlock_all(win_);
+        MPI_Win_free(&win_);
+        if (leaders_ != MPI_COMM_NULL) {
+            MPI_Comm_free(&leaders_);
+        }
+        MPI_Comm_free(&node_);
+    }
+
+    Communicator(const Communicator&) = delete;
+    Communicator& operator=(const Communicator&) = delete;
+
+    // recv is only written on root
+    template <typename T, typename Op = allreduce::Sum>
+    int reduce(const T* send, T* recv, size_t count, int root, Mode mode = Mode::automatic) {
+        MPI_Datatype type = mpiw::datatype<T>();
+        MPI_Op op = mpi_op<Op>::template get<T>();
+        if (!hierarchical(mode)) {
+            return MPI_Reduce(send, recv, (int)count, type, op, root, comm_);
+        }
+        int root_node = node_of_[root], err = MPI_SUCCESS;
+        size_t step = segment_ / sizeof(T);
+        for (size_t at = 0; at < count; at += step) {
+            size_t n = std::min(step, count - at);
+            T* result = combine_on_node<T, Op>(send + at, n);
+            if (leaders_ != MPI_COMM_NULL && nodes_ > 1) {
+                bool mine = node_of_[rank_] == root_node;
+                keep(err, MPI_Reduce(mine ? MPI_IN_PLACE : result, mine ? result : nullptr, (int)n, type, op,
+                                     root_node, leaders_));
+            }
+            if (node_of_[rank_] == root_node) {
+                fence();
+                if (rank_ == root) {
+                    std::memcpy(recv + at, result, n * sizeof(T));
+                }
+            }
+        }
+        return err;
+    }
+
+    template <typename T, typename Op = allreduce::Sum>
+    int allreduce(const T* send, T* recv, size_t count, Mode mode = Mode::automatic) {
+        MPI_Datatype type = mpiw::datatype<T>();
+        MPI_Op op = mpi_op<Op>::template get<T>();
+        if (!hierarchical(mode)) {
+            return MPI_Allreduce(send, recv, (int)count, type, op, comm_);
+        }
+        int err = MPI_SUCCESS;
+        size_t step = segment_ / sizeof(T);
+        for (size_t at = 0; at < count; at += step) {
+            size_t n = std::min(step, count - at);
+            T* result = combine_on_node<T, Op>(send + at, n);
+            if (leaders_ != MPI_COMM_NULL && nodes_ > 1) {
+                keep(err, MPI_Allreduce(MPI_IN_PLACE, result, (int)n, type, op, leaders_));
+            }
+            fence();
+            std::memcpy(recv + at, result, n * sizeof(T));
+        }
+        return err;
+    }
+
+    int bcast(void* data, size_t bytes, int root, Mode mode = Mode::automatic) {
+        if (!hierarchical(mode)) {
+            return MPI_Bcast(data, (int)bytes, MPI_BYTE, root, comm_);
+        }
+        int root_node = node_of_[root], err = MPI_SUCCESS;
+        char* buf = static_cast<char*>(data);
+        // Ranks of the node may still be copying the previous collective's result
+        // out of the result segments, which the root and the leader write below
+        fence();
+        // Segments alternate between the two results: by the time segment k + 2
+        // overwrites one, every rank of the node has passed the fence of segment
+        // k + 1, which it reaches only after copying segment k out
+        for (size_t at = 0, k = 0; at < bytes; at += segment_, ++k) {
+            size_t n = std::min(segment_, bytes - at);
+            char* result = result_[k % 2];
+            if (node_of_[rank_] == root_node) {
+                if (rank_ == root) {
+                    std::memcpy(result, buf + at, n);
+                }
+                fence();
+            }
+            if (leaders_ != MPI_COMM_NULL && nodes_ > 1) {
+                keep(err, MPI_Bcast(result, (int)n, MPI_BYTE, root_node, leaders_));
+            }
+            fence();
+            if (rank_ != root) {
+                std::memcpy(buf + at, result, n);
+            }
+        }
+        return err;
+    }
+
+    bool hierarchical(Mode mode) const {
+        return mode == Mode::hierarchical || (mode == Mode::automatic && worthwhile_);
+    }
+
+    int nodes() const { return nodes_; }
+    int node_size() const { return node_size_; }
+    int node_rank() const { return node_rank_; }
+    MPI_Comm node_comm() const { return node_; }
+    MPI_Comm leader_comm() const { return leaders_; }
+
+private:
+    // Make the stores of every rank of the node visible to the others
+    void fence() {
+        MPI_Win_sync(win_);
+        MPI_Barrier(node_);
+        MPI_Win_sync(win_);
+    }
+
+    static void keep(int& err, int call) {
+        if (err == MPI_SUCCESS) {
+            err = call;
+        }
+    }
+
+    // Intra-node phase: the node's combined n elements, in the first result segment.
+    // Each rank combines its own slice of the segment over every rank's contribution
+    template <typename T, typename Op>
+    T* combine_on_node(const T* send, size_t n) {
+        std::memcpy(slots_[node_rank_], send, n * sizeof(T));
+        fence();
+        T* result = reinterpret_cast<T*>(result_[0]);
+        size_t lo = n * node_rank_ / node_size_, hi = n * (node_rank_ + 1) / node_size_;
+        std::memcpy(result + lo, reinterpret_cast<T*>(slots_[0]) + lo, (hi - lo) * sizeof(T));
+        for (int r = 1; r < node_size_; ++r) {
+            Op::combine(reinterpret_cast<T*>(slots_[r]) + lo, result + lo, hi - lo);
+        }
+        fence();
+        return result;
+    }
+
+    MPI_Comm comm_, node_, leaders_ = MPI_COMM_NULL;
+    int rank_, size_, node_rank_, node_size_, nodes_ = 0;
+    bool worthwhile_ = false;
+    std::vector<int> node_of_;      // Node index of every rank of comm
+    size_t segment_;
+    MPI_Win win_;
+    std::vector<char*> slots_;      // Every node rank's segment
+    char* result_[2];
+};
+
+} // namespace hier
+
+#endif // HIERARCHICAL_HPP
@@ -0,0 +1,195 @@
+#ifndef MATRIX_IO_HPP
+#define MATRIX_IO_HPP
+
+#include <mpi.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "mpi_wrap.hpp"
+
+// Binary matrix files read and written collectively with MPI-IO, header-only.
+//
+// A file is a 64-byte header followed by the elements:
+//
+//   offset  size  field
+//        0     8  magic "MPIMAT01"
+//        8     8  rows (int64)
+//       16     8  cols (int64)
+//       24     4  dtype: 1 int32, 2 int64, 3 float32, 4 float64
+//       28     4  layout: 0 row-major, 1 column-major
+//       32    32  zero
+//
+// in the byte order of the machine that wrote it. Every rank reads or writes its
+// own rows x cols block straight from or into the file through a subarray file
+// view, in one collective call, so no rank ever holds more than its block and
+// the MPI-IO layer is free to merge the ranks' requests into large contiguous
+// accesses. Blocks in memory are always row-major; a column-major file is
+// transposed on the fly by the memory datatype. Files are written row-major.
+//
+// Dimensions must fit in an int, as they do everywhere else in these programs.
+
+namespace matio {
+
+const MPI_Offset header_bytes = 64;
+const char magic[8] = {'M', 'P', 'I', 'M', 'A', 'T', '0', '1'};
+
+enum Layout : int32_t { row_major = 0, column_major = 1 };
+
+template <typename T> struct dtype_code;
+template <> struct dtype_code<int32_t> { static const int32_t value = 1; };
+template <> struct dtype_code<int64_t> { static const int32_t value = 2; };
+template <> struct dtype_code<float> { static const int32_t value = 3; };
+template <> struct dtype_code<double> { static const int32_t value = 4; };
+
+struct Header {
+    int64_t rows = 0, cols = 0;
+    int32_t dtype = 0;
+    int32_t layout = row_major;
+};
+
+// Report a malformed file or a mismatched request and abort
+[[noreturn]] __attribute__((noinline, cold)) inline void fail(const char* path, const std::string& what) {
+    std::cerr << "Matrix file " << path << ": " << what << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+    std::abort();
+}
+
+// Collective over comm. Fills h and returns true, or puts the reason into error
+// and returns false (missing file, bad magic, ...) on every rank.
+inline bool read_header(const char* path, MPI_Comm comm, Header& h, std::string& error) {
+    MPI_File fh;
+    if (MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        error = "cannot open";
+        return false;
+    }
+    // Every rank reads the same 64 bytes; the collective lets MPI-IO read them once
+    char raw[header_bytes] = {};
+    MPI_Status status;
+    mpiw::check(MPI_File_read_at_all(fh, 0, raw, (int)header_bytes, MPI_BYTE, &status), "MPI_File_read_at_all");
+    int got = 0;
+    MPI_Get_count(&status, MPI_BYTE, &got);
+    MPI_File_close(&fh);
+
+    std::memcpy(&h.rows, raw + 8, 8);
+    std::memcpy(&h.cols, raw + 16, 8);
+    std::memcpy(&h.dtype, raw + 24, 4);
+    std::memcpy(&h.layout, raw + 28, 4);
+    if (got != header_bytes || std::memcmp(raw, magic, sizeof(magic)) != 0) {
+        error = "not a matrix file";
+    } else if (h.rows < 0 || h.cols < 0 || h.rows > INT32_MAX || h.cols > INT32_MAX) {
+        error = "dimensions out of range";
+    } else if (h.dtype < 1 || h.dtype > 4 || (h.layout != row_major && h.layout != column_major)) {
+        error = "unknown dtype or layout";
+    } else {
+        return true;
+    }
+    return false;
+}
+
+// File type selecting the rows x cols block at (row0, col0) of a matrix stored
+// with the given layout, or the element type alone for an empty block (MPI does
+// not allow empty subarrays)
+template <typename T>
+MPI_Datatype block_filetype(const Header& h, int row0, int col0, int rows, int cols) {
+    MPI_Datatype type = mpiw::datatype<T>();
+    if (rows == 0 || cols == 0) {
+        return type;
+    }
+    int sizes[2] = {(int)h.rows, (int)h.cols}, subsizes[2] = {rows, cols}, starts[2] = {row0, col0};
+    int order = h.layout == row_major ? MPI_ORDER_C : MPI_ORDER_FORTRAN;
+    mpiw::check(MPI_Type_create_subarray(2, sizes, subsizes, starts, order, type, &type), "MPI_Type_create_subarray");
+    mpiw::check(MPI_Type_commit(&type), "MPI_Type_commit");
+    return type;
+}
+
+// Memory type for one block in row-major order receiving elements in the file's
+// order: contiguous for a row-major file, column by column for a column-major one
+template <typename T>
+MPI_Datatype block_memtype(const Header& h, int rows, int cols) {
+    MPI_Datatype element = mpiw::datatype<T>(), type;
+    if (h.layout == row_major) {
+        mpiw::check(MPI_Type_contiguous(rows * cols, element, &type), "MPI_Type_contiguous");
+    } else {
+        MPI_Datatype column, stride_one;
+        mpiw::check(MPI_Type_vector(rows, 1, cols, element, &column), "MPI_Type_vector");
+        mpiw::check(MPI_Type_create_resized(column, 0, sizeof(T), &stride_one), "MPI_Type_create_resized");
+        mpiw::check(MPI_Type_contiguous(cols, stride_one, &type), "MPI_Type_contiguous");
+        MPI_Type_free(&column);
+        MPI_Type_free(&stride_one);
+    }
+    mpiw::check(MPI_Type_commit(&type), "MPI_Type_commit");
+    return type;
+}
+
+// Collective over comm: read this rank's rows x cols block at (row0, col0) into
+// block (row-major, rows * cols elements). Aborts if the file is unreadable or
+// does not hold T.
+template <typename T>
+void read_block(const char* path, MPI_Comm comm, int row0, int col0, int rows, int cols, T* block) {
+    Header h;
+    std::string error;
+    if (!read_header(path, comm, h, error)) {
+        fail(path, error);
+    }
+    if (h.dtype != dtype_code<T>::value) {
+        fail(path, "element type does not match");
+    }
+    MPI_File fh;
+    mpiw::check(MPI_File_open(comm, path, MPI_MODE_RDONLY, MPI_INFO_NULL, &fh), "MPI_File_open");
+    MPI_Datatype filetype = block_filetype<T>(h, row0, col0, rows, cols);
+    MPI_Datatype memtype = block_memtype<T>(h, rows, cols);
+    mpiw::check(MPI_File_set_view(fh, header_bytes, mpiw::datatype<T>(), filetype, "native", MPI_INFO_NULL),
+                "MPI_File_set_view");
+    mpiw::check(MPI_File_read_all(fh, block, rows > 0 && cols > 0 ? 1 : 0, memtype, MPI_STATUS_IGNORE),
+                "MPI_File_read_all");
+    MPI_Type_free(&memtype);
+    if (filetype != mpiw::datatype<T>()) {
+        MPI_Type_free(&filetype);
+    }
+    MPI_File_close(&fh);
+}
+
+// Collective over comm: create path as a rows x cols row-major matrix and write
+// each rank's block (row-major, rows * cols elements) at (row0, col0) into it.
+// The blocks must cover the matrix.
+template <typename T>
+void write_block(const char* path, MPI_Comm comm, int64_t total_rows, int64_t total_cols, int row0, int col0, int rows,
+                 int cols, const T* block) {
+    MPI_File fh;
+    int err = MPI_File_open(comm, path, MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &fh);
+    if (err != MPI_SUCCESS) {
+        fail(path, "cannot create");
+    }
+    mpiw::check(MPI_File_set_size(fh, header_bytes + total_rows * total_cols * (MPI_Offset)sizeof(T)),
+                "MPI_File_set_size");
+
+    Header h;
+    h.rows = total_rows;
+    h.cols = total_cols;
+    h.dtype = dtype_code<T>::value;
+    h.layout = row_major;
+    char raw[header_bytes] = {};
+    std::memcpy(raw, magic, sizeof(magic));
+    std::memcpy(raw + 8, &h.rows, 8);
+    std::memcpy(raw + 16, &h.cols, 8);
+    std::memcpy(raw + 24, &h.dtype, 4);
+    std::memcpy(raw + 28, &h.layout, 4);
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+    mpiw::check(MPI_File_write_at_all(fh, 0, raw, rank == 0 ? (int)header_bytes : 0, MPI_BYTE, MPI_STATUS_IGNORE),
+                "MPI_File_write_at_all");
+
+    MPI_Datatype filetype = block_filetype<T>(h, row0, col0, rows, cols);
+    mpiw::check(MPI_File_set_view(fh, header_bytes, mpiw::datatype<T>(), filetype, "native", MPI_INFO_NULL),
+                "MPI_File_set_view");
+    mpiw::check(MPI_File_write_all(fh, block, rows > 0 && cols > 0 ? rows * cols : 0, mpiw::datatype<T>(),
+                                   MPI_STATUS_IGNORE), "MPI_File_write_all");
+    if (filetype != mpiw::datatype<T>()) {
+        MPI_Type_free(&filetype);
+    }
+    MPI_File_close(&fh);
+}
+
+} // namespace matio
+
+#endif // MATRIX_IO_HPP
@@ -0,0 +1,364 @@
+#ifndef MPI_ASYNC_HPP
+#define MPI_ASYNC_HPP
+
+#include <mpi.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "mpi_wrap.hpp"
+
+// Futures with continuations for nonblocking MPI calls, header-only.
+//
+// An Engine owns the outstanding requests. track(request) hands back a
+// Future<MPI_Status> that becomes ready when MPI completes the request, and
+// future.then(f) returns a future for f's result: f runs as soon as the first
+// future is ready and gets its value (or nothing, if it takes no argument). If f
+// returns a future itself, say because it starts the next MPI call, then() waits
+// for that one too, so a pipeline is one chain:
+//
+//   mpia::Engine engine;
+//   mpia::iscatter(engine, all.data(), mine.data(), n, 0)
+//       .then([&] { partial = sum(mine); return mpia::ireduce(engine, &partial, &total, 1, MPI_SUM, 0); })
+//       .then([&] { report(total); });
+//
+// The engine checks all outstanding requests with one MPI_Testsome per
+// progress() call and runs the continuations of the completed ones. Progress is
+// cooperative by default: whoever calls progress(), wait() or get() drives it,
+// so the computation that is meant to overlap calls engine.progress() between
+// pieces of work. start_thread() instead drives it from a background thread,
+// which needs MPI_THREAD_MULTIPLE; continuations then run on that thread.
+//
+// Continuations run outside the engine's lock and may track new requests. A
+// future must not be waited for from inside a continuation.
+
+namespace mpia {
+
+class Engine;
+template <typename T> class Future;
+
+namespace detail {
+
+struct StateBase {
+    std::mutex mutex;
+    bool ready = false;
+    std::vector<std::function<void()>> continuations;
+
+    // Mark ready and run what was waiting, outside the lock
+    void complete() {
+        std::vector<std::function<void()>> run;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready = true;
+            run.swap(continuations);
+        }
+        for (auto& f : run) {
+            f();
+        }
+    }
+
+    // Run f once ready: right away if it already is
+    void on_ready(std::function<void()> f) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ready) {
+                continuations.push_back(std::move(f));
+                return;
+            }
+        }
+        f();
+    }
+
+    bool is_ready() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return ready;
+    }
+};
+
+template <typename T>
+struct State : StateBase {
+    T value{};
+};
+
+template <>
+struct State<void> : StateBase {};
+
+// Call f with the value of a ready state, or without arguments if f takes none
+template <typename T, typename F>
+auto call(F& f, State<T>& s) {
+    if constexpr (std::is_invocable<F&, T&>::value) {
+        return f(s.value);
+    } else {
+        return f();
+    }
+}
+
+template <typename F>
+auto call(F& f, State<void>&) {
+    return f();
+}
+
+template <typename R> struct unwrap { using type = R; };
+template <typename U> struct unwrap<Future<U>> { using type = U; };
+
+template <typename R> struct is_future : std::false_type {};
+template <typename U> struct is_future<Future<U>> : std::true_type {};
+
+} // namespace detail
+
+class Engine {
+public:
+    Engine() = default;
+
+    // Waits for every outstanding request, so no buffer is released while MPI still uses it
+    ~Engine() {
+        stop_thread();
+        while (pending() > 0) {
+            progress();
+        }
+    }
+
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+
+    // Future that becomes ready with the request's status when MPI completes it
+    Future<MPI_Status> track(MPI_Request request);
+
+    // Test every outstanding request once and run the continuations of those that
+    // completed; true if any did
+    bool progress() {
+        std::vector<std::shared_ptr<detail::State<MPI_Status>>> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (requests_.empty()) {
+                return false;
+            }
+            int n = (int)requests_.size(), completed = 0;
+            indices_.resize(n);
+            statuses_.resize(n);
+            mpiw::check(MPI_Testsome(n, requests_.data(), &completed, indices_.data(), statuses_.data()),
+                        "MPI_Testsome");
+            if (completed == MPI_UNDEFINED || completed == 0) {
+                return false;
+            }
+            for (int i = 0; i < completed; ++i) {
+                states_[indices_[i]]->value = statuses_[i];
+                done.push_back(std::move(states_[indices_[i]]));
+            }
+            // Completed entries are now MPI_REQUEST_NULL; keep the rest in order
+            size_t kept = 0;
+            for (size_t i = 0; i < requests_.size(); ++i) {
+                if (requests_[i] != MPI_REQUEST_NULL) {
+                    requests_[kept] = requests_[i];
+                    states_[kept] = std::move(states_[i]);
+                    ++kept;
+                }
+            }
+            requests_.resize(kept);
+            states_.resize(kept);
+        }
+        for (auto& s : done) {
+            s->complete();
+        }
+        return true;
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return requests_.size();
+    }
+
+    // Drive progress from a background thread; false (and no thread) without MPI_THREAD_MULTIPLE
+    bool start_thread() {
+        int provided;
+        MPI_Query_thread(&provided);
+        if (provided < MPI_THREAD_MULTIPLE || thread_.joinable()) {
+            return false;
+        }
+        stop_.store(false);
+        thread_ = std::thread([this] {
+            while (!stop_.load(std::memory_order_relaxed)) {
+                if (!progress()) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+        return true;
+    }
+
+    void stop_thread() {
+        if (thread_.joinable()) {
+            stop_.store(true);
+            thread_.join();
+        }
+    }
+
+    bool threaded() const { return thread_.joinable(); }
+
+private:
+    std::mutex mutex_;
+    std::vector<MPI_Request> requests_;
+    std::vector<std::shared_ptr<detail::State<MPI_Status>>> states_;
+    std::vector<int> indices_;
+    std::vector<MPI_Status> statuses_;
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+};
+
+template <typename T>
+class Future {
+public:
+    Future() = default;
+    Future(Engine* engine, std::shared_ptr<detail::State<T>> state) : engine_(engine), state_(std::move(state)) {}
+
+    bool valid() const { return state_ != nullptr; }
+    bool ready() const { return state_->is_ready(); }
+
+    // Drive the engine (or, with a progress thread, let it work) until ready
+    void wait() const {
+        while (!state_->is_ready()) {
+            if (engine_->threaded()) {
+                std::this_thread::yield();
+            } else {
+                engine_->progress();
+            }
+        }
+    }
+
+    template <typename U = T>
+    typename std::enable_if<!std::is_void<U>::value, U&>::type get() const {
+        wait();
+        return state_->value;
+    }
+
+    // Future for f(value) (or f()), flattened if f returns a future
+    template <typename F>
+    auto then(F f) const {
+        using R = decltype(detail::call(f, *state_));
+        using Out = typename detail::unwrap<R>::type;
+        auto next = std::make_shared<detail::State<Out>>();
+        auto state = state_;
+        state_->on_ready([state, next, f]() mutable {
+            if constexpr (detail::is_future<R>::value) {
+                R inner = detail::call(f, *state);
+                auto inner_state = inner.state_;
+                inner_state->on_ready([inner_state, next] {
+                    if constexpr (!std::is_void<Out>::value) {
+                        next->value = inner_state->value;
+                    }
+                    next->complete();
+                });
+            } else if constexpr (std::is_void<R>::value) {
+                detail::call(f, *state);
+                next->complete();
+            } else {
+                next->value = detail::call(f, *state);
+                next->complete();
+            }
+        });
+        return Future<Out>(engine_, next);
+    }
+
+private:
+    template <typename U> friend class Future;
+    template <typename U> friend Future<void> when_all(const std::vector<Future<U>>& futures);
+
+    Engine* engine_ = nullptr;
+    std::shared_ptr<detail::State<T>> state_;
+};
+
+inline Future<MPI_Status> Engine::track(MPI_Request request) {
+    auto state = std::make_shared<detail::State<MPI_Status>>();
+    if (request == MPI_REQUEST_NULL) {
+        state->ready = true;
+        return Future<MPI_Status>(this, state);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    requests_.push_back(request);
+    states_.push_back(state);
+    return Future<MPI_Status>(this, state);
+}
+
+// Ready once every one of the futures is; an empty list is ready at once
+template <typename T>
+Future<void> when_all(const std::vector<Future<T>>& futures) {
+    auto all = std::make_shared<detail::State<void>>();
+    Engine* engine = futures.empty() ? nullptr : futures.front().engine_;
+    auto left = std::make_shared<std::atomic<size_t>>(futures.size());
+    if (futures.empty()) {
+        all->ready = true;
+    }
+    for (const Future<T>& f : futures) {
+        f.state_->on_ready([all, left] {
+            if (left->fetch_sub(1) == 1) {
+                all->complete();
+            }
+        });
+    }
+    return Future<void>(engine, all);
+}
+
+// Typed nonblocking calls, in the style of mpi_wrap.hpp; anything else goes through track()
+
+template <typename T>
+inline Future<MPI_Status> isend(Engine& e, const T* data, int count, int dest, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    mpiw::check(MPI_Isend(data, count, mpiw::datatype<T>(), dest, tag, comm, &r), "MPI_Isend");
+    return e.track(r);
+}
+
+template <typename T>
+inline Future<MPI_Status> irecv(Engine& e, T* data, int count, int source, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    mpiw::check(MPI_Irecv(data, count, mpiw::datatype<T>(), source, tag, comm, &r), "MPI_Irecv");
+    return e.track(r);
+}
+
+template <typename T>
+inline Future<MPI_Status> ibcast(Engine& e, T* data, int count, int root, MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    mpiw::check(MPI_Ibcast(data, count, mpiw::datatype<T>(), root, comm, &r), "MPI_Ibcast");
+    return e.track(r);
+}
+
+template <typename T>
+inline Future<MPI_Status> ireduce(Engine& e, const T* send, T* recv, int count, MPI_Op op, int root,
+                                  MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    mpiw::check(MPI_Ireduce(send, recv, count, mpiw::datatype<T>(), op, root, comm, &r), "MPI_Ireduce");
+    return e.track(r);
+}
+
+template <typename T>
+inline Future<MPI_Status> iallreduce(Engine& e, const T* send, T* recv, int count, MPI_Op op,
+                                     MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    mpiw::check(MPI_Iallreduce(send, recv, count, mpiw::datatype<T>(), op, comm, &r), "MPI_Iallreduce");
+    return e.track(r);
+}
+
+template <typename T>
+inline Future<MPI_Status> iscatter(Engine& e, const T* send, T* recv, int count, int root,
+                                   MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    MPI_Datatype t = mpiw::datatype<T>();
+    mpiw::check(MPI_Iscatter(send, count, t, recv, count, t, root, comm, &r), "MPI_Iscatter");
+    return e.track(r);
+}
+
+template <typename T>
+inline Future<MPI_Status> igather(Engine& e, const T* send, T* recv, int count, int root,
+                                  MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    MPI_Datatype t = mpiw::datatype<T>();
+    mpiw::check(MPI_Igather(send, count, t, recv, count, t, root, comm, &r), "MPI_Igather");
+    return e.track(r);
+}
+
+} // namespace mpia
+
+#endif // MPI_ASYNC_HPP
@@ -0,0 +1,554 @@
+#ifndef MPI_COMPRESS_HPP
+#define MPI_COMPRESS_HPP
+
+#include <mpi.h>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+#include "mpi_wrap.hpp"
+
+// Lossless compression of integer arrays on the way through MPI, header-only.
+//
+// The data is cut into chunks (256 KB by default) and every chunk is encoded
+// with whichever of three codecs makes it smallest:
+//
+//   raw           the elements as they are
+//   delta         the first element, then the zigzag-coded differences between
+//                 neighbours, bit-packed at the width of the largest one: sorted
+//                 keys, timestamps and small-range values shrink to a few bits each
+//   rle           (value, run length) pairs: constant stretches and sparse data
+//
+// A Channel sends, receives and broadcasts through these chunks. The sender
+// encodes chunk k + 1 while chunk k is on the wire and the receivers decode
+// chunk k while chunk k + 1 is, so coding and transfer overlap.
+//
+// Whether compressing pays off depends on the link and the data. Under
+// Policy::adaptive the sender encodes the first chunk and compares the pipelined
+// compressed transfer, limited by the slowest of encoding, the link at the
+// measured ratio and decoding, against the plain transfer at the link's
+// bandwidth. The message goes raw if that is no slower, and without even the
+// sample if perfect compression would not be faster. calibrate() measures
+// the link and the broadcast bandwidth once. The codec throughputs are kept as
+// running averages of the chunks actually coded.
+//
+// Both sides must use the same element type and count. Chunks are in the
+// machine's byte order, so all ranks must share one.
+
+namespace mpic {
+
+enum class Policy { raw, compressed, adaptive };
+
+enum Codec : uint8_t { codec_raw = 0, codec_delta = 1, codec_rle = 2 };
+
+// Report a misuse of the channel and abort
+[[noreturn]] __attribute__((noinline, cold)) inline void fail(const char* what) {
+    std::cerr << "Compressed channel: " << what << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+    std::abort();
+}
+
+namespace detail {
+
+// Writes values of any width up to 64 bits, LSB first, in 32-bit words
+class BitWriter {
+public:
+    explicit BitWriter(char* out) : out_(out) {}
+
+    void put(uint64_t v, int width) {
+        while (width > 0) {
+            int take = std::min(width, 32);
+            acc_ |= (v & (~0ULL >> (64 - take))) << fill_;
+            fill_ += take;
+            v >>= take;
+            width -= take;
+            if (fill_ >= 32) {
+                word();
+            }
+        }
+    }
+
+    // Bytes written, the last partial word included
+    size_t finish() {
+        if (fill_ > 0) {
+            word();
+        }
+        return written_;
+    }
+
+private:
+    void word() {
+        uint32_t w = (uint32_t)acc_;
+        std::memcpy(out_ + written_, &w, sizeof(w));
+        written_ += sizeof(w);
+        acc_ >>= 32;
+        fill_ = std::max(0, fill_ - 32);
+    }
+
+    char* out_;
+    size_t written_ = 0;
+    uint64_t acc_ = 0;
+    int fill_ = 0;
+};
+
+class BitReader {
+public:
+    explicit BitReader(const char* in) : in_(in) {}
+
+    uint64_t get(int width) {
+        uint64_t v = 0;
+        for (int done = 0; done < width;) {
+            int take = std::min(width - done, 32);
+            if (fill_ < take) {
+                uint32_t w;
+                std::memcpy(&w, in_ + read_, sizeof(w));
+                read_ += sizeof(w);
+                acc_ |= (uint64_t)w << fill_;
+                fill_ += 32;
+            }
+            v |= (acc_ & (~0ULL >> (64 - take))) << done;
+            acc_ >>= take;
+            fill_ -= take;
+            done += take;
+        }
+        return v;
+    }
+
+private:
+    const char* in_;
+    size_t read_ = 0;
+    uint64_t acc_ = 0;
+    int fill_ = 0;
+};
+
+template <typename T>
+using Bits = typename std::make_unsigned<T>::type;
+
+// Differences wrap around in the unsigned type; zigzag maps small negative ones to small codes
+template <typename T>
+inline Bits<T> zigzag(Bits<T> d) {
+    typedef typename std::make_signed<Bits<T>>::type S;
+    return (Bits<T>)(d << 1) ^ (Bits<T>)((S)d >> (8 * sizeof(T) - 1));
+}
+
+template <typename T>
+inline Bits<T> unzigzag(Bits<T> z) {
+    return (z >> 1) ^ (Bits<T>)(0 - (z & 1));
+}
+
+inline int bit_width(uint64_t v) {
+    return v == 0 ? 0 : 64 - __builtin_clzll(v);
+}
+
+} // namespace detail
+
+// Largest encoding of n elements: raw plus the codec byte
+template <typename T>
+inline size_t max_encoded_bytes(size_t n) {
+    return 1 + n * sizeof(T);
+}
+
+// Encode n > 0 elements into out (room for max_encoded_bytes<T>(n)); returns the bytes used
+template <typename T>
+size_t encode(const T* x, size_t n, char* out) {
+    static_assert(std::is_integral<T>::value, "only integer arrays are compressed");
+    typedef detail::Bits<T> U;
+
+    // One pass sizes both codecs
+    U widest = 0;
+    size_t runs = 1;
+    for (size_t i = 1; i < n; ++i) {
+        widest |= detail::zigzag<T>((U)((U)x[i] - (U)x[i - 1]));
+        runs += x[i] != x[i - 1];
+    }
+    int width = detail::bit_width(widest);
+    size_t raw = max_encoded_bytes<T>(n);
+    size_t delta = 1 + sizeof(T) + 1 + 4 * (((n - 1) * width + 31) / 32);
+    size_t rle = 1 + sizeof(uint32_t) + runs * (sizeof(T) + sizeof(uint32_t));
+
+    if (delta <= rle && delta < raw) {
+        out[0] = codec_delta;
+        std::memcpy(out + 1, &x[0], sizeof(T));
+        out[1 + sizeof(T)] = (char)width;
+        detail::BitWriter w(out + 2 + sizeof(T));
+        for (size_t i = 1; i < n && width > 0; ++i) {
+            w.put(detail::zigzag<T>((U)((U)x[i] - (U)x[i - 1])), width);
+        }
+        return 2 + sizeof(T) + w.finish();
+    }
+    if (rle < raw) {
+        out[0] = codec_rle;
+        uint32_t count = (uint32_t)runs;
+        std::memcpy(out + 1, &count, sizeof(count));
+        char* at = out + 1 + sizeof(count);
+        for (size_t i = 0; i < n;) {
+            size_t j = i + 1;
+            while (j < n && x[j] == x[i]) {
+                ++j;
+            }
+            uint32_t length = (uint32_t)(j - i);
+            std::memcpy(at, &x[i], sizeof(T));
+            std::memcpy(at + sizeof(T), &length, sizeof(length));
+            at += sizeof(T) + sizeof(length);
+            i = j;
+        }
+        return rle;
+    }
+    out[0] = codec_raw;
+    std::memcpy(out + 1, x, n * sizeof(T));
+    return raw;
+}
+
+// Decode n elements that encode() wrote from as many
+template <typename T>
+void decode(const char* in, size_t n, T* x) {
+    typedef detail::Bits<T> U;
+    switch (in[0]) {
+    case codec_delta: {
+        T first;
+        std::memcpy(&first, in + 1, sizeof(T));
+        int width = (unsigned char)in[1 + sizeof(T)];
+        detail::BitReader r(in + 2 + sizeof(T));
+        U v = (U)first;
+        x[0] = first;
+        for (size_t i = 1; i < n; ++i) {
+            v += width > 0 ? detail::unzigzag<T>((U)r.get(width)) : 0;
+            x[i] = (T)v;
+        }
+        break;
+    }
+    case codec_rle: {
+        uint32_t runs;
+        std::memcpy(&runs, in + 1, sizeof(runs));
+        const char* at = in + 1 + sizeof(runs);
+        size_t i = 0;
+        for (uint32_t k = 0; k < runs; ++k) {
+            T value;
+            uint32_t length;
+            std::memcpy(&value, at, sizeof(T));
+            std::memcpy(&length, at + sizeof(T), sizeof(length));
+            at += sizeof(T) + sizeof(length);
+            std::fill(x + i, x + i + length, value);
+            i += length;
+        }
+        break;
+    }
+    case codec_raw:
+        std::memcpy(x, in + 1, n * sizeof(T));
+        break;
+    default:
+        fail("unknown codec in chunk");
+    }
+}
+
+class Channel {
+public:
+    struct Stats {
+        long long messages = 0, compressed = 0;  // Sent or broadcast from here, and how many compressed
+        long long raw_bytes = 0, wire_bytes = 0; // Their size, and what went on the wire
+    };
+
+    // Messages travel on a duplicate of comm, so they never match the caller's own
+    explicit Channel(MPI_Comm comm, size_t chunk_bytes = 256 << 10, Policy policy = Policy::adaptive)
+        : chunk_bytes_(std::min<size_t>(std::max<size_t>(chunk_bytes, 64), 64 << 20)), policy_(policy) {
+        mpiw::check(MPI_Comm_dup(comm, &comm_), "MPI_Comm_dup");
+    }
+
+    ~Channel() { MPI_Comm_free(&comm_); }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Collective: measure the bandwidth between ranks 0 and 1 and of a broadcast
+    // over all ranks with `bytes` messages, and the codecs on small-range integers
+    void calibrate(size_t bytes = 4 << 20) {
+        int rank, size;
+        MPI_Comm_rank(comm_, &rank);
+        MPI_Comm_size(comm_, &size);
+        std::vector<char> buf(bytes);
+        double rates[2] = {0.0, 0.0};  // Link, broadcast
+        for (int round = 0; round < 3; ++round) {
+            if (size > 1 && rank < 2) {
+                double start = MPI_Wtime();
+                if (rank == 0) {
+                    MPI_Send(buf.data(), (int)bytes, MPI_BYTE, 1, 0, comm_);
+                    MPI_Recv(buf.data(), (int)bytes, MPI_BYTE, 1, 0, comm_, MPI_STATUS_IGNORE);
+                } else {
+                    MPI_Recv(buf.data(), (int)bytes, MPI_BYTE, 0, 0, comm_, MPI_STATUS_IGNORE);
+                    MPI_Send(buf.data(), (int)bytes, MPI_BYTE, 0, 0, comm_);
+                }
+                rates[0] = std::max(rates[0], 2 * bytes / (MPI_Wtime() - start));
+            }
+            MPI_Barrier(comm_);
+            double start = MPI_Wtime(), elapsed;
+            MPI_Bcast(buf.data(), (int)bytes, MPI_BYTE, 0, comm_);
+            double mine = MPI_Wtime() - start;
+            MPI_Allreduce(&mine, &elapsed, 1, MPI_DOUBLE, MPI_MAX, comm_);
+            rates[1] = std::max(rates[1], bytes / elapsed);
+        }
+        MPI_Bcast(rates, 2, MPI_DOUBLE, 0, comm_);
+        // A single rank has no link; nothing is ever worth compressing for it
+        link_rate_ = size > 1 ? rates[0] : 1e15;
+        bcast_rate_ = size > 1 ? rates[1] : 1e15;
+
+        // Codec throughput, the same on every rank: the slowest one's
+        size_t n = chunk_bytes_ / sizeof(int);
+        std::vector<int> x(n), y(n);
+        std::vector<char> enc(max_encoded_bytes<int>(n));
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = (int)((i * 2654435761u) % 1000);
+        }
+        double codec[2] = {0.0, 0.0};
+        for (int round = 0; round < 3; ++round) {
+            double start = MPI_Wtime();
+            encode(x.data(), n, enc.data());
+            double mid = MPI_Wtime();
+            decode(enc.data(), n, y.data());
+            double end = MPI_Wtime();
+            codec[0] = std::max(codec[0], n * sizeof(int) / std::max(mid - start, 1e-9));
+            codec[1] = std::max(codec[1], n * sizeof(int) / std::max(end - mid, 1e-9));
+        }
+        MPI_Allreduce(MPI_IN_PLACE, codec, 2, MPI_DOUBLE, MPI_MIN, comm_);
+        encode_rate_ = codec[0];
+        decode_rate_ = codec[1];
+    }
+
+    template <typename T>
+    void send(const T* data, size_t count, int dest, int tag = 0) {
+        size_t n = chunk_elements<T>();
+        std::vector<char> bufs[2];
+        bufs[0].resize(max_encoded_bytes<T>(n));
+        // Sample the first chunk only if even perfect compression could pay off
+        size_t first = 0, sample = std::min(n, count) * sizeof(T);
+        bool compress = count > 0 && decide(count * sizeof(T), 0, sample, link_rate_);
+        if (compress) {
+            first = encode_chunk(data, std::min(n, count), bufs[0].data());
+            compress = decide(count * sizeof(T), first, sample, link_rate_);
+        }
+        long long header[3] = {(long long)count, compress, (long long)n};
+        mpiw::check(MPI_Send(header, 3, MPI_LONG_LONG, dest, tag, comm_), "MPI_Send");
+        account(count * sizeof(T), compress);
+        if (!compress) {
+            send_raw(data, count, dest, tag);
+            return;
+        }
+
+        // Encode chunk k + 1 while chunk k is in flight
+        bufs[1].resize(bufs[0].size());
+        MPI_Request requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+        size_t chunks = (count + n - 1) / n, bytes = first;
+        for (size_t k = 0; k < chunks; ++k) {
+            char* buf = bufs[k % 2].data();
+            if (k > 0) {
+                mpiw::check(MPI_Wait(&requests[k % 2], MPI_STATUS_IGNORE), "MPI_Wait");
+                bytes = encode_chunk(data + k * n, std::min(n, count - k * n), buf);
+            }
+            stats_.wire_bytes += (long long)bytes;
+            mpiw::check(MPI_Isend(buf, (int)bytes, MPI_BYTE, dest, tag, comm_, &requests[k % 2]), "MPI_Isend");
+        }
+        mpiw::check(MPI_Waitall(2, requests, MPI_STATUSES_IGNORE), "MPI_Waitall");
+    }
+
+    template <typename T>
+    void recv(T* data, size_t count, int source, int tag = 0) {
+        long long header[3];
+        mpiw::check(MPI_Recv(header, 3, MPI_LONG_LONG, source, tag, comm_, MPI_STATUS_IGNORE), "MPI_Recv");
+        if (header[0] != (long long)count) {
+            fail("received a message of a different length");
+        }
+        if (!header[1]) {
+            recv_raw(data, count, source, tag);
+            return;
+        }
+
+        // Decode chunk k while chunk k + 1 arrives
+        size_t n = (size_t)header[2], chunks = (count + n - 1) / n;
+        std::vector<char> bufs[2] = {std::vector<char>(max_encoded_bytes<T>(n)), std::vector<char>(max_encoded_bytes<T>(n))};
+        MPI_Request requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+        mpiw::check(MPI_Irecv(bufs[0].data(), (int)bufs[0].size(), MPI_BYTE, source, tag, comm_, &requests[0]),
+                    "MPI_Irecv");
+        for (size_t k = 0; k < chunks; ++k) {
+            mpiw::check(MPI_Wait(&requests[k % 2], MPI_STATUS_IGNORE), "MPI_Wait");
+            if (k + 1 < chunks) {
+                std::vector<char>& next = bufs[(k + 1) % 2];
+                mpiw::check(MPI_Irecv(next.data(), (int)next.size(), MPI_BYTE, source, tag, comm_,
+                                      &requests[(k + 1) % 2]), "MPI_Irecv");
+            }
+            decode_chunk(bufs[k % 2].data(), std::min(n, count - k * n), data + k * n);
+        }
+    }
+
+    // Collective; count must be the same on every rank
+    template <typename T>
+    void bcast(T* data, size_t count, int root) {
+        int rank;
+        MPI_Comm_rank(comm_, &rank);
+        size_t n = chunk_elements<T>();
+        std::vector<char> bufs[2];
+        bufs[0].resize(max_encoded_bytes<T>(n));
+        bufs[1].resize(bufs[0].size());
+        long long header[4] = {(long long)count, 0, (long long)n, 0};  // Count, compressed, chunk, first chunk's bytes
+        size_t sample = std::min(n, count) * sizeof(T);
+        if (rank == root && count > 0 && decide(count * sizeof(T), 0, sample, bcast_rate_)) {
+            header[3] = (long long)encode_chunk(data, std::min(n, count), bufs[0].data());
+            header[1] = decide(count * sizeof(T), (size_t)header[3], sample, bcast_rate_);
+        }
+        mpiw::check(MPI_Bcast(header, 4, MPI_LONG_LONG, root, comm_), "MPI_Bcast");
+        if (header[0] != (long long)count) {
+            fail("broadcast of different lengths on different ranks");
+        }
+        if (rank == root) {
+            account(count * sizeof(T), header[1]);
+        }
+        if (!header[1]) {
+            bcast_raw(data, count, root);
+            return;
+        }
+
+        // The root encodes chunk k + 1 and the others decode chunk k - 1 while
+        // chunk k is broadcast; each chunk's size is broadcast ahead of it
+        n = (size_t)header[2];
+        if (max_encoded_bytes<T>(n) > bufs[0].size()) {
+            bufs[0].resize(max_encoded_bytes<T>(n));
+            bufs[1].resize(max_encoded_bytes<T>(n));
+        }
+        size_t chunks = (count + n - 1) / n;
+        long long bytes = header[3];
+        MPI_Request requests[2] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+        for (size_t k = 0; k < chunks; ++k) {
+            if (rank == root) {
+                stats_.wire_bytes += bytes;
+            }
+            mpiw::check(MPI_Ibcast(bufs[k % 2].data(), (int)bytes, MPI_BYTE, root, comm_, &requests[k % 2]),
+                        "MPI_Ibcast");
+            int other = (k + 1) % 2;  // Holds chunk k - 1, and chunk k + 1 next
+            if (rank == root && k + 1 < chunks) {
+                mpiw::check(MPI_Wait(&requests[other], MPI_STATUS_IGNORE), "MPI_Wait");
+                bytes = (long long)encode_chunk(data + (k + 1) * n, std::min(n, count - (k + 1) * n),
+                                                bufs[other].data());
+            } else if (rank != root && k > 0) {
+                mpiw::check(MPI_Wait(&requests[other], MPI_STATUS_IGNORE), "MPI_Wait");
+                decode_chunk(bufs[other].data(), n, data + (k - 1) * n);
+            }
+            if (k + 1 < chunks) {
+                mpiw::check(MPI_Bcast(&bytes, 1, MPI_LONG_LONG, root, comm_), "MPI_Bcast");
+            }
+        }
+        mpiw::check(MPI_Waitall(2, requests, MPI_STATUSES_IGNORE), "MPI_Waitall");
+        if (rank != root) {
+            size_t last = chunks - 1;
+            decode_chunk(bufs[last % 2].data(), count - last * n, data + last * n);
+        }
+    }
+
+    Policy policy() const { return policy_; }
+    void set_policy(Policy policy) { policy_ = policy; }
+    size_t chunk_bytes() const { return chunk_bytes_; }
+
+    // Bytes per second
+    double link_bandwidth() const { return link_rate_; }
+    double bcast_bandwidth() const { return bcast_rate_; }
+    double encode_throughput() const { return encode_rate_; }
+    double decode_throughput() const { return decode_rate_; }
+
+    const Stats& stats() const { return stats_; }
+    void reset_stats() { stats_ = Stats(); }
+
+private:
+    template <typename T>
+    size_t chunk_elements() const {
+        return std::max<size_t>(1, chunk_bytes_ / sizeof(T));
+    }
+
+    // Running average over the chunks coded, in bytes per second
+    static void update(double& rate, size_t bytes, double seconds) {
+        if (seconds > 0.0) {
+            rate = 0.8 * rate + 0.2 * (bytes / seconds);
+        }
+    }
+
+    template <typename T>
+    size_t encode_chunk(const T* x, size_t n, char* out) {
+        double start = MPI_Wtime();
+        size_t bytes = encode(x, n, out);
+        update(encode_rate_, n * sizeof(T), MPI_Wtime() - start);
+        return bytes;
+    }
+
+    template <typename T>
+    void decode_chunk(const char* in, size_t n, T* x) {
+        double start = MPI_Wtime();
+        decode(in, n, x);
+        update(decode_rate_, n * sizeof(T), MPI_Wtime() - start);
+    }
+
+    // Compress a message of `bytes` whose first chunk of sample_bytes encoded to `encoded`, over a link of `rate`?
+    // With encoded = 0 the answer is for perfect compression, an upper bound on the gain
+    bool decide(size_t bytes, size_t encoded, size_t sample_bytes, double rate) const {
+        if (policy_ != Policy::adaptive) {
+            return policy_ == Policy::compressed;
+        }
+        double ratio = (double)encoded / sample_bytes;
+        double raw = bytes / rate;
+        // The pipeline runs at its slowest stage, plus filling and draining it by one chunk
+        double stage = std::min({encode_rate_, decode_rate_, ratio > 0.0 ? rate / ratio : rate * 1e6});
+        double chunk = (double)std::min(bytes, chunk_bytes_);
+        double compressed = bytes / stage + chunk / encode_rate_ + chunk / decode_rate_;
+        return compressed < raw;
+    }
+
+    void account(size_t bytes, bool compressed) {
+        ++stats_.messages;
+        stats_.compressed += compressed;
+        stats_.raw_bytes += (long long)bytes;
+        if (!compressed) {
+            stats_.wire_bytes += (long long)bytes;
+        }
+    }
+
+    // Plain messages of at most INT_MAX / 2 bytes
+    template <typename T>
+    size_t raw_piece() const {
+        return (INT_MAX / 2) / sizeof(T);
+    }
+
+    template <typename T>
+    void send_raw(const T* data, size_t count, int dest, int tag) {
+        for (size_t at = 0; at < count; at += raw_piece<T>()) {
+            int n = (int)std::min(raw_piece<T>(), count - at);
+            mpiw::check(MPI_Send(data + at, n * (int)sizeof(T), MPI_BYTE, dest, tag, comm_), "MPI_Send");
+        }
+    }
+
+    template <typename T>
+    void recv_raw(T* data, size_t count, int source, int tag) {
+        for (size_t at = 0; at < count; at += raw_piece<T>()) {
+            int n = (int)std::min(raw_piece<T>(), count - at);
+            mpiw::check(MPI_Recv(data + at, n * (int)sizeof(T), MPI_BYTE, source, tag, comm_, MPI_STATUS_IGNORE),
+                        "MPI_Recv");
+        }
+    }
+
+    template <typename T>
+    void bcast_raw(T* data, size_t count, int root) {
+        for (size_t at = 0; at < count; at += raw_piece<T>()) {
+            int n = (int)std::min(raw_piece<T>(), count - at);
+            mpiw::check(MPI_Bcast(data + at, n * (int)sizeof(T), MPI_BYTE, root, comm_), "MPI_Bcast");
+        }
+    }
+
+    MPI_Comm comm_;
+    size_t chunk_bytes_;
+    Policy policy_;
+    // Until calibrate(): a 10 GB/s link against 2 GB/s codecs, so adaptive rarely compresses
+    double link_rate_ = 10e9, bcast_rate_ = 10e9;
+    double encode_rate_ = 2e9, decode_rate_ = 2e9;
+    Stats stats_;
+};
+
+} // namespace mpic
+
+#endif // MPI_COMPRESS_HPP
@@ -0,0 +1,694 @@
+#include <mpi.h>
+#if MPI_VERSION < 4 && defined(OPEN_MPI)
+#include <mpi-ext.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+// MPI profiler for any of the e* programs, unmodified, through the PMPI
+// interface. Every intercepted MPI_X records its duration and the bytes this
+// rank contributes, then calls PMPI_X. Intercepted are all the calls the
+// programs and headers of this repository make that communicate, wait, poll or
+// synchronize: point-to-point, probes, completion, collectives, communicator and
+// window creation, one-sided operations and MPI-IO. Purely local calls (ranks,
+// datatypes, MPI_Wtime, attributes) are not, so their time counts as compute;
+// a program calling anything else should be added to MPI_PROF_CALLS.
+//
+// Each thread counts into its own statistics (calls, bytes, time and a log2
+// histogram of durations per call) and appends events to its own ring buffer,
+// which keeps the most recent MPI_PROF_EVENTS calls. Recording takes no lock,
+// allocates nothing and costs two clock reads. At MPI_Finalize, rank 0 collects
+// everything and writes two things:
+//   - a summary table on stderr: per call the count, bytes, time summed over
+//     ranks, the largest per-rank time and the median/99th percentile duration,
+//     and the split of each rank's wall time between MPI and everything else
+//   - a Chrome trace (chrome://tracing, ui.perfetto.dev) with one process per
+//     rank and one track per thread, in MPI_PROF_TRACE
+//
+// Build: mpicxx -O2 -shared -fPIC -o libmpi_prof.so mpi_prof.cpp
+// Run:   mpirun -np 8 -x LD_PRELOAD=$PWD/libmpi_prof.so ./e8 --n 2000 --m 2000 --k 2000
+//
+// Environment:
+//   MPI_PROF_EVENTS  events kept per thread (default 65536, 0 = no trace)
+//   MPI_PROF_TRACE   trace file (default mpi_prof_trace.json)
+//
+// Timestamps come from each node's monotonic clock, aligned at the barrier in
+// MPI_Init; across nodes the timeline is only as good as that alignment.
+
+namespace {
+
+// Persistent collectives: MPI 4, or Open MPI 4's MPIX_*_init (listed under the MPI 4 name)
+#if MPI_VERSION >= 4 || defined(OMPI_HAVE_MPI_EXT_PCOLLREQ)
+#define MPI_PROF_PCOLL_CALLS(X) X(Allreduce_init) X(Allgather_init)
+#else
+#define MPI_PROF_PCOLL_CALLS(X)
+#endif
+
+#define MPI_PROF_CALLS(X) \
+    X(Send) X(Recv) X(Isend) X(Irecv) X(Sendrecv) X(Send_init) X(Recv_init) X(Start) X(Startall) \
+    X(Probe) X(Iprobe) X(Improbe) X(Mrecv) \
+    X(Wait) X(Waitall) X(Waitany) X(Waitsome) X(Test) X(Testall) X(Testany) X(Testsome) X(Request_free) \
+    X(Barrier) X(Bcast) X(Ibcast) X(Reduce) X(Ireduce) X(Allreduce) X(Iallreduce) X(Reduce_scatter_block) \
+    X(Scatter) X(Iscatter) X(Gather) X(Igather) X(Allgather) X(Iallgather) X(Allgatherv) X(Alltoall) X(Alltoallv) \
+    MPI_PROF_PCOLL_CALLS(X) \
+    X(Comm_dup) X(Comm_split) X(Comm_split_type) X(Cart_create) X(Cart_sub) X(Comm_free) \
+    X(Win_create) X(Win_allocate) X(Win_allocate_shared) X(Win_free) \
+    X(Put) X(Get) X(Accumulate) X(Fetch_and_op) X(Compare_and_swap) \
+    X(Win_fence) X(Win_lock_all) X(Win_unlock_all) X(Win_flush) X(Win_flush_all) X(Win_sync) \
+    X(File_open) X(File_close) X(File_get_size) X(File_set_size) X(File_set_view) \
+    X(File_read_all) X(File_write_all) X(File_read_at_all) X(File_write_at_all) X(File_iread_at_all)
+
+enum Call {
+#define MPI_PROF_ENUM(name) call_##name,
+    MPI_PROF_CALLS(MPI_PROF_ENUM)
+#undef MPI_PROF_ENUM
+    call_count
+};
+
+const char* call_names[] = {
+#define MPI_PROF_NAME(name) "MPI_" #name,
+    MPI_PROF_CALLS(MPI_PROF_NAME)
+#undef MPI_PROF_NAME
+};
+
+const int hist_buckets = 40; // Bucket b holds calls of [2^b, 2^(b+1)) nanoseconds
+
+struct CallStats {
+    long long count, bytes, ns;
+    long long histogram[hist_buckets];
+};
+
+struct Event {
+    long long start_ns, duration_ns, bytes;
+    int call, thread;
+};
+
+struct ThreadState {
+    int thread;
+    CallStats stats[call_count];
+    std::vector<Event> ring;  // Event i lives at ring[i % ring.size()]
+    long long events = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+std::mutex registry_mutex;
+std::vector<ThreadState*> registry;  // Owned; freed at MPI_Finalize
+size_t ring_capacity = 65536;
+Clock::time_point epoch = Clock::now();
+bool active = false;  // Between MPI_Init and MPI_Finalize
+
+ThreadState* thread_state() {
+    static thread_local ThreadState* state = nullptr;
+    if (state == nullptr) {
+        state = new ThreadState();
+        memset(state->stats, 0, sizeof(state->stats));
+        state->ring.resize(ring_capacity);
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        state->thread = (int)registry.size();
+        registry.push_back(state);
+    }
+    return state;
+}
+
+long long now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count();
+}
+
+// Times one intercepted call from construction to record()
+class Scope {
+public:
+    explicit Scope(Call call) : call_(call), start_(now_ns()) {}
+
+    void record(long long bytes) {
+        if (!active) {
+            return;
+        }
+        long long duration = now_ns() - start_;
+        ThreadState* state = thread_state();
+        CallStats& s = state->stats[call_];
+        s.count++;
+        s.bytes += bytes;
+        s.ns += duration;
+        int bucket = duration < 2 ? 0 : 63 - __builtin_clzll((unsigned long long)duration);
+        s.histogram[bucket < hist_buckets ? bucket : hist_buckets - 1]++;
+        if (!state->ring.empty()) {
+            state->ring[state->events % state->ring.size()] = {start_, duration, bytes, call_, state->thread};
+            state->events++;
+        }
+    }
+
+private:
+    Call call_;
+    long long start_;
+};
+
+long long type_bytes(int count, MPI_Datatype type) {
+    if (count <= 0 || type == MPI_DATATYPE_NULL) {
+        return 0;
+    }
+    int size;
+    PMPI_Type_size(type, &size);
+    return (long long)count * size;
+}
+
+long long sum_counts(const int* counts, MPI_Datatype type, MPI_Comm comm) {
+    if (counts == nullptr) {
+        return 0;
+    }
+    int size;
+    PMPI_Comm_size(comm, &size);
+    long long total = 0;
+    for (int i = 0; i < size; ++i) {
+        total += counts[i];
+    }
+    return type_bytes(1, type) * total;
+}
+
+// Upper edge in nanoseconds of the bucket in which the given fraction of calls had finished
+double percentile(const long long* histogram, long long total, double fraction) {
+    long long seen = 0;
+    for (int b = 0; b < hist_buckets; ++b) {
+        seen += histogram[b];
+        if (seen >= fraction * total) {
+            return (double)(2LL << b);
+        }
+    }
+    return (double)(1LL << hist_buckets);
+}
+
+void start_profiling() {
+    const char* env = getenv("MPI_PROF_EVENTS");
+    if (env != nullptr) {
+        ring_capacity = (size_t)strtoull(env, nullptr, 10);
+    }
+    PMPI_Barrier(MPI_COMM_WORLD); // Common time origin for the trace
+    epoch = Clock::now();
+    active = true;
+}
+
+void print_summary(int rank, int size, double wall) {
+    // Per call: count, bytes, ns and histogram, summed over this rank's threads
+    const int fields = 3 + hist_buckets;
+    std::vector<long long> mine(call_count * fields, 0), total(call_count * fields), max_ns(call_count);
+    std::vector<long long> my_ns(call_count, 0);
+    long long mpi_ns = 0;
+    for (ThreadState* state : registry) {
+        for (int c = 0; c < call_count; ++c) {
+            const CallStats& s = state->stats[c];
+            long long* out = &mine[c * fields];
+            out[0] += s.count;
+            out[1] += s.bytes;
+            out[2] += s.ns;
+            for (int b = 0; b < hist_buckets; ++b) {
+                out[3 + b] += s.histogram[b];
+            }
+            my_ns[c] += s.ns;
+            mpi_ns += s.ns;
+        }
+    }
+    PMPI_Reduce(mine.data(), total.data(), call_count * fields, MPI_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    PMPI_Reduce(my_ns.data(), max_ns.data(), call_count, MPI_LONG_LONG, MPI_MAX, 0, MPI_COMM_WORLD);
+    double share = wall > 0.0 ? mpi_ns * 1e-9 / wall : 0.0;
+    std::vector<double> shares(size);
+    PMPI_Gather(&share, 1, MPI_DOUBLE, shares.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank != 0) {
+        return;
+    }
+
+    std::vector<int> order;
+    for (int c = 0; c < call_count; ++c) {
+        if (total[c * fields] > 0) {
+            order.push_back(c);
+        }
+    }
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return total[a * fields + 2] > total[b * fields + 2]; });
+    fprintf(stderr, "\nmpi_prof: %d ranks, %.3f s wall time\n", size, wall);
+    fprintf(stderr, "%-24s %12s %14s %12s %12s %10s %10s\n", "call", "calls", "bytes", "total_s", "max_rank_s",
+            "p50_us", "p99_us");
+    for (int c : order) {
+        const long long* t = &total[c * fields];
+        fprintf(stderr, "%-24s %12lld %14lld %12.6f %12.6f %10.2f %10.2f\n", call_names[c], t[0], t[1], t[2] * 1e-9,
+                max_ns[c] * 1e-9, percentile(t + 3, t[0], 0.5) / 1e3, percentile(t + 3, t[0], 0.99) / 1e3);
+    }
+    double lo = *std::min_element(shares.begin(), shares.end()), hi = *std::max_element(shares.begin(), shares.end());
+    double avg = 0.0;
+    for (double s : shares) {
+        avg += s / size;
+    }
+    fprintf(stderr, "MPI share of wall time per rank: min %.1f%%, avg %.1f%%, max %.1f%%; the rest (avg %.1f%%) is compute\n",
+            100 * lo, 100 * avg, 100 * hi, 100 * (1 - avg));
+}
+
+void write_trace(int rank, int size) {
+    // Every rank sends its events, oldest first, to rank 0
+    std::vector<Event> mine;
+    for (ThreadState* state : registry) {
+        size_t kept = (size_t)std::min<long long>(state->events, (long long)state->ring.size());
+        for (size_t i = 0; i < kept; ++i) {
+            mine.push_back(state->ring[(state->events - kept + i) % state->ring.size()]);
+        }
+    }
+    int bytes = (int)(mine.size() * sizeof(Event));
+    std::vector<int> counts(size), displs(size, 0);
+    PMPI_Gather(&bytes, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+    std::vector<Event> all;
+    if (rank == 0) {
+        for (int r = 1; r < size; ++r) {
+            displs[r] = displs[r - 1] + counts[r - 1];
+        }
+        all.resize((displs[size - 1] + counts[size - 1]) / sizeof(Event));
+    }
+    PMPI_Gatherv(mine.data(), bytes, MPI_BYTE, all.data(), counts.data(), displs.data(), MPI_BYTE, 0, MPI_COMM_WORLD);
+    if (rank != 0) {
+        return;
+    }
+
+    const char* path = getenv("MPI_PROF_TRACE");
+    path = path != nullptr ? path : "mpi_prof_trace.json";
+    FILE* f = fopen(path, "w");
+    if (f == nullptr) {
+        fprintf(stderr, "mpi_prof: cannot write %s\n", path);
+        return;
+    }
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first = true;
+    for (int r = 0; r < size; ++r) {
+        fprintf(f, "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"rank %d\"}}",
+                first ? "" : ",\n", r, r);
+        first = false;
+        for (size_t i = displs[r] / sizeof(Event); i < (displs[r] + counts[r]) / sizeof(Event); ++i) {
+            const Event& e = all[i];
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,"
+                       "\"args\":{\"bytes\":%lld}}",
+                    call_names[e.call], r, e.thread, e.start_ns / 1e3, e.duration_ns / 1e3, e.bytes);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    fprintf(stderr, "mpi_prof: trace of %zu calls written to %s\n", all.size(), path);
+}
+
+} // namespace
+
+#define PROFILE(name, bytes, ...) \
+    Scope scope(call_##name); \
+    int err = PMPI_##name(__VA_ARGS__); \
+    scope.record(bytes); \
+    return err
+
+extern "C" {
+
+int MPI_Init(int* argc, char*** argv) {
+    int err = PMPI_Init(argc, argv);
+    start_profiling();
+    return err;
+}
+
+int MPI_Init_thread(int* argc, char*** argv, int required, int* provided) {
+    int err = PMPI_Init_thread(argc, argv, required, provided);
+    start_profiling();
+    return err;
+}
+
+int MPI_Finalize(void) {
+    double wall = now_ns() * 1e-9;
+    active = false;
+    int rank, size;
+    PMPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    PMPI_Comm_size(MPI_COMM_WORLD, &size);
+    print_summary(rank, size, wall);
+    if (ring_capacity > 0) {
+        write_trace(rank, size);
+    }
+    for (ThreadState* state : registry) {
+        delete state;
+    }
+    registry.clear();
+    return PMPI_Finalize();
+}
+
+// Point-to-point
+
+int MPI_Send(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm) {
+    PROFILE(Send, type_bytes(count, type), buf, count, type, dest, tag, comm);
+}
+
+int MPI_Recv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Status* status) {
+    PROFILE(Recv, type_bytes(count, type), buf, count, type, source, tag, comm, status);
+}
+
+int MPI_Isend(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm, MPI_Request* request) {
+    PROFILE(Isend, type_bytes(count, type), buf, count, type, dest, tag, comm, request);
+}
+
+int MPI_Irecv(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request* request) {
+    PROFILE(Irecv, type_bytes(count, type), buf, count, type, source, tag, comm, request);
+}
+
+int MPI_Sendrecv(const void* sendbuf, int sendcount, MPI_Datatype sendtype, int dest, int sendtag, void* recvbuf,
+                 int recvcount, MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm, MPI_Status* status) {
+    PROFILE(Sendrecv, type_bytes(sendcount, sendtype), sendbuf, sendcount, sendtype, dest, sendtag, recvbuf, recvcount,
+            recvtype, source, recvtag, comm, status);
+}
+
+int MPI_Send_init(const void* buf, int count, MPI_Datatype type, int dest, int tag, MPI_Comm comm,
+                  MPI_Request* request) {
+    PROFILE(Send_init, 0, buf, count, type, dest, tag, comm, request);
+}
+
+int MPI_Recv_init(void* buf, int count, MPI_Datatype type, int source, int tag, MPI_Comm comm, MPI_Request* request) {
+    PROFILE(Recv_init, 0, buf, count, type, source, tag, comm, request);
+}
+
+int MPI_Start(MPI_Request* request) {
+    PROFILE(Start, 0, request);
+}
+
+int MPI_Startall(int count, MPI_Request requests[]) {
+    PROFILE(Startall, 0, count, requests);
+}
+
+int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status* status) {
+    PROFILE(Probe, 0, source, tag, comm, status);
+}
+
+int MPI_Iprobe(int source, int tag, MPI_Comm comm, int* flag, MPI_Status* status) {
+    PROFILE(Iprobe, 0, source, tag, comm, flag, status);
+}
+
+int MPI_Improbe(int source, int tag, MPI_Comm comm, int* flag, MPI_Message* message, MPI_Status* status) {
+    PROFILE(Improbe, 0, source, tag, comm, flag, message, status);
+}
+
+int MPI_Mrecv(void* buf, int count, MPI_Datatype type, MPI_Message* message, MPI_Status* status) {
+    PROFILE(Mrecv, type_bytes(count, type), buf, count, type, message, status);
+}
+
+// Completion
+
+int MPI_Wait(MPI_Request* request, MPI_Status* status) {
+    PROFILE(Wait, 0, request, status);
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[]) {
+    PROFILE(Waitall, 0, count, requests, statuses);
+}
+
+int MPI_Waitany(int count, MPI_Request requests[], int* index, MPI_Status* status) {
+    PROFILE(Waitany, 0, count, requests, index, status);
+}
+
+int MPI_Test(MPI_Request* request, int* flag, MPI_Status* status) {
+    PROFILE(Test, 0, request, flag, status);
+}
+
+int MPI_Waitsome(int count, MPI_Request requests[], int* outcount, int indices[], MPI_Status statuses[]) {
+    PROFILE(Waitsome, 0, count, requests, outcount, indices, statuses);
+}
+
+int MPI_Testall(int count, MPI_Request requests[], int* flag, MPI_Status statuses[]) {
+    PROFILE(Testall, 0, count, requests, flag, statuses);
+}
+
+int MPI_Testany(int count, MPI_Request requests[], int* index, int* flag, MPI_Status* status) {
+    PROFILE(Testany, 0, count, requests, index, flag, status);
+}
+
+int MPI_Testsome(int count, MPI_Request requests[], int* outcount, int indices[], MPI_Status statuses[]) {
+    PROFILE(Testsome, 0, count, requests, outcount, indices, statuses);
+}
+
+int MPI_Request_free(MPI_Request* request) {
+    PROFILE(Request_free, 0, request);
+}
+
+// Collectives; bytes are what this rank contributes
+
+int MPI_Barrier(MPI_Comm comm) {
+    PROFILE(Barrier, 0, comm);
+}
+
+int MPI_Bcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm) {
+    PROFILE(Bcast, type_bytes(count, type), buf, count, type, root, comm);
+}
+
+int MPI_Ibcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm, MPI_Request* request) {
+    PROFILE(Ibcast, type_bytes(count, type), buf, count, type, root, comm, request);
+}
+
+int MPI_Reduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm) {
+    PROFILE(Reduce, type_bytes(count, type), sendbuf, recvbuf, count, type, op, root, comm);
+}
+
+int MPI_Ireduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm,
+                MPI_Request* request) {
+    PROFILE(Ireduce, type_bytes(count, type), sendbuf, recvbuf, count, type, op, root, comm, request);
+}
+
+int MPI_Allreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+    PROFILE(Allreduce, type_bytes(count, type), sendbuf, recvbuf, count, type, op, comm);
+}
+
+int MPI_Iallreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm,
+                   MPI_Request* request) {
+    PROFILE(Iallreduce, type_bytes(count, type), sendbuf, recvbuf, count, type, op, comm, request);
+}
+
+int MPI_Reduce_scatter_block(const void* sendbuf, void* recvbuf, int recvcount, MPI_Datatype type, MPI_Op op,
+                             MPI_Comm comm) {
+    int size;
+    PMPI_Comm_size(comm, &size);
+    PROFILE(Reduce_scatter_block, type_bytes(recvcount, type) * size, sendbuf, recvbuf, recvcount, type, op, comm);
+}
+
+int MPI_Scatter(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+                MPI_Datatype recvtype, int root, MPI_Comm comm) {
+    PROFILE(Scatter, type_bytes(recvcount, recvtype), sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root,
+            comm);
+}
+
+int MPI_Iscatter(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+                 MPI_Datatype recvtype, int root, MPI_Comm comm, MPI_Request* request) {
+    PROFILE(Iscatter, type_bytes(recvcount, recvtype), sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root,
+            comm, request);
+}
+
+int MPI_Gather(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+               MPI_Datatype recvtype, int root, MPI_Comm comm) {
+    PROFILE(Gather, type_bytes(sendcount, sendtype), sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root,
+            comm);
+}
+
+int MPI_Igather(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+                MPI_Datatype recvtype, int root, MPI_Comm comm, MPI_Request* request) {
+    PROFILE(Igather, type_bytes(sendcount, sendtype), sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root,
+            comm, request);
+}
+
+int MPI_Allgather(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+                  MPI_Datatype recvtype, MPI_Comm comm) {
+    PROFILE(Allgather, type_bytes(sendcount, sendtype), sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+}
+
+int MPI_Iallgather(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+                   MPI_Datatype recvtype, MPI_Comm comm, MPI_Request* request) {
+    PROFILE(Iallgather, type_bytes(sendcount, sendtype), sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm,
+            request);
+}
+
+int MPI_Allgatherv(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, const int recvcounts[],
+                   const int displs[], MPI_Datatype recvtype, MPI_Comm comm) {
+    PROFILE(Allgatherv, type_bytes(sendcount, sendtype), sendbuf, sendcount, sendtype, recvbuf, recvcounts, displs,
+            recvtype, comm);
+}
+
+int MPI_Alltoall(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+                 MPI_Datatype recvtype, MPI_Comm comm) {
+    int size;
+    PMPI_Comm_size(comm, &size);
+    PROFILE(Alltoall, type_bytes(sendcount, sendtype) * size, sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype,
+            comm);
+}
+
+int MPI_Alltoallv(const void* sendbuf, const int sendcounts[], const int sdispls[], MPI_Datatype sendtype, void* recvbuf,
+                  const int recvcounts[], const int rdispls[], MPI_Datatype recvtype, MPI_Comm comm) {
+    PROFILE(Alltoallv, sum_counts(sendcounts, sendtype, comm), sendbuf, sendcounts, sdispls, sendtype, recvbuf,
+            recvcounts, rdispls, recvtype, comm);
+}
+
+#if MPI_VERSION >= 4
+int MPI_Allreduce_init(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm,
+                       MPI_Info info, MPI_Request* request) {
+    PROFILE(Allreduce_init, 0, sendbuf, recvbuf, count, type, op, comm, info, request);
+}
+
+int MPI_Allgather_init(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+                       MPI_Datatype recvtype, MPI_Comm comm, MPI_Info info, MPI_Request* request) {
+    PROFILE(Allgather_init, 0, sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, info, request);
+}
+#elif defined(OMPI_HAVE_MPI_EXT_PCOLLREQ)
+int MPIX_Allreduce_init(const void* sendbuf, void* recvbuf, int count, MPI_Datatype type, MPI_Op op, MPI_Comm comm,
+                        MPI_Info info, MPI_Request* request) {
+    Scope scope(call_Allreduce_init);
+    int err = PMPIX_Allreduce_init(sendbuf, recvbuf, count, type, op, comm, info, request);
+    scope.record(0);
+    return err;
+}
+
+int MPIX_Allgather_init(const void* sendbuf, int sendcount, MPI_Datatype sendtype, void* recvbuf, int recvcount,
+                        MPI_Datatype recvtype, MPI_Comm comm, MPI_Info info, MPI_Request* request) {
+    Scope scope(call_Allgather_init);
+    int err = PMPIX_Allgather_init(sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm, info, request);
+    scope.record(0);
+    return err;
+}
+#endif
+
+// Communicators and windows: collective over the communicator
+
+int MPI_Comm_dup(MPI_Comm comm, MPI_Comm* newcomm) {
+    PROFILE(Comm_dup, 0, comm, newcomm);
+}
+
+int MPI_Comm_split(MPI_Comm comm, int color, int key, MPI_Comm* newcomm) {
+    PROFILE(Comm_split, 0, comm, color, key, newcomm);
+}
+
+int MPI_Comm_split_type(MPI_Comm comm, int split_type, int key, MPI_Info info, MPI_Comm* newcomm) {
+    PROFILE(Comm_split_type, 0, comm, split_type, key, info, newcomm);
+}
+
+int MPI_Cart_create(MPI_Comm comm, int ndims, const int dims[], const int periods[], int reorder, MPI_Comm* newcomm) {
+    PROFILE(Cart_create, 0, comm, ndims, dims, periods, reorder, newcomm);
+}
+
+int MPI_Cart_sub(MPI_Comm comm, const int remain_dims[], MPI_Comm* newcomm) {
+    PROFILE(Cart_sub, 0, comm, remain_dims, newcomm);
+}
+
+int MPI_Comm_free(MPI_Comm* comm) {
+    PROFILE(Comm_free, 0, comm);
+}
+
+int MPI_Win_create(void* base, MPI_Aint bytes, int disp_unit, MPI_Info info, MPI_Comm comm, MPI_Win* win) {
+    PROFILE(Win_create, 0, base, bytes, disp_unit, info, comm, win);
+}
+
+int MPI_Win_allocate(MPI_Aint bytes, int disp_unit, MPI_Info info, MPI_Comm comm, void* base, MPI_Win* win) {
+    PROFILE(Win_allocate, 0, bytes, disp_unit, info, comm, base, win);
+}
+
+int MPI_Win_allocate_shared(MPI_Aint bytes, int disp_unit, MPI_Info info, MPI_Comm comm, void* base, MPI_Win* win) {
+    PROFILE(Win_allocate_shared, 0, bytes, disp_unit, info, comm, base, win);
+}
+
+int MPI_Win_free(MPI_Win* win) {
+    PROFILE(Win_free, 0, win);
+}
+
+// One-sided
+
+int MPI_Put(const void* origin, int origin_count, MPI_Datatype origin_type, int target, MPI_Aint disp, int target_count,
+            MPI_Datatype target_type, MPI_Win win) {
+    PROFILE(Put, type_bytes(origin_count, origin_type), origin, origin_count, origin_type, target, disp, target_count,
+            target_type, win);
+}
+
+int MPI_Get(void* origin, int origin_count, MPI_Datatype origin_type, int target, MPI_Aint disp, int target_count,
+            MPI_Datatype target_type, MPI_Win win) {
+    PROFILE(Get, type_bytes(origin_count, origin_type), origin, origin_count, origin_type, target, disp, target_count,
+            target_type, win);
+}
+
+int MPI_Accumulate(const void* origin, int origin_count, MPI_Datatype origin_type, int target, MPI_Aint disp,
+                   int target_count, MPI_Datatype target_type, MPI_Op op, MPI_Win win) {
+    PROFILE(Accumulate, type_bytes(origin_count, origin_type), origin, origin_count, origin_type, target, disp,
+            target_count, target_type, op, win);
+}
+
+int MPI_Fetch_and_op(const void* origin, void* result, MPI_Datatype type, int target, MPI_Aint disp, MPI_Op op,
+                     MPI_Win win) {
+    PROFILE(Fetch_and_op, type_bytes(1, type), origin, result, type, target, disp, op, win);
+}
+
+int MPI_Compare_and_swap(const void* origin, const void* compare, void* result, MPI_Datatype type, int target,
+                         MPI_Aint disp, MPI_Win win) {
+    PROFILE(Compare_and_swap, type_bytes(1, type), origin, compare, result, type, target, disp, win);
+}
+
+int MPI_Win_fence(int assertion, MPI_Win win) {
+    PROFILE(Win_fence, 0, assertion, win);
+}
+
+int MPI_Win_lock_all(int assertion, MPI_Win win) {
+    PROFILE(Win_lock_all, 0, assertion, win);
+}
+
+int MPI_Win_unlock_all(MPI_Win win) {
+    PROFILE(Win_unlock_all, 0, win);
+}
+
+int MPI_Win_flush(int rank, MPI_Win win) {
+    PROFILE(Win_flush, 0, rank, win);
+}
+
+int MPI_Win_flush_all(MPI_Win win) {
+    PROFILE(Win_flush_all, 0, win);
+}
+
+int MPI_Win_sync(MPI_Win win) {
+    PROFILE(Win_sync, 0, win);
+}
+
+// MPI-IO; bytes are what this rank reads or writes
+
+int MPI_File_open(MPI_Comm comm, const char* filename, int amode, MPI_Info info, MPI_File* fh) {
+    PROFILE(File_open, 0, comm, filename, amode, info, fh);
+}
+
+int MPI_File_close(MPI_File* fh) {
+    PROFILE(File_close, 0, fh);
+}
+
+int MPI_File_get_size(MPI_File fh, MPI_Offset* bytes) {
+    PROFILE(File_get_size, 0, fh, bytes);
+}
+
+int MPI_File_set_size(MPI_File fh, MPI_Offset bytes) {
+    PROFILE(File_set_size, 0, fh, bytes);
+}
+
+int MPI_File_set_view(MPI_File fh, MPI_Offset disp, MPI_Datatype etype, MPI_Datatype filetype, const char* datarep,
+                      MPI_Info info) {
+    PROFILE(File_set_view, 0, fh, disp, etype, filetype, datarep, info);
+}
+
+int MPI_File_read_all(MPI_File fh, void* buf, int count, MPI_Datatype type, MPI_Status* status) {
+    PROFILE(File_read_all, type_bytes(count, type), fh, buf, count, type, status);
+}
+
+int MPI_File_write_all(MPI_File fh, const void* buf, int count, MPI_Datatype type, MPI_Status* status) {
+    PROFILE(File_write_all, type_bytes(count, type), fh, buf, count, type, status);
+}
+
+int MPI_File_read_at_all(MPI_File fh, MPI_Offset offset, void* buf, int count, MPI_Datatype type, MPI_Status* status) {
+    PROFILE(File_read_at_all, type_bytes(count, type), fh, offset, buf, count, type, status);
+}
+
+int MPI_File_write_at_all(MPI_File fh, MPI_Offset offset, const void* buf, int count, MPI_Datatype type,
+                          MPI_Status* status) {
+    PROFILE(File_write_at_all, type_bytes(count, type), fh, offset, buf, count, type, status);
+}
+
+int MPI_File_iread_at_all(MPI_File fh, MPI_Offset offset, void* buf, int count, MPI_Datatype type,
+                          MPI_Request* request) {
+    PROFILE(File_iread_at_all, type_bytes(count, type), fh, offset, buf, count, type, request);
+}
+
+} // extern "C"
@@ -0,0 +1,383 @@
+#ifndef MPI_WRAP_HPP
+#define MPI_WRAP_HPP
+
+#include <mpi.h>
+#include <iostream>
+#include <array>
+#include <vector>
+#include <string>
+#include <utility>
+#include <type_traits>
+#include <cstdlib>
+#if __has_include(<span>)
+#include <span>
+#endif
+
+// Thin typed layer over the MPI C API, header-only.
+//
+// - datatype<T>() maps C++ element types to MPI_Datatype at compile time through
+//   the mpi_type<T> trait; using an unmapped type is a compile error.
+// - send/recv/bcast/reduce/... take a pointer and count, a single value, or any
+//   contiguous container (std::vector, std::array, std::string, std::span).
+// - Request and Comm are move-only RAII owners of MPI_Request and MPI_Comm.
+// - Every call is checked; a failure prints MPI_Error_string for the code and
+//   aborts. The success path is one comparison and no allocation.
+//
+// Everything is inline, so each call compiles down to the raw MPI call.
+
+namespace mpiw {
+
+// C++ element type -> MPI datatype
+template <typename T> struct mpi_type;
+#define MPIW_TYPE(T, D) \
+    template <> struct mpi_type<T> { static MPI_Datatype get() { return D; } }
+MPIW_TYPE(char, MPI_CHAR);
+MPIW_TYPE(signed char, MPI_SIGNED_CHAR);
+MPIW_TYPE(unsigned char, MPI_UNSIGNED_CHAR);
+MPIW_TYPE(short, MPI_SHORT);
+MPIW_TYPE(unsigned short, MPI_UNSIGNED_SHORT);
+MPIW_TYPE(int, MPI_INT);
+MPIW_TYPE(unsigned, MPI_UNSIGNED);
+MPIW_TYPE(long, MPI_LONG);
+MPIW_TYPE(unsigned long, MPI_UNSIGNED_LONG);
+MPIW_TYPE(long long, MPI_LONG_LONG);
+MPIW_TYPE(unsigned long long, MPI_UNSIGNED_LONG_LONG);
+MPIW_TYPE(float, MPI_FLOAT);
+MPIW_TYPE(double, MPI_DOUBLE);
+MPIW_TYPE(long double, MPI_LONG_DOUBLE);
+MPIW_TYPE(bool, MPI_CXX_BOOL);
+#undef MPIW_TYPE
+
+template <typename T, typename = void>
+struct has_mpi_type : std::false_type {};
+template <typename T>
+struct has_mpi_type<T, decltype((void)mpi_type<T>::get())> : std::true_type {};
+
+template <typename T>
+inline MPI_Datatype datatype() {
+    static_assert(has_mpi_type<T>::value, "no MPI datatype for this element type");
+    return mpi_type<T>::get();
+}
+
+// Report a failed MPI call and abort; kept out of line so callers stay small
+[[noreturn]] __attribute__((noinline, cold)) inline void fail(int err, const char* what) {
+    char text[MPI_MAX_ERROR_STRING];
+    int len = 0;
+    if (MPI_Error_string(err, text, &len) != MPI_SUCCESS) {
+        len = 0;
+    }
+    text[len] = '\0';
+    std::cerr << "MPI Error in " << what << ": " << text << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, err);
+    std::abort();
+}
+
+inline void check(int err, const char* what = "MPI call") {
+    if (__builtin_expect(err != MPI_SUCCESS, 0)) {
+        fail(err, what);
+    }
+}
+
+// Contiguous view of a buffer argument: a single value of a mapped type, or a
+// container with data() and size()
+template <typename T>
+struct View {
+    T* data;
+    int count;
+};
+
+template <typename T, typename std::enable_if<has_mpi_type<typename std::remove_const<T>::type>::value, int>::type = 0>
+inline View<T> view(T& value) {
+    return {&value, 1};
+}
+
+template <typename C, typename std::enable_if<!has_mpi_type<typename std::remove_const<C>::type>::value, int>::type = 0>
+inline auto view(C& container) -> View<typename std::remove_reference<decltype(*container.data())>::type> {
+    return {container.data(), (int)container.size()};
+}
+
+// Buffer-form overloads take values and containers; a raw pointer goes to the
+// (pointer, count) form instead
+template <typename B>
+using if_buffer = typename std::enable_if<!std::is_pointer<typename std::decay<B>::type>::value, int>::type;
+
+template <typename T>
+inline MPI_Datatype datatype_of(const View<T>&) {
+    return datatype<typename std::remove_const<T>::type>();
+}
+
+// Move-only owner of a nonblocking request; an active request is waited for on
+// destruction so its buffer cannot be released while MPI still uses it
+class Request {
+public:
+    Request() = default;
+    explicit Request(MPI_Request r) : handle_(r) {}
+    Request(Request&& other) noexcept : handle_(std::exchange(other.handle_, MPI_REQUEST_NULL)) {}
+    Request& operator=(Request&& other) noexcept {
+        if (this != &other) {
+            complete();
+            handle_ = std::exchange(other.handle_, MPI_REQUEST_NULL);
+        }
+        return *this;
+    }
+    Request(const Request&) = delete;
+    Request& operator=(const Request&) = delete;
+    ~Request() { complete(); }
+
+    MPI_Status wait() {
+        MPI_Status status;
+        check(MPI_Wait(&handle_, &status), "MPI_Wait");
+        return status;
+    }
+
+    bool test() {
+        int flag;
+        check(MPI_Test(&handle_, &flag, MPI_STATUS_IGNORE), "MPI_Test");
+        return flag != 0;
+    }
+
+    bool active() const { return handle_ != MPI_REQUEST_NULL; }
+    MPI_Request* get() { return &handle_; }
+
+private:
+    void complete() {
+        if (handle_ != MPI_REQUEST_NULL) {
+            MPI_Wait(&handle_, MPI_STATUS_IGNORE);
+        }
+    }
+
+    MPI_Request handle_ = MPI_REQUEST_NULL;
+};
+
+// Wait for / test a fixed set of requests with a single MPI call
+template <size_t N>
+inline void wait_all(Request (&requests)[N]) {
+    std::array<MPI_Request, N> handles;
+    for (size_t i = 0; i < N; ++i) {
+        handles[i] = *requests[i].get();
+    }
+    check(MPI_Waitall((int)N, handles.data(), MPI_STATUSES_IGNORE), "MPI_Waitall");
+    for (size_t i = 0; i < N; ++i) {
+        *requests[i].get() = handles[i];
+    }
+}
+
+template <size_t N>
+inline bool test_all(Request (&requests)[N]) {
+    std::array<MPI_Request, N> handles;
+    for (size_t i = 0; i < N; ++i) {
+        handles[i] = *requests[i].get();
+    }
+    int flag;
+    check(MPI_Testall((int)N, handles.data(), &flag, MPI_STATUSES_IGNORE), "MPI_Testall");
+    for (size_t i = 0; i < N; ++i) {
+        *requests[i].get() = handles[i];
+    }
+    return flag != 0;
+}
+
+inline void wait_all(std::vector<Request>& requests) {
+    for (Request& r : requests) {
+        r.wait();
+    }
+}
+
+// Move-only communicator; frees what it owns (dup/split results), never the predefined ones
+class Comm {
+public:
+    Comm(MPI_Comm c = MPI_COMM_WORLD, bool owned = false) : handle_(c), owned_(owned) {}
+    Comm(Comm&& other) noexcept
+        : handle_(std::exchange(other.handle_, MPI_COMM_NULL)), owned_(std::exchange(other.owned_, false)) {}
+    Comm& operator=(Comm&& other) noexcept {
+        if (this != &other) {
+            release();
+            handle_ = std::exchange(other.handle_, MPI_COMM_NULL);
+            owned_ = std::exchange(other.owned_, false);
+        }
+        return *this;
+    }
+    Comm(const Comm&) = delete;
+    Comm& operator=(const Comm&) = delete;
+    ~Comm() { release(); }
+
+    static Comm world() { return Comm(MPI_COMM_WORLD); }
+
+    int rank() const {
+        int r;
+        check(MPI_Comm_rank(handle_, &r), "MPI_Comm_rank");
+        return r;
+    }
+
+    int size() const {
+        int s;
+        check(MPI_Comm_size(handle_, &s), "MPI_Comm_size");
+        return s;
+    }
+
+    Comm dup() const {
+        MPI_Comm c;
+        check(MPI_Comm_dup(handle_, &c), "MPI_Comm_dup");
+        return Comm(c, true);
+    }
+
+    Comm split(int color, int key) const {
+        MPI_Comm c;
+        check(MPI_Comm_split(handle_, color, key, &c), "MPI_Comm_split");
+        return Comm(c, c != MPI_COMM_NULL);
+    }
+
+    bool null() const { return handle_ == MPI_COMM_NULL; }
+    MPI_Comm get() const { return handle_; }
+    operator MPI_Comm() const { return handle_; }
+
+private:
+    void release() {
+        if (owned_ && handle_ != MPI_COMM_NULL) {
+            MPI_Comm_free(&handle_);
+        }
+        owned_ = false;
+    }
+
+    MPI_Comm handle_;
+    bool owned_;
+};
+
+// Point-to-point
+
+template <typename T>
+inline void send(const T* data, int count, int dest, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    check(MPI_Send(data, count, datatype<T>(), dest, tag, comm), "MPI_Send");
+}
+
+template <typename B, if_buffer<B> = 0>
+inline void send(const B& buf, int dest, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    auto v = view(buf);
+    check(MPI_Send(v.data, v.count, datatype_of(v), dest, tag, comm), "MPI_Send");
+}
+
+template <typename T>
+inline MPI_Status recv(T* data, int count, int source, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Status status;
+    check(MPI_Recv(data, count, datatype<T>(), source, tag, comm, &status), "MPI_Recv");
+    return status;
+}
+
+template <typename B, if_buffer<B> = 0>
+inline MPI_Status recv(B& buf, int source, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    auto v = view(buf);
+    MPI_Status status;
+    check(MPI_Recv(v.data, v.count, datatype_of(v), source, tag, comm, &status), "MPI_Recv");
+    return status;
+}
+
+template <typename T>
+[[nodiscard]] inline Request isend(const T* data, int count, int dest, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    check(MPI_Isend(data, count, datatype<T>(), dest, tag, comm, &r), "MPI_Isend");
+    return Request(r);
+}
+
+template <typename B, if_buffer<B> = 0>
+[[nodiscard]] inline Request isend(const B& buf, int dest, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    auto v = view(buf);
+    return isend(v.data, v.count, dest, tag, comm);
+}
+
+template <typename T>
+[[nodiscard]] inline Request irecv(T* data, int count, int source, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    check(MPI_Irecv(data, count, datatype<T>(), source, tag, comm, &r), "MPI_Irecv");
+    return Request(r);
+}
+
+template <typename B, if_buffer<B> = 0>
+[[nodiscard]] inline Request irecv(B& buf, int source, int tag, MPI_Comm comm = MPI_COMM_WORLD) {
+    auto v = view(buf);
+    return irecv(v.data, v.count, source, tag, comm);
+}
+
+// Collectives
+
+template <typename T>
+inline void bcast(T* data, int count, int root, MPI_Comm comm = MPI_COMM_WORLD) {
+    check(MPI_Bcast(data, count, datatype<T>(), root, comm), "MPI_Bcast");
+}
+
+template <typename B, if_buffer<B> = 0>
+inline void bcast(B& buf, int root, MPI_Comm comm = MPI_COMM_WORLD) {
+    auto v = view(buf);
+    bcast(v.data, v.count, root, comm);
+}
+
+template <typename T>
+[[nodiscard]] inline Request ibcast(T* data, int count, int root, MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    check(MPI_Ibcast(data, count, datatype<T>(), root, comm, &r), "MPI_Ibcast");
+    return Request(r);
+}
+
+template <typename T>
+inline void reduce(const T* send_data, T* recv_data, int count, MPI_Op op, int root, MPI_Comm comm = MPI_COMM_WORLD) {
+    check(MPI_Reduce(send_data, recv_data, count, datatype<T>(), op, root, comm), "MPI_Reduce");
+}
+
+// Reduce a value or container; result only meaningful on root
+template <typename B, if_buffer<B> = 0>
+inline void reduce(const B& send_buf, B& recv_buf, MPI_Op op, int root, MPI_Comm comm = MPI_COMM_WORLD) {
+    auto s = view(send_buf);
+    auto r = view(recv_buf);
+    reduce(s.data, r.data, s.count, op, root, comm);
+}
+
+template <typename T>
+[[nodiscard]] inline Request ireduce(const T* send_data, T* recv_data, int count, MPI_Op op, int root,
+                                     MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    check(MPI_Ireduce(send_data, recv_data, count, datatype<T>(), op, root, comm, &r), "MPI_Ireduce");
+    return Request(r);
+}
+
+template <typename T>
+inline void allreduce(const T* send_data, T* recv_data, int count, MPI_Op op, MPI_Comm comm = MPI_COMM_WORLD) {
+    check(MPI_Allreduce(send_data, recv_data, count, datatype<T>(), op, comm), "MPI_Allreduce");
+}
+
+template <typename B, if_buffer<B> = 0>
+inline void allreduce(const B& send_buf, B& recv_buf, MPI_Op op, MPI_Comm comm = MPI_COMM_WORLD) {
+    auto s = view(send_buf);
+    auto r = view(recv_buf);
+    allreduce(s.data, r.data, s.count, op, comm);
+}
+
+// Scatter/gather count elements per rank
+template <typename T>
+inline void scatter(const T* send_data, T* recv_data, int count, int root, MPI_Comm comm = MPI_COMM_WORLD) {
+    check(MPI_Scatter(send_data, count, datatype<T>(), recv_data, count, datatype<T>(), root, comm), "MPI_Scatter");
+}
+
+template <typename T>
+[[nodiscard]] inline Request iscatter(const T* send_data, T* recv_data, int count, int root,
+                                      MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    check(MPI_Iscatter(send_data, count, datatype<T>(), recv_data, count, datatype<T>(), root, comm, &r),
+          "MPI_Iscatter");
+    return Request(r);
+}
+
+template <typename T>
+inline void gather(const T* send_data, T* recv_data, int count, int root, MPI_Comm comm = MPI_COMM_WORLD) {
+    check(MPI_Gather(send_data, count, datatype<T>(), recv_data, count, datatype<T>(), root, comm), "MPI_Gather");
+}
+
+template <typename T>
+[[nodiscard]] inline Request igather(const T* send_data, T* recv_data, int count, int root,
+                                     MPI_Comm comm = MPI_COMM_WORLD) {
+    MPI_Request r;
+    check(MPI_Igather(send_data, count, datatype<T>(), recv_data, count, datatype<T>(), root, comm, &r),
+          "MPI_Igather");
+    return Request(r);
+}
+
+} // namespace mpiw
+
+#endif // MPI_WRAP_HPP
@@ -0,0 +1,227 @@
+#ifndef MSG_AGGREGATOR_HPP
+#define MSG_AGGREGATOR_HPP
+
+#include <mpi.h>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "mpi_wrap.hpp"
+
+// Aggregation of small messages into large ones, header-only.
+//
+// send(dest, handler, data, bytes) appends a record to a buffer kept per
+// destination instead of sending it. A buffer goes out as one MPI message when
+// it would exceed the size threshold, when poll() finds it older than the time
+// threshold, or on flush(). The receiver splits each message back into records
+// and calls the handler registered under the record's id with the payload, so
+// every record pays a 6-byte header instead of a whole MPI message.
+//
+// poll() receives and dispatches whatever has arrived, retires completed sends
+// and applies the time threshold; call it regularly (every few sends is enough).
+// Handlers run inside poll() and may send again. finish() is collective: it
+// flushes and polls until every record sent on any rank, including those sent by
+// handlers meanwhile, has been dispatched.
+//
+// A payload that does not fit in an empty buffer travels as a message of its
+// own. Records between two ranks are dispatched in the order they were sent.
+// Not thread-safe: one aggregator per thread that calls MPI.
+
+class MessageAggregator {
+public:
+    using Handler = std::function<void(int source, const void* data, size_t bytes)>;
+
+    // Messages use `tag` on a duplicate of comm, so they never match the caller's own messages
+    explicit MessageAggregator(MPI_Comm comm, size_t buffer_bytes = 8192, double flush_interval = 1e-3, int tag = 0)
+        : buffer_bytes_(buffer_bytes), flush_interval_(flush_interval), tag_(tag) {
+        mpiw::check(MPI_Comm_dup(comm, &comm_), "MPI_Comm_dup");
+        int size;
+        MPI_Comm_size(comm_, &size);
+        buffers_.resize(size);
+        batches_to_.assign(size, 0);
+    }
+
+    ~MessageAggregator() {
+        for (InFlight& f : in_flight_) {
+            MPI_Wait(&f.request, MPI_STATUS_IGNORE);
+        }
+        MPI_Comm_free(&comm_);
+    }
+
+    MessageAggregator(const MessageAggregator&) = delete;
+    MessageAggregator& operator=(const MessageAggregator&) = delete;
+
+    // Returns the id to pass to send()
+    int register_handler(Handler handler) {
+        handlers_.push_back(std::move(handler));
+        return (int)handlers_.size() - 1;
+    }
+
+    void send(int dest, int handler, const void* data, size_t bytes) {
+        Buffer& b = buffers_[dest];
+        size_t record = header_bytes + bytes;
+        if (!b.data.empty() && b.data.size() + record > buffer_bytes_) {
+            flush(dest);
+        }
+        if (b.data.empty()) {
+            b.data = take_buffer();
+            b.since = MPI_Wtime();
+        }
+        size_t at = b.data.size();
+        uint32_t length = (uint32_t)bytes;
+        uint16_t id = (uint16_t)handler;
+        b.data.resize(at + record);
+        std::memcpy(&b.data[at], &length, sizeof(length));
+        std::memcpy(&b.data[at + sizeof(length)], &id, sizeof(id));
+        if (bytes > 0) {
+            std::memcpy(&b.data[at + header_bytes], data, bytes);
+        }
+        ++records_sent_;
+        if (b.data.size() >= buffer_bytes_) {
+            flush(dest);
+        }
+    }
+
+    // Send the buffered records for dest now
+    void flush(int dest) {
+        Buffer& b = buffers_[dest];
+        if (b.data.empty()) {
+            return;
+        }
+        in_flight_.emplace_back();
+        InFlight& f = in_flight_.back();
+        f.data = std::move(b.data);
+        b.data = std::vector<char>();
+        mpiw::check(MPI_Isend(f.data.data(), (int)f.data.size(), MPI_BYTE, dest, tag_, comm_, &f.request), "MPI_Isend");
+        ++batches_to_[dest];
+        ++batches_sent_;
+        bytes_sent_ += (long long)f.data.size();
+    }
+
+    void flush() {
+        for (int dest = 0; dest < (int)buffers_.size(); ++dest) {
+            flush(dest);
+        }
+    }
+
+    // Dispatch arrived messages, retire completed sends and flush buffers older than the time threshold
+    void poll() {
+        for (;;) {
+            int found;
+            MPI_Message message;
+            MPI_Status status;
+            mpiw::check(MPI_Improbe(MPI_ANY_SOURCE, tag_, comm_, &found, &message, &status), "MPI_Improbe");
+            if (!found) {
+                break;
+            }
+            int bytes;
+            MPI_Get_count(&status, MPI_BYTE, &bytes);
+            recv_buf_.resize(bytes);
+            mpiw::check(MPI_Mrecv(recv_buf_.data(), bytes, MPI_BYTE, &message, MPI_STATUS_IGNORE), "MPI_Mrecv");
+            ++batches_received_;
+            dispatch(status.MPI_SOURCE, bytes);
+        }
+
+        for (size_t i = 0; i < in_flight_.size();) {
+            int done;
+            mpiw::check(MPI_Test(&in_flight_[i].request, &done, MPI_STATUS_IGNORE), "MPI_Test");
+            if (done) {
+                spare_.push_back(std::move(in_flight_[i].data));
+                in_flight_[i] = std::move(in_flight_.back());
+                in_flight_.pop_back();
+            } else {
+                ++i;
+            }
+        }
+
+        double now = MPI_Wtime();
+        for (int dest = 0; dest < (int)buffers_.size(); ++dest) {
+            if (!buffers_[dest].data.empty() && now - buffers_[dest].since >= flush_interval_) {
+                flush(dest);
+            }
+        }
+    }
+
+    // Collective: return once every record sent so far on any rank has been dispatched
+    void finish() {
+        for (;;) {
+            flush();
+            long long sent_before = batches_sent_;
+            // How many messages have been sent to this rank in total, against how many it has received
+            long long expected = 0;
+            mpiw::check(MPI_Reduce_scatter_block(batches_to_.data(), &expected, 1, MPI_LONG_LONG, MPI_SUM, comm_),
+                        "MPI_Reduce_scatter_block");
+            while (batches_received_ < expected) {
+                poll();
+            }
+            // Handlers may have sent more while this rank drained its messages
+            flush();
+            long long more = batches_sent_ - sent_before, any = 0;
+            mpiw::check(MPI_Allreduce(&more, &any, 1, MPI_LONG_LONG, MPI_SUM, comm_), "MPI_Allreduce");
+            if (any == 0) {
+                break;
+            }
+        }
+        for (InFlight& f : in_flight_) {
+            mpiw::check(MPI_Wait(&f.request, MPI_STATUS_IGNORE), "MPI_Wait");
+            spare_.push_back(std::move(f.data));
+        }
+        in_flight_.clear();
+    }
+
+    long long records_sent() const { return records_sent_; }
+    long long batches_sent() const { return batches_sent_; }
+    long long bytes_sent() const { return bytes_sent_; }
+
+private:
+    static const size_t header_bytes = sizeof(uint32_t) + sizeof(uint16_t);
+
+    struct Buffer {
+        std::vector<char> data;
+        double since = 0.0;  // When the first record went in
+    };
+
+    struct InFlight {
+        std::vector<char> data;
+        MPI_Request request = MPI_REQUEST_NULL;
+    };
+
+    // An empty buffer with room for buffer_bytes_, reusing the memory of completed sends
+    std::vector<char> take_buffer() {
+        std::vector<char> data;
+        if (!spare_.empty()) {
+            data = std::move(spare_.back());
+            spare_.pop_back();
+            data.clear();
+        }
+        data.reserve(buffer_bytes_);
+        return data;
+    }
+
+    void dispatch(int source, int bytes) {
+        for (int at = 0; at < bytes;) {
+            uint32_t length;
+            uint16_t id;
+            std::memcpy(&length, &recv_buf_[at], sizeof(length));
+            std::memcpy(&id, &recv_buf_[at + sizeof(length)], sizeof(id));
+            handlers_[id](source, &recv_buf_[at + header_bytes], length);
+            at += (int)(header_bytes + length);
+        }
+    }
+
+    MPI_Comm comm_;
+    size_t buffer_bytes_;
+    double flush_interval_;
+    int tag_;
+    std::vector<Handler> handlers_;
+    std::vector<Buffer> buffers_;            // Per destination
+    std::vector<InFlight> in_flight_;
+    std::vector<std::vector<char>> spare_;   // Buffers of completed sends
+    std::vector<char> recv_buf_;
+    std::vector<long long> batches_to_;      // Messages sent per destination, ever
+    long long batches_received_ = 0;
+    long long records_sent_ = 0, batches_sent_ = 0, bytes_sent_ = 0;
+};
+
+#endif // MSG_AGGREGATOR_HPP
@@ -0,0 +1,183 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing pool for data-parallel loops, header-only.
+//
+// parallel_for(begin, end, grain, body) cuts [begin, end) into chunks of at most
+// grain indices and deals them out in contiguous runs, one run per thread, so
+// neighbouring chunks start on the same core. A thread takes chunks from the
+// front of its own queue and, once that is empty, steals from the back of the
+// others, which evens out slow chunks and uneven cores. The calling thread is
+// thread 0 and computes too, so a pool of n threads starts n - 1 workers.
+//
+// An optional progress function is called by the calling thread only, between
+// its chunks and while it waits for the workers; with drive set the calling
+// thread computes nothing and just calls progress() until the loop is done. That
+// thread can then be the only one that talks to MPI (MPI_THREAD_FUNNELED) and
+// drive communication while the others compute.
+//
+// Loop bodies must not call parallel_for themselves.
+
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads) : queues_(threads > 0 ? threads : 1) {
+        for (int t = 1; t < (int)queues_.size(); ++t) {
+            workers_.emplace_back([this, t] { worker(t); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& w : workers_) {
+            w.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return (int)queues_.size(); }
+
+    // Chunks taken from another thread's queue since the pool was created
+    long long steals() const { return steals_.load(std::memory_order_relaxed); }
+
+    // Run body(lo, hi) over [begin, end) in chunks of at most grain indices. With a
+    // progress function the calling thread calls it after each chunk it runs and
+    // while it waits for the others; with drive it runs no chunks at all.
+    void parallel_for(int begin, int end, int grain, const std::function<void(int, int)>& body,
+                      const std::function<void()>& progress = nullptr, bool drive = false) {
+        bool compute = !drive || queues_.size() == 1;  // Without workers the caller has to compute
+        if (!start(begin, end, grain, body, compute ? 0 : 1)) {
+            return;
+        }
+        while (compute && run_one(0)) {
+            if (progress) {
+                progress();
+            }
+        }
+        while (progress && remaining_.load(std::memory_order_acquire) > 0) {
+            progress();
+        }
+        finish();
+    }
+
+private:
+    struct Chunk {
+        int begin, end;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Chunk> chunks;
+    };
+
+    // Deal the chunks out over threads [first, size()) and wake the workers;
+    // false if there is nothing to do
+    bool start(int begin, int end, int grain, const std::function<void(int, int)>& body, int first) {
+        if (end <= begin) {
+            return false;
+        }
+        grain = grain > 0 ? grain : 1;
+        int chunks = (end - begin + grain - 1) / grain;
+        int threads = (int)queues_.size() - first;
+        body_ = &body;
+        remaining_.store(chunks, std::memory_order_relaxed);
+        for (int t = 0; t < threads; ++t) {
+            Queue& q = queues_[first + t];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            for (int c = (long long)chunks * t / threads; c < (long long)chunks * (t + 1) / threads; ++c) {
+                int lo = begin + c * grain;
+                q.chunks.push_back({lo, lo + grain < end ? lo + grain : end});
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++generation_;
+        }
+        wake_.notify_all();
+        return true;
+    }
+
+    // Wait until every chunk has run; the caller has already run out of chunks to take
+    void finish() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return remaining_.load(std::memory_order_acquire) == 0; });
+        body_ = nullptr;
+    }
+
+    // Run one chunk from this thread's queue or stolen from another; false if all queues are empty
+    bool run_one(int self) {
+        Chunk chunk;
+        bool found = pop(queues_[self], chunk, true);
+        for (int i = 1; !found && i < (int)queues_.size(); ++i) {
+            found = pop(queues_[(self + i) % queues_.size()], chunk, false);
+            if (found) {
+                steals_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        if (!found) {
+            return false;
+        }
+        (*body_)(chunk.begin, chunk.end);
+        if (remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.notify_all();
+        }
+        return true;
+    }
+
+    static bool pop(Queue& q, Chunk& chunk, bool front) {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (q.chunks.empty()) {
+            return false;
+        }
+        if (front) {
+            chunk = q.chunks.front();
+            q.chunks.pop_front();
+        } else {
+            chunk = q.chunks.back();
+            q.chunks.pop_back();
+        }
+        return true;
+    }
+
+    void worker(int self) {
+        long long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) {
+                    return;
+                }
+                seen = generation_;
+            }
+            while (run_one(self)) {
+            }
+        }
+    }
+
+    std::vector<Queue> queues_;
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_, done_;
+    long long generation_ = 0;
+    bool stop_ = false;
+    const std::function<void(int, int)>* body_ = nullptr;
+    std::atomic<int> remaining_{0};
+    std::atomic<long long> steals_{0};
+};
+
+#endif // THREAD_POOL_HPP